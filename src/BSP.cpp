@@ -1,7 +1,9 @@
 #include "BSP.h"
 #include "delaunay.h"
+#include "mesh_io.h"
+#include "parallel.h"
+#include "trace.h"
 #include <algorithm>
-#include <fstream>
 #include <iostream>
 #include <set>
 #include <time.h>
@@ -330,7 +332,7 @@ void BSPcomplex::vrts_orient_wrtPlane(const vector<uint32_t> &vrts_inds,
     if (isVertexBuiltFromPlane(p, &p0, &p1, &p2))
       vrts_orBin[vrts_inds[v]] = 0;
     else {
-      vrts_orBin[vrts_inds[v]] = genericPoint::orient3D(*p, p0, p2, p1);
+      vrts_orBin[vrts_inds[v]] = CountedPredicates::orient3D(*p, p0, p2, p1);
     }
   }
 }
@@ -382,7 +384,7 @@ BSPcomplex::constraint_innerIntersects_face(const vector<uint32_t> &face_vrts) {
 //
 //
 bool BSPcomplex::coplanar_constraint_innerIntersects_face(
-    const std::vector<uint64_t> &fedges, const uint32_t tri[3], int xyz) {
+    const edge_list_t &fedges, const uint32_t tri[3], int xyz) {
   // ASSUMPTION: No face vertices are in the interior of the constraint
 
   // Process: intersection must be bound by at least three unaligned points on
@@ -423,7 +425,8 @@ bool BSPcomplex::coplanar_constraint_innerIntersects_face(
         const BSPedge &edge = edges[fedges[e]];
         const genericPoint *ev1 = vertices[edge.vertices[0]];
         const genericPoint *ev2 = vertices[edge.vertices[1]];
-        if (genericPoint::pointInInnerSegment(*vertices[tri[i]], *ev1, *ev2, xyz)) {
+        if (CountedPredicates::pointInInnerSegment(*vertices[tri[i]], *ev1,
+                                                   *ev2, xyz)) {
           mask |= (1 << i);
           break;
         }
@@ -450,7 +453,8 @@ bool BSPcomplex::coplanar_constraint_innerIntersects_face(
       vid = (vid == edge.vertices[0])? edge.vertices[1] : edge.vertices[0];
       const genericPoint *ev1 = vertices[tri[ti0]];
       const genericPoint *ev2 = vertices[tri[ti1]];
-      if (genericPoint::pointInInnerSegment(*vertices[vid], *ev1, *ev2, xyz)) {
+      if (CountedPredicates::pointInInnerSegment(*vertices[vid], *ev1, *ev2,
+                                                 xyz)) {
         mask |= (1 << ti0);
         mask |= (1 << ti1);
         break;
@@ -471,7 +475,7 @@ bool BSPcomplex::coplanar_constraint_innerIntersects_face(
       const genericPoint *ev2 = vertices[edge.vertices[1]];
       const genericPoint *fv1 = vertices[tri[ti0]];
       const genericPoint *fv2 = vertices[tri[ti1]];
-      if (genericPoint::innerSegmentsCross(*ev1, *ev2, *fv1, *fv2, xyz))
+      if (CountedPredicates::innerSegmentsCross(*ev1, *ev2, *fv1, *fv2, xyz))
         return true;
     }
   }
@@ -486,17 +490,17 @@ int localizedPointInTriangle(const genericPoint &P, const genericPoint &A,
                              int xyz) {
   int o1, o2, o3;
   if (xyz == 2) {
-    o1 = genericPoint::orient2Dxy(P, A, B);
-    o2 = genericPoint::orient2Dxy(P, B, C);
-    o3 = genericPoint::orient2Dxy(P, C, A);
+    o1 = CountedPredicates::orient2Dxy(P, A, B);
+    o2 = CountedPredicates::orient2Dxy(P, B, C);
+    o3 = CountedPredicates::orient2Dxy(P, C, A);
   } else if (xyz == 0) {
-    o1 = genericPoint::orient2Dyz(P, A, B);
-    o2 = genericPoint::orient2Dyz(P, B, C);
-    o3 = genericPoint::orient2Dyz(P, C, A);
+    o1 = CountedPredicates::orient2Dyz(P, A, B);
+    o2 = CountedPredicates::orient2Dyz(P, B, C);
+    o3 = CountedPredicates::orient2Dyz(P, C, A);
   } else {
-    o1 = genericPoint::orient2Dzx(P, A, B);
-    o2 = genericPoint::orient2Dzx(P, B, C);
-    o3 = genericPoint::orient2Dzx(P, C, A);
+    o1 = CountedPredicates::orient2Dzx(P, A, B);
+    o2 = CountedPredicates::orient2Dzx(P, B, C);
+    o3 = CountedPredicates::orient2Dzx(P, C, A);
   }
   return ((o1 >= 0 && o2 >= 0 && o3 >= 0) || (o1 <= 0 && o2 <= 0 && o3 <= 0)) +
          ((o1 > 0 && o2 > 0 && o3 > 0) || (o1 < 0 && o2 < 0 && o3 < 0));
@@ -615,15 +619,16 @@ inline bool BSPcomplex::tet_face_isNew(uint64_t tet_i, uint64_t adjtet_i,
 //
 //
 inline void BSPcomplex::fill_face_colour(uint64_t tet_i, uint64_t face_i,
-                                         const uint32_t **map_fi,
-                                         const uint32_t *num_map_fi) {
-  if (num_map_fi[tet_i] == 0)
+                                         const TetConstraintMap &map_fi) {
+  const uint32_t num = map_fi.count(tet_i);
+  const uint32_t *constr = map_fi.list(tet_i);
+  if (num == 0)
     faces[face_i].colour = WHITE;
   else {
     // Count non-virtual constraints.
     uint32_t n = 0;
-    for (uint32_t cc = 0; cc < num_map_fi[tet_i]; cc++)
-      if (!is_virtual(map_fi[tet_i][cc]))
+    for (uint32_t cc = 0; cc < num; cc++)
+      if (!is_virtual(constr[cc]))
         n++;
 
     if (n == 0)
@@ -632,27 +637,53 @@ inline void BSPcomplex::fill_face_colour(uint64_t tet_i, uint64_t face_i,
       faces[face_i].colour = GREY;
       faces[face_i].coplanar_constraints.resize(n);
       uint32_t pos = 0;
-      for (uint32_t cc = 0; cc < num_map_fi[tet_i]; cc++)
-        if (!is_virtual(map_fi[tet_i][cc]))
-          faces[face_i].coplanar_constraints[pos++] = map_fi[tet_i][cc];
+      for (uint32_t cc = 0; cc < num; cc++)
+        if (!is_virtual(constr[cc]))
+          faces[face_i].coplanar_constraints[pos++] = constr[cc];
     }
   }
 }
 
-// Fills the data scruture with the information of the Delauany mesh.
 BSPcomplex::BSPcomplex(const TetMesh *mesh, const Constraint *_constraints,
-                       const uint32_t **map, const uint32_t *num_map,
-                       const uint32_t **map_f0, const uint32_t *num_map_f0,
-                       const uint32_t **map_f1, const uint32_t *num_map_f1,
-                       const uint32_t **map_f2, const uint32_t *num_map_f2,
-                       const uint32_t **map_f3, const uint32_t *num_map_f3) {
+                       const TetConstraintMap &map,
+                       const TetConstraintMap &map_f0,
+                       const TetConstraintMap &map_f1,
+                       const TetConstraintMap &map_f2,
+                       const TetConstraintMap &map_f3) {
+  init(mesh, _constraints, map, map_f0, map_f1, map_f2, map_f3);
+}
+
+void BSPcomplex::clear() {
+  vertices.clear();
+  edges.clear();
+  faces.clear();
+  cells.clear();
+  constraints_verts.clear();
+  constraint_group.clear();
+  first_virtual_constraint = 0;
+  vrts_orBin.clear();
+  vrts_visit.clear();
+  edge_visit.clear();
+  explicit_arena.reset();
+  lpi_arena.reset();
+  tpi_arena.reset();
+}
+
+// Fills the data scruture with the information of the Delauany mesh.
+void BSPcomplex::init(const TetMesh *mesh, const Constraint *_constraints,
+                      const TetConstraintMap &map,
+                      const TetConstraintMap &map_f0,
+                      const TetConstraintMap &map_f1,
+                      const TetConstraintMap &map_f2,
+                      const TetConstraintMap &map_f3) {
+  TRACE_SPAN("complex_init");
 
   // Uploading the vertices of the mesh
   vertices.resize(mesh->num_vertices);
   for (uint32_t i = 0; i < mesh->num_vertices; i++)
-    vertices[i] = new explicitPoint3D(mesh->vertices[i].coord[0],
-                                        mesh->vertices[i].coord[1],
-                                        mesh->vertices[i].coord[2]);
+    vertices[i] = explicit_arena.create(mesh->vertices[i].coord[0],
+                                          mesh->vertices[i].coord[1],
+                                          mesh->vertices[i].coord[2]);
 
   // Initialize vrts_orBin:
   // since orient3D can be -1, 0 or 1 all elements are set to 2.
@@ -696,11 +727,9 @@ BSPcomplex::BSPcomplex(const TetMesh *mesh, const Constraint *_constraints,
     // have been already turned into BSP cells.
 
     // Constraint improperly intersecated by tet.
-    if (num_map[tet_i] > 0) {
-      cells[cell_i].constraints.resize(num_map[tet_i]);
-      for (uint32_t i = 0; i < num_map[tet_i]; i++)
-        cells[cell_i].constraints[i] = map[tet_i][i];
-    }
+    if (map.count(tet_i) > 0)
+      cells[cell_i].constraints.assign(map.list(tet_i),
+                                       map.list(tet_i) + map.count(tet_i));
 
     // Adding BSPface and BSPedges to create a BSPcell conformed to tetrahedron.
     uint32_t v[4]; // Indices of tet vertices.
@@ -724,7 +753,7 @@ BSPcomplex::BSPcomplex(const TetMesh *mesh, const Constraint *_constraints,
       tet_edge[1] = add_tetEdge(mesh, v[1], v[2], tet_i, new_order);
       assign_edge_to_face(tet_edge[1], face_i);
       // Color and coplanar-constraints
-      fill_face_colour(tet_i, face_i, map_f3, num_map_f3);
+      fill_face_colour(tet_i, face_i, map_f3);
     } else {
       face_i = faceSharedWithCell(cell_i, adjcell_i);
       BSPface &face = faces[face_i];
@@ -745,7 +774,7 @@ BSPcomplex::BSPcomplex(const TetMesh *mesh, const Constraint *_constraints,
       // <v0,v1> is tet_edge[0].
       assign_edge_to_face(tet_edge[0], face_i);
       // Color and coplanar-constraints
-      fill_face_colour(tet_i, face_i, map_f2, num_map_f2);
+      fill_face_colour(tet_i, face_i, map_f2);
     } else {
       face_i = faceSharedWithCell(cell_i, adjcell_i);
       BSPface &face = faces[face_i];
@@ -764,7 +793,7 @@ BSPcomplex::BSPcomplex(const TetMesh *mesh, const Constraint *_constraints,
       assign_edge_to_face(tet_edge[2], face_i);
       assign_edge_to_face(tet_edge[3], face_i);
       // Color and coplanar-constraints
-      fill_face_colour(tet_i, face_i, map_f1, num_map_f1);
+      fill_face_colour(tet_i, face_i, map_f1);
     } else {
       face_i = faceSharedWithCell(cell_i, adjcell_i);
       tet_edge[5] = find_face_edge(faces[face_i], v[2], v[3]);
@@ -780,7 +809,7 @@ BSPcomplex::BSPcomplex(const TetMesh *mesh, const Constraint *_constraints,
       assign_edge_to_face(tet_edge[5], face_i);
       assign_edge_to_face(tet_edge[4], face_i);
       // Color and coplanar-constraints
-      fill_face_colour(tet_i, face_i, map_f0, num_map_f0);
+      fill_face_colour(tet_i, face_i, map_f0);
     }
   }
 
@@ -1253,7 +1282,7 @@ void BSPcomplex::fixCommonFaceOrientation(uint64_t cf_id) {
     if (edges_ShareCommonPlanes(edge1, edge))
       continue;
     genericPoint *v2 = vertices[vid];
-    int ori = ori0 * genericPoint::orient2D(*v0, *v1, *v2, xyz);
+    int ori = ori0 * CountedPredicates::orient2D(*v0, *v1, *v2, xyz);
     if (ori < 0)
       return;
     if (ori > 0) {
@@ -1283,7 +1312,7 @@ uint32_t BSPcomplex::add_LPIvrt(const BSPedge &edge, uint32_t constr) {
   genericPoint *e0 = vertices[edge.meshVertices[0]];
   genericPoint *e1 = vertices[edge.meshVertices[1]];
 
-  vertices.push_back(new implicitPoint3D_LPI(
+  vertices.push_back(lpi_arena.create(
       e0->toExplicit3D(), e1->toExplicit3D(), c0->toExplicit3D(),
       c1->toExplicit3D(), c2->toExplicit3D()));
 
@@ -1332,22 +1361,22 @@ uint32_t BSPcomplex::add_TPIvrt(const BSPedge &edge, uint32_t constr) {
   // If two of the three triangles share two vertices -> create an LPI
   uint32_t comm[3];
   if (twoEqualVertices(ic0, ic1, ic2, ie0, ie1, ie2, comm))
-    vertices.push_back(new implicitPoint3D_LPI(
+    vertices.push_back(lpi_arena.create(
         vertices[comm[0]]->toExplicit3D(), vertices[comm[1]]->toExplicit3D(),
         vertices[ie3]->toExplicit3D(), vertices[ie4]->toExplicit3D(),
         vertices[ie5]->toExplicit3D()));
   else if (twoEqualVertices(ic0, ic1, ic2, ie3, ie4, ie5, comm))
-    vertices.push_back(new implicitPoint3D_LPI(
+    vertices.push_back(lpi_arena.create(
         vertices[comm[0]]->toExplicit3D(), vertices[comm[1]]->toExplicit3D(),
         vertices[ie0]->toExplicit3D(), vertices[ie1]->toExplicit3D(),
         vertices[ie2]->toExplicit3D()));
   else if (twoEqualVertices(ie3, ie4, ie5, ie0, ie1, ie2, comm))
-    vertices.push_back(new implicitPoint3D_LPI(
+    vertices.push_back(lpi_arena.create(
         vertices[comm[0]]->toExplicit3D(), vertices[comm[1]]->toExplicit3D(),
         vertices[ic0]->toExplicit3D(), vertices[ic1]->toExplicit3D(),
         vertices[ic2]->toExplicit3D()));
   else {
-    vertices.push_back(new implicitPoint3D_TPI(
+    vertices.push_back(tpi_arena.create(
         vertices[ie0]->toExplicit3D(), vertices[ie1]->toExplicit3D(),
         vertices[ie2]->toExplicit3D(), vertices[ie3]->toExplicit3D(),
         vertices[ie4]->toExplicit3D(), vertices[ie5]->toExplicit3D(),
@@ -1369,10 +1398,10 @@ uint32_t BSPcomplex::add_TPIvrt(const BSPedge &edge, uint32_t constr) {
 // return the face in 'c' that shares 'e0' with 'f0'
 uint64_t BSPcomplex::getOppositeEdgeFace(const uint64_t e0, const uint64_t f0,
                                          const uint64_t c) {
-  const std::vector<uint64_t> &cfaces = cells[c].faces;
+  const face_list_t &cfaces = cells[c].faces;
   for (uint64_t fid : cfaces)
     if (fid != f0) {
-      const std::vector<uint64_t> &fedges = faces[fid].edges;
+      const edge_list_t &fedges = faces[fid].edges;
       for (uint64_t e : fedges)
         if (e == e0)
           return fid;
@@ -1735,8 +1764,8 @@ bool BSPcomplex::is_baricenter_inFace(const BSPface &face,
     else
       vid = edge.vertices[0];
 
-    const int ao = genericPoint::orient2D(face_center, *vertices[pvid],
-                                          *vertices[vid], max_normComp);
+    const int ao = CountedPredicates::orient2D(
+        face_center, *vertices[pvid], *vertices[vid], max_normComp);
     if (ao == 0)
       break;
     if (ao != oro) {
@@ -1795,7 +1824,7 @@ uint32_t BSPcomplex::blackAB_or_white(uint64_t face_i, bool two_input) {
       const genericPoint *c1 = vertices[constraints_verts[constr_ID + 1]];
       const genericPoint *c2 = vertices[constraints_verts[constr_ID + 2]];
 
-      if (genericPoint::pointInTriangle(face_center, *c0, *c1, *c2, xyz)) {
+      if (CountedPredicates::pointInTriangle(face_center, *c0, *c1, *c2, xyz)) {
 
         if (!two_input)
           return BLACK_A;
@@ -1909,144 +1938,160 @@ uint32_t BSPcomplex::blackAB_or_white(uint64_t face_i, bool two_input) {
   }
 }
 
-void BSPcomplex::saveSkin(const char *filename, const char bool_opcode) {
-  if (bool_opcode == 'U') { // Union
-    for (BSPcell &cell : cells)
-      cell.place = (cell.place == INTERNAL_A || cell.place == INTERNAL_B ||
-                    cell.place == INTERNAL_AB)? (INTERNAL_A) : (EXTERNAL);
-  }
+//  Input: complex, name of the file: filename, faces to save: fcs,
+//         vector of flags: reversed (empty if no face is reversed),
+//         flag: triangulate, number of threads: num_threads.
+// Output: saves the faces to an OFF file. A face i is reversed if
+//         reversed[i] is not 0. If triangulate is true, a face that is not a
+//         triangle is split by joining its centre (a new vertex, after the
+//         vertices of the complex) with its edges, as in tetrahedrize.
+static void save_faces_OFF(BSPcomplex &complex, const char *filename,
+                           const vector<uint64_t> &fcs,
+                           const vector<uint8_t> &reversed, bool triangulate,
+                           uint32_t num_threads) {
+  if (num_threads == 0)
+    num_threads = 1;
+  vector<uint32_t> &vrts_visit = complex.vrts_visit;
+  vector<uint64_t> &edge_visit = complex.edge_visit;
+  for (size_t i = 0; i < vrts_visit.size(); i++)
+    vrts_visit[i] = 0;
+  for (size_t i = 0; i < complex.edges.size(); i++)
+    edge_visit[i] = 0;
 
-  else if (bool_opcode == 'I') { // Intersection
-    for (BSPcell &cell : cells)
-      cell.place = (cell.place == INTERNAL_AB) ? (INTERNAL_A) : (EXTERNAL);
+  for (uint64_t f_i : fcs)
+    for (uint64_t eid : complex.faces[f_i].edges)
+      edge_visit[eid] = 1;
+  for (size_t i = 0; i < complex.edges.size(); i++)
+    if (edge_visit[i])
+      vrts_visit[complex.edges[i].vertices[0]] =
+          vrts_visit[complex.edges[i].vertices[1]] = 1;
+
+  vector<uint32_t> vmap(complex.vertices.size(), UINT32_MAX);
+  vector<uint32_t> used_vrts;
+  for (uint32_t v = 0; v < complex.vertices.size(); v++)
+    if (vrts_visit[v]) {
+      vmap[v] = (uint32_t)used_vrts.size();
+      used_vrts.push_back(v);
+    }
+  const uint64_t num_vrts = used_vrts.size();
+
+  // Every face writes its polygons at a precomputed position.
+  vector<uint64_t> face_start(1, 0);
+  vector<uint64_t> fcs_start(fcs.size() + 1, 0);
+  vector<uint32_t> centre_ind(fcs.size(), UINT32_MAX);
+  uint32_t num_centres = 0;
+  for (size_t i = 0; i < fcs.size(); i++) {
+    const uint64_t n = complex.faces[fcs[i]].edges.size();
+    if (triangulate && n > 3) {
+      centre_ind[i] = num_centres++;
+      for (uint64_t j = 0; j < n; j++)
+        face_start.push_back(face_start.back() + 3);
+    } else
+      face_start.push_back(face_start.back() + n);
+    fcs_start[i + 1] = face_start.back();
   }
 
-  else if (bool_opcode == 'D') { // Difference A\B
-    for (BSPcell &cell : cells)
-      cell.place = (cell.place == INTERNAL_A && !(cell.place == INTERNAL_AB))
-                       ? (INTERNAL_A) : (EXTERNAL);
+  vector<double> coords(3 * (num_vrts + num_centres));
+  vector<uint32_t> face_vrts(face_start.back());
+  {
+    // Approximate coordinates are computed as in the rest of the pipeline,
+    // the file is written in the caller's environment.
+    FPUscope fpu_scope;
+    initFPU();
+    parallel_run(num_threads, [&](uint32_t t) {
+      for (uint64_t i = t; i < num_vrts; i += num_threads) {
+        double *p = coords.data() + 3 * i;
+        complex.vertices[used_vrts[i]]->getApproxXYZCoordinates(p[0], p[1],
+                                                                p[2]);
+      }
+    });
+    parallel_run(num_threads, [&](uint32_t t) {
+      vector<uint32_t> fv;
+      for (size_t i = t; i < fcs.size(); i += num_threads) {
+        BSPface &face = complex.faces[fcs[i]];
+        fv.resize(face.edges.size());
+        complex.list_faceVertices(face, fv);
+        if (!reversed.empty() && reversed[i])
+          std::reverse(fv.begin(), fv.end());
+        for (uint32_t &v : fv)
+          v = vmap[v];
+
+        uint32_t *out = face_vrts.data() + fcs_start[i];
+        const size_t n = fv.size();
+        if (centre_ind[i] == UINT32_MAX) {
+          std::copy(fv.begin(), fv.end(), out);
+          continue;
+        }
+        const uint32_t c = (uint32_t)(num_vrts + centre_ind[i]);
+        double *p = coords.data() + 3 * (uint64_t)c;
+        p[0] = p[1] = p[2] = 0;
+        for (uint32_t v : fv)
+          for (int k = 0; k < 3; k++)
+            p[k] += coords[3 * (uint64_t)v + k];
+        for (int k = 0; k < 3; k++)
+          p[k] /= n;
+        for (size_t j = 0; j < n; j++) {
+          out[3 * j] = c;
+          out[3 * j + 1] = fv[j];
+          out[3 * j + 2] = fv[(j + 1) % n];
+        }
+      }
+    });
   }
 
-  // Set "internal" depending on bool_opcode and find border faces to save
+  save_OFF_file(filename, coords.data(), num_vrts + num_centres,
+                face_start.data(), face_start.size() - 1, face_vrts.data(),
+                num_threads);
+}
+
+void BSPcomplex::saveSkin(const char *filename, const char bool_opcode,
+                          bool triangulate, uint32_t num_threads) {
+  TRACE_SPAN("save_skin");
+  // Find border faces to save
   vector<uint64_t> mark(faces.size(), 0);
   for (BSPcell &cell : cells)
-    if (cell.place == INTERNAL_A)
+    if (place_in_volume(cell.place, bool_opcode))
       for (uint64_t fi = 0; fi < cell.faces.size(); fi++)
         mark[cell.faces[fi]]++;
 
-  for (size_t i = 0; i < vrts_visit.size(); i++)
-    vrts_visit[i] = 0;
-  for (size_t i = 0; i < edges.size(); i++)
-    edge_visit[i] = 0;
-
-  uint64_t num_border_faces = 0;
+  // Faces are oriented towards the outside of the volume
+  vector<uint64_t> border_faces;
+  vector<uint8_t> reversed;
   for (uint64_t f_i = 0; f_i < faces.size(); f_i++)
     if (mark[f_i] == 1) {
-      num_border_faces++;
-      for (uint64_t eid : faces[f_i].edges)
-        edge_visit[eid] = 1;
+      border_faces.push_back(f_i);
+      reversed.push_back(
+          place_in_volume(cells[faces[f_i].conn_cells[0]].place, bool_opcode));
     }
-  for (size_t i = 0; i < edges.size(); i++)
-    if (edge_visit[i])
-      vrts_visit[edges[i].vertices[0]] = vrts_visit[edges[i].vertices[1]] = 1;
-
-  std::vector<uint32_t> vmap(vertices.size(), 0);
-  size_t num_v = 0;
-  for (size_t i = 0; i < vrts_visit.size(); i++) {
-    vmap[i] = (uint32_t)num_v;
-    if (vrts_visit[i])
-      num_v++;
-  }
-
-  ofstream f(filename);
-
-  if (!f)
-    ip_error("BSPcomplex::saveSkin: cannot open the file.\n");
 
-  f << "OFF\n";
-  f << num_v << " ";
-  f << num_border_faces << " ";
-  f << "0\n";
-
-  // Print vertices coordinates
-  for (uint32_t v = 0; v < vertices.size(); v++)
-    if (vrts_visit[v])
-      f << (*(vertices)[v]) << "\n";
-
-  // Print border faces
-  for (uint32_t f_i = 0; f_i < faces.size(); f_i++)
-    if (mark[f_i] == 1) {
-      BSPface &face = faces[f_i];
-      vector<uint32_t> face_vrts(face.edges.size(), UINT32_MAX);
-      list_faceVertices(face, face_vrts);
-      f << face_vrts.size();
-
-      if (cells[face.conn_cells[0]].place == INTERNAL_A)
-        for (uint32_t v = (uint32_t)face_vrts.size(); v > 0; v--)
-          f << " " << vmap[face_vrts[v - 1]];
-      else
-        for (uint32_t v = 0; v < face_vrts.size(); v++)
-          f << " " << vmap[face_vrts[v]];
-
-      f << "\n";
-    }
-
-  f.close();
+  save_faces_OFF(*this, filename, border_faces, reversed, triangulate,
+                 num_threads);
 }
 
-void BSPcomplex::saveBlackFaces(const char *filename) {
-  ofstream f(filename);
-
-  if (!f)
-    ip_error("BSPcomplex::saveBlackFaces: cannot open the file.\n");
-
-  for (size_t i = 0; i < vrts_visit.size(); i++)
-    vrts_visit[i] = 0;
-  for (size_t i = 0; i < edges.size(); i++)
-    edge_visit[i] = 0;
-
-  uint64_t num_border_faces = 0;
+void BSPcomplex::saveBlackFaces(const char *filename, uint32_t num_threads) {
+  TRACE_SPAN("save_black_faces");
+  vector<uint64_t> black_faces;
   for (uint64_t f_i = 0; f_i < faces.size(); f_i++)
-    if (faces[f_i].colour != WHITE) {
-      num_border_faces++;
-      for (uint64_t eid : faces[f_i].edges)
-        edge_visit[eid] = 1;
-    }
-  for (size_t i = 0; i < edges.size(); i++)
-    if (edge_visit[i])
-      vrts_visit[edges[i].vertices[0]] = vrts_visit[edges[i].vertices[1]] = 1;
-
-  std::vector<uint32_t> vmap(vertices.size(), 0);
-  size_t num_v = 0;
-  for (size_t i = 0; i < vrts_visit.size(); i++) {
-    vmap[i] = (uint32_t)num_v;
-    if (vrts_visit[i])
-      num_v++;
-  }
+    if (faces[f_i].colour != WHITE)
+      black_faces.push_back(f_i);
 
-  f << "OFF\n";
-  f << num_v << " ";
-  f << num_border_faces << " ";
-  f << "0\n";
-
-  // Print vertices coordinates
-  for (uint32_t v = 0; v < vertices.size(); v++)
-    if (vrts_visit[v])
-      f << (*(vertices)[v]) << "\n";
-
-  // Print border faces
-  for (uint32_t f_i = 0; f_i < faces.size(); f_i++)
-    if (faces[f_i].colour != WHITE) {
-      BSPface &face = faces[f_i];
-      vector<uint32_t> face_vrts(face.edges.size(), UINT32_MAX);
-      list_faceVertices(face, face_vrts);
-      f << face_vrts.size();
-
-      for (uint32_t v = 0; v < face_vrts.size(); v++)
-        f << " " << vmap[face_vrts[v]];
-
-      f << "\n";
-    }
+  save_faces_OFF(*this, filename, black_faces, vector<uint8_t>(), false,
+                 num_threads);
+}
 
-  f.close();
+//  Input: name of the file: filename,
+//         boolean operation: bool_opcode ('0' if there is only one input),
+//         flag: tetrahedral, number of threads: num_threads.
+// Output: saves the cells of the volume (see saveSkin) to a binary MSH file.
+// Note. MSH has no element type for general polyhedra: cells are split into
+//       tetrahedra (see tetrahedrize). Unless tetrahedral is true, each
+//       tetrahedron has, as element data "cell", the index of the cell it
+//       comes from.
+void BSPcomplex::saveMesh(const char *filename, const char bool_opcode,
+                          bool tetrahedral, uint32_t num_threads) {
+  TRACE_SPAN("save_mesh");
+  BSPtetrahedra t;
+  tetrahedrize(bool_opcode, t, num_threads);
+  save_MSH_file(filename, t.coords.data(), t.coords.size() / 3, t.tets.data(),
+                t.tets.size() / 4, (tetrahedral) ? (NULL) : (t.cell.data()));
 }
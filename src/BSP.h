@@ -4,8 +4,12 @@
 #include "conforming_mesh.h"
 #include "delaunay.h"
 #include "implicit_point.h"
+#include "mesh_stats.h"
+#include "small_vector.h"
 #include <ctype.h>
 #include <list>
+#include <memory>
+#include <new>
 #include <stdio.h>
 #include <utility>
 #include <vector>
@@ -29,6 +33,21 @@
 #define INTERNAL_AB 3
 #define EXTERNAL 0
 
+// Returns true if a cell with place 'place' belongs to the volume resulting
+// from bool_opcode ('0' if there is only one input).
+inline bool place_in_volume(uint32_t place, const char bool_opcode) {
+  if (bool_opcode == 'U') // Union
+    return (place == INTERNAL_A || place == INTERNAL_B || place == INTERNAL_AB);
+  if (bool_opcode == 'I') // Intersection
+    return (place == INTERNAL_AB);
+  return (place == INTERNAL_A); // One input or difference A\B
+}
+
+// Adjacency lists of faces and cells. Most of them are short and are stored
+// inline, which saves a heap block per list.
+typedef SmallVector<uint64_t, 4> edge_list_t;   // Edges of a face
+typedef SmallVector<uint64_t, 6> face_list_t;   // Faces of a cell
+typedef SmallVector<uint32_t, 2> constr_list_t; // Constraints
 
 class BSPedge { // The edge of a BSPcell.
 public:
@@ -73,13 +92,13 @@ public:
 
 class BSPface { // The face of a BSPcell.
 public:
-  std::vector<uint64_t> edges; // BSPedges bounding the face:
+  edge_list_t edges;           // BSPedges bounding the face:
                                //   the position (i) of an edge in the vector
                                //   is such that the previous (i-1) and next
                                //   (i+i) edge are consecutive by walking the
                                //   face boundary.
   uint64_t conn_cells[2];      // The two cells that share this face.
-  std::vector<uint32_t> coplanar_constraints;
+  constr_list_t coplanar_constraints;
   uint32_t meshVertices[3]; // 3 vertices of the mesh-tet-face
                             // which contains BSPedge.
   uint32_t colour;
@@ -99,7 +118,7 @@ public:
   }
 
   BSPface(uint32_t m_v1, uint32_t m_v2, uint32_t m_v3, uint64_t c1, uint64_t c2,
-          uint32_t _colour, const vector<uint32_t> &constraints) {
+          uint32_t _colour, const constr_list_t &constraints) {
     meshVertices[0] = m_v1;
     meshVertices[1] = m_v2;
     meshVertices[2] = m_v3;
@@ -131,9 +150,9 @@ public:
 class BSPcell { // A convex polyhedron defined by the intersection of a
                 // mesh-tet and a certain number of constraints.
 public:
-  std::vector<uint64_t> faces;       // BSPfaces bounding the BSPcell.
-  std::vector<uint32_t> constraints; // Constraint that intersect
-                                     // the BSPcell.
+  face_list_t faces;         // BSPfaces bounding the BSPcell.
+  constr_list_t constraints; // Constraint that intersect
+                             // the BSPcell.
   uint32_t place = UNDEFINED; // Internal, external or undefined (see macros)
                               // w.r.t. constraints surface.
 
@@ -152,6 +171,71 @@ public:
   inline void removeFace(uint64_t face);
 };
 
+// Tetrahedra that split the cells of a volume (see BSPcomplex::tetrahedrize)
+struct BSPtetrahedra {
+  std::vector<double> coords; // Rounded vertex coordinates (x0 y0 z0 x1 ...)
+  std::vector<uint32_t> tets; // Vertices of the tetrahedra (a0 b0 c0 d0 ...),
+                              // positively oriented (rounding may flip
+                              // almost flat ones).
+  std::vector<uint64_t> cell; // Cell each tetrahedron comes from (cells of
+                              // the volume are numbered from 0).
+};
+
+// Arena of points of type T: points are constructed in large contiguous
+// slabs and destroyed all together.
+template <class T> class PointArena {
+  static const uint32_t slab_size = 4096; // Points per slab
+  std::vector<T *> slabs;
+  std::vector<uint32_t> used; // Points constructed in each slab
+  std::vector<T *> spare;     // Empty slabs kept by reset
+
+public:
+  PointArena() {}
+  ~PointArena() { clear(); }
+
+  // Constructs a new point from args
+  template <class... Args> T *create(Args &&... args) {
+    if (slabs.empty() || used.back() == slab_size) {
+      if (spare.empty())
+        slabs.push_back((T *)malloc(sizeof(T) * slab_size));
+      else {
+        slabs.push_back(spare.back());
+        spare.pop_back();
+      }
+      used.push_back(0);
+    }
+    T *p = slabs.back() + used.back()++;
+    new (p) T(std::forward<Args>(args)...);
+    return p;
+  }
+
+  // Takes the points of arena a, that is left empty
+  void adopt(PointArena &a) {
+    slabs.insert(slabs.end(), a.slabs.begin(), a.slabs.end());
+    used.insert(used.end(), a.used.begin(), a.used.end());
+    a.slabs.clear();
+    a.used.clear();
+  }
+
+  // Destroys all the points, keeps the slabs for the next ones
+  void reset() {
+    for (size_t i = 0; i < slabs.size(); i++) {
+      for (uint32_t j = 0; j < used[i]; j++)
+        slabs[i][j].~T();
+      spare.push_back(slabs[i]);
+    }
+    slabs.clear();
+    used.clear();
+  }
+
+  void clear() {
+    reset();
+    for (size_t i = 0; i < spare.size(); i++)
+      free(spare[i]);
+    spare.clear();
+  }
+};
+
 class BSPcomplex {
 public:
   std::vector<genericPoint *> vertices; // mesh vertices + new vertices.
@@ -174,23 +258,53 @@ public:
   std::vector<uint64_t> edge_visit; // To flag visited edges when needed
                                     // (same length of edges)
 
+  // Storage of the vertices
+  PointArena<explicitPoint3D> explicit_arena;
+  PointArena<implicitPoint3D_LPI> lpi_arena;
+  PointArena<implicitPoint3D_TPI> tpi_arena;
+
   BSPcomplex(const TetMesh *mesh, const Constraint *constraints,
-             const uint32_t **map, const uint32_t *num_map,
-             const uint32_t **map_f0, const uint32_t *num_map_f0,
-             const uint32_t **map_f1, const uint32_t *num_map_f1,
-             const uint32_t **map_f2, const uint32_t *num_map_f2,
-             const uint32_t **map_f3, const uint32_t *num_map_f3);
-
-  ~BSPcomplex() {
-    for (genericPoint *v : vertices)
-      delete v;
-  }
+             const TetConstraintMap &map, const TetConstraintMap &map_f0,
+             const TetConstraintMap &map_f1, const TetConstraintMap &map_f2,
+             const TetConstraintMap &map_f3);
 
-  // Save the faces representing the input constraints
-  void saveBlackFaces(const char *filename);
+  // Empty complex
+  BSPcomplex() : first_virtual_constraint(0) {}
 
-  // Save the faces that separate in and out
-  void saveSkin(const char *filename, const char bool_opcode);
+  // Fill an empty complex with the Delaunay mesh (as the constructor does)
+  void init(const TetMesh *mesh, const Constraint *constraints,
+            const TetConstraintMap &map, const TetConstraintMap &map_f0,
+            const TetConstraintMap &map_f1, const TetConstraintMap &map_f2,
+            const TetConstraintMap &map_f3);
+
+  // Remove all the elements. The memory is kept, and reused by the next
+  // init or loadSnapshot.
+  void clear();
+
+  // Save the faces representing the input constraints
+  void saveBlackFaces(const char *filename, uint32_t num_threads = 1);
+
+  // Save the faces that separate in and out (split into triangles if
+  // triangulate is true)
+  void saveSkin(const char *filename, const char bool_opcode,
+                bool triangulate = false, uint32_t num_threads = 1);
+
+  // Save the cells of the volume to a binary MSH file (see saveMesh)
+  void saveMesh(const char *filename, const char bool_opcode,
+                bool tetrahedral = false, uint32_t num_threads = 1);
+
+  // BSPsnapshot
+  // Save the complex to a binary snapshot file
+  void saveSnapshot(const char *filename);
+  // Load a snapshot saved by saveSnapshot into this complex, replacing its
+  // elements
+  void loadSnapshot(const char *filename);
+
+  // BSPtetrahedra
+  // Split the cells of the volume into tetrahedra (by num_threads threads,
+  // 0 is read as 1)
+  void tetrahedrize(const char bool_opcode, BSPtetrahedra &out,
+                    uint32_t num_threads = 1);
 
   // Complex elements relations
   inline void assign_edge_to_face(uint64_t edge, uint64_t face);
@@ -224,7 +338,7 @@ public:
   inline bool
   constraint_innerIntersects_face(const vector<uint32_t> &face_vrts);
   bool
-  coplanar_constraint_innerIntersects_face(const vector<uint64_t> &face_edges,
+  coplanar_constraint_innerIntersects_face(const edge_list_t &face_edges,
                                            const uint32_t constraint[3],
                                            const int dominant_normal_comp);
 
@@ -238,8 +352,7 @@ public:
   inline bool tet_face_isNew(uint64_t tet_ind, uint64_t adjTet_ind,
                              uint64_t adjCell_ind);
   inline void fill_face_colour(uint64_t tet_ind, uint64_t face_ind,
-                               const uint32_t **map_fi,
-                               const uint32_t *num_map_fi);
+                               const TetConstraintMap &map_fi);
 
   // BSPsubdivision
   inline void move_edge(uint64_t edge_face_ind, uint64_t face_ind,
@@ -268,6 +381,10 @@ public:
   void splitFace(uint64_t face_ind, uint32_t constr, uint64_t cell_ind,
                  const vector<uint32_t> &face_vrts);
   void splitCell(uint64_t cell_ind);
+  // Split all the cells by their constraints. Cells in different regions of
+  // the complex are split concurrently by num_threads threads. The result
+  // does not depend on num_threads.
+  void subdivide(uint32_t num_threads = 1);
   void find_coplanar_constraints(uint64_t cell_ind, uint32_t constr,
                                  vector<uint32_t> &coplanar_c);
 
@@ -285,6 +402,39 @@ public:
                          const std::vector<double> &face_costs);
 };
 
+// Read-only view of a triangle mesh stored by the caller. Vertex i is the
+// triple of doubles (x, y, z) that starts coords_stride * i bytes after
+// coords, and triangle i is the triple of vertex indices that starts
+// tri_stride * i bytes after tri_idx. A stride of 0 stands for packed
+// triples.
+struct MeshView {
+  const double *coords;
+  uint32_t npts;
+  const uint32_t *tri_idx;
+  uint32_t ntri;
+  size_t coords_stride;
+  size_t tri_stride;
+
+  MeshView()
+      : coords(NULL), npts(0), tri_idx(NULL), ntri(0), coords_stride(0),
+        tri_stride(0) {}
+
+  MeshView(const double *_coords, uint32_t _npts, const uint32_t *_tri_idx,
+           uint32_t _ntri, size_t _coords_stride = 0, size_t _tri_stride = 0)
+      : coords(_coords), npts(_npts), tri_idx(_tri_idx), ntri(_ntri),
+        coords_stride(_coords_stride), tri_stride(_tri_stride) {}
+
+  inline const double *vertex(uint32_t i) const {
+    const size_t s = (coords_stride) ? (coords_stride) : (3 * sizeof(double));
+    return (const double *)((const char *)coords + s * i);
+  }
+
+  inline const uint32_t *triangle(uint32_t i) const {
+    const size_t s = (tri_stride) ? (tri_stride) : (3 * sizeof(uint32_t));
+    return (const uint32_t *)((const char *)tri_idx + s * i);
+  }
+};
+
 /// <summary>
 /// Main function - Create a polyhedral mesh out of the input
 /// Input may be made of either one or two models to be combined into a boolean
@@ -300,12 +450,35 @@ public:
 /// triangles</param> <param name="ntri_B">Number of second model
 /// triangles</param> <param name="bool_opcode">Boolean operation (0 = no op, U
 /// = union, D = difference, I = intersection</param> <param
-/// name="verbose">Print useful info during the process</param> <param
+/// name="verbose">Print useful info during the process</param>
+/// <param name="num_threads">Number of threads used by the parallel
+/// stages (0 is read as 1)</param> <param name="complex">If not NULL, a
+/// complex that is cleared and filled in place of a new one, so that its
+/// memory is reused</param> <param name="stats">If not NULL, the time of each stage
+/// is appended to stats->stages, and the peak memory and the counts of
+/// stats are set</param> <param
 /// resulting BSPcomplex structure</returns>
 BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
                                uint32_t *tri_idx_A, uint32_t ntri_A,
                                double *coords_B = NULL, uint32_t npts_B = 0,
                                uint32_t *tri_idx_B = NULL, uint32_t ntri_B = 0,
-                               char bool_opcode = '0', bool verbose = false);
+                               char bool_opcode = '0', bool verbose = false,
+                               uint32_t num_threads = 1,
+                               BSPcomplex *complex = NULL,
+                               MeshStats *stats = NULL);
+
+/// <summary>
+/// Same as above, but the input models are views of arrays that remain owned
+/// by the caller: they are neither copied nor freed
+/// </summary>
+/// <param name="A">First model</param>
+/// <param name="B">Second model (empty if bool_opcode is '0')</param>
+/// <returns>The resulting BSPcomplex structure</returns>
+std::unique_ptr<BSPcomplex> makePolyhedralMesh(const MeshView &A,
+                                               const MeshView &B = MeshView(),
+                                               char bool_opcode = '0',
+                                               bool verbose = false,
+                                               uint32_t num_threads = 1,
+                                               MeshStats *stats = NULL);
 
 #endif /* BSP_h */
@@ -0,0 +1,335 @@
+#include "BSP.h"
+#include "mapped_file.h"
+#include "trace.h"
+#include <string.h>
+#include <unordered_map>
+
+// Binary snapshot of a BSPcomplex.
+// The file starts with a BSPsnapshotHeader, followed by these sections
+// (each one padded to a multiple of 8 bytes), in the byte order of the
+// machine that saved it:
+//   explicit vertices: x y z (doubles), they are the first num_explicit
+//                      vertices of the complex;
+//   implicit vertices: 9 indices of explicit vertices each (LPI vertices
+//                      have 5 of them, and UINT32_MAX in the other 4);
+//   edges:             BSPedge records, as they are in memory;
+//   faces:             BSPsnapshotFace records;
+//   face edges, face coplanar constraints (concatenated lists);
+//   cells:             BSPsnapshotCell records;
+//   cell faces, cell constraints (concatenated lists);
+//   constraints_verts, constraint_group.
+// Loading maps the file and rebuilds the complex with no geometric
+// computation, so a complex can be saved once and exported many times.
+#define BSP_SNAPSHOT_MAGIC "BSPsnap"
+#define BSP_SNAPSHOT_VERSION 1
+
+struct BSPsnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t one; // Tells the reader the byte order
+  uint64_t num_vertices, num_explicit, num_edges, num_faces, num_cells;
+  uint64_t num_face_edges, num_face_constraints;
+  uint64_t num_cell_faces, num_cell_constraints;
+  uint64_t num_constraints_verts, num_constraint_group;
+  uint64_t first_virtual_constraint;
+};
+
+struct BSPsnapshotFace {
+  uint64_t conn_cells[2];
+  uint32_t meshVertices[3];
+  uint32_t colour;
+  uint32_t num_edges;
+  uint32_t num_constraints;
+};
+
+struct BSPsnapshotCell {
+  uint32_t place;
+  uint32_t num_faces;
+  uint32_t num_constraints;
+  uint32_t pad;
+};
+
+// Writes count items of size bytes to f, padded to a multiple of 8 bytes.
+static void snapshot_write(FILE *f, const void *data, size_t size,
+                           size_t count) {
+  static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  const size_t pad = (8 - (size * count) % 8) % 8;
+  if ((count && fwrite(data, size, count, f) != count) ||
+      (pad && fwrite(zeros, 1, pad, f) != pad))
+    ip_error("BSPcomplex::saveSnapshot: FATAL ERROR cannot write the file\n");
+}
+
+void BSPcomplex::saveSnapshot(const char *filename) {
+  TRACE_SPAN("save_snapshot");
+  FILE *f = fopen(filename, "wb");
+  if (f == NULL)
+    ip_error("BSPcomplex::saveSnapshot: FATAL ERROR cannot open the file\n");
+
+  BSPsnapshotHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BSP_SNAPSHOT_MAGIC, sizeof(h.magic));
+  h.version = BSP_SNAPSHOT_VERSION;
+  h.one = 1;
+  h.num_vertices = vertices.size();
+  while (h.num_explicit < vertices.size() &&
+         vertices[h.num_explicit]->isExplicit3D())
+    h.num_explicit++;
+  h.num_edges = edges.size();
+  h.num_faces = faces.size();
+  h.num_cells = cells.size();
+  for (const BSPface &face : faces) {
+    h.num_face_edges += face.edges.size();
+    h.num_face_constraints += face.coplanar_constraints.size();
+  }
+  for (const BSPcell &cell : cells) {
+    h.num_cell_faces += cell.faces.size();
+    h.num_cell_constraints += cell.constraints.size();
+  }
+  h.num_constraints_verts = constraints_verts.size();
+  h.num_constraint_group = constraint_group.size();
+  h.first_virtual_constraint = first_virtual_constraint;
+  snapshot_write(f, &h, sizeof(h), 1);
+
+  // Vertices
+  std::vector<double> coords(3 * h.num_explicit);
+  std::unordered_map<const genericPoint *, uint32_t> explicit_ind;
+  explicit_ind.reserve(h.num_explicit);
+  for (uint32_t i = 0; i < h.num_explicit; i++) {
+    const explicitPoint3D &p = vertices[i]->toExplicit3D();
+    coords[3 * i] = p.X();
+    coords[3 * i + 1] = p.Y();
+    coords[3 * i + 2] = p.Z();
+    explicit_ind[&p] = i;
+  }
+  snapshot_write(f, coords.data(), sizeof(double), coords.size());
+
+  std::vector<uint32_t> implicit(9 * (h.num_vertices - h.num_explicit),
+                                 UINT32_MAX);
+  for (uint64_t i = h.num_explicit; i < h.num_vertices; i++) {
+    uint32_t *rec = implicit.data() + 9 * (i - h.num_explicit);
+    const genericPoint *v = vertices[i];
+    if (v->isLPI()) {
+      const implicitPoint3D_LPI &p = v->toLPI();
+      const explicitPoint3D *e[5] = {&p.P(), &p.Q(), &p.R(), &p.S(), &p.T()};
+      for (int j = 0; j < 5; j++)
+        rec[j] = explicit_ind.at(e[j]);
+    } else if (v->isTPI()) {
+      const implicitPoint3D_TPI &p = v->toTPI();
+      const explicitPoint3D *e[9] = {&p.V1(), &p.V2(), &p.V3(),
+                                     &p.W1(), &p.W2(), &p.W3(),
+                                     &p.U1(), &p.U2(), &p.U3()};
+      for (int j = 0; j < 9; j++)
+        rec[j] = explicit_ind.at(e[j]);
+    } else
+      ip_error("BSPcomplex::saveSnapshot: explicit vertex after implicit "
+               "ones\n");
+  }
+  snapshot_write(f, implicit.data(), sizeof(uint32_t), implicit.size());
+
+  // Edges
+  snapshot_write(f, edges.data(), sizeof(BSPedge), edges.size());
+
+  // Faces
+  std::vector<BSPsnapshotFace> face_recs(faces.size());
+  std::vector<uint64_t> face_edges;
+  std::vector<uint32_t> face_constraints;
+  face_edges.reserve(h.num_face_edges);
+  face_constraints.reserve(h.num_face_constraints);
+  for (uint64_t i = 0; i < faces.size(); i++) {
+    const BSPface &face = faces[i];
+    BSPsnapshotFace &rec = face_recs[i];
+    rec.conn_cells[0] = face.conn_cells[0];
+    rec.conn_cells[1] = face.conn_cells[1];
+    for (int j = 0; j < 3; j++)
+      rec.meshVertices[j] = face.meshVertices[j];
+    rec.colour = face.colour;
+    rec.num_edges = face.edges.size();
+    rec.num_constraints = face.coplanar_constraints.size();
+    face_edges.insert(face_edges.end(), face.edges.begin(), face.edges.end());
+    face_constraints.insert(face_constraints.end(),
+                            face.coplanar_constraints.begin(),
+                            face.coplanar_constraints.end());
+  }
+  snapshot_write(f, face_recs.data(), sizeof(BSPsnapshotFace),
+                 face_recs.size());
+  snapshot_write(f, face_edges.data(), sizeof(uint64_t), face_edges.size());
+  snapshot_write(f, face_constraints.data(), sizeof(uint32_t),
+                 face_constraints.size());
+
+  // Cells
+  std::vector<BSPsnapshotCell> cell_recs(cells.size());
+  std::vector<uint64_t> cell_faces;
+  std::vector<uint32_t> cell_constraints;
+  cell_faces.reserve(h.num_cell_faces);
+  cell_constraints.reserve(h.num_cell_constraints);
+  for (uint64_t i = 0; i < cells.size(); i++) {
+    const BSPcell &cell = cells[i];
+    BSPsnapshotCell &rec = cell_recs[i];
+    rec.place = cell.place;
+    rec.num_faces = cell.faces.size();
+    rec.num_constraints = cell.constraints.size();
+    rec.pad = 0;
+    cell_faces.insert(cell_faces.end(), cell.faces.begin(), cell.faces.end());
+    cell_constraints.insert(cell_constraints.end(), cell.constraints.begin(),
+                            cell.constraints.end());
+  }
+  snapshot_write(f, cell_recs.data(), sizeof(BSPsnapshotCell),
+                 cell_recs.size());
+  snapshot_write(f, cell_faces.data(), sizeof(uint64_t), cell_faces.size());
+  snapshot_write(f, cell_constraints.data(), sizeof(uint32_t),
+                 cell_constraints.size());
+
+  // Constraints
+  snapshot_write(f, constraints_verts.data(), sizeof(uint32_t),
+                 constraints_verts.size());
+  snapshot_write(f, constraint_group.data(), sizeof(uint32_t),
+                 constraint_group.size());
+
+  if (fclose(f) != 0)
+    ip_error("BSPcomplex::saveSnapshot: FATAL ERROR cannot write the file\n");
+}
+
+// Sequential reader of the sections of a mapped snapshot.
+class SnapshotReader {
+  const char *pos, *end;
+
+public:
+  SnapshotReader(const MappedFile &file)
+      : pos(file.data), end(file.data + file.size) {}
+
+  // Returns the next section, made of count items of type T.
+  template <class T> const T *section(uint64_t count) {
+    const uint64_t size = sizeof(T) * count;
+    const uint64_t padded = size + (8 - size % 8) % 8;
+    if (count > (uint64_t)(end - pos) / sizeof(T) ||
+        padded > (uint64_t)(end - pos))
+      ip_error("BSPcomplex::loadSnapshot: FATAL ERROR truncated file\n");
+    const T *p = (const T *)pos;
+    pos += padded;
+    return p;
+  }
+
+  bool atEnd() const { return pos == end; }
+};
+
+void BSPcomplex::loadSnapshot(const char *filename) {
+  TRACE_SPAN("load_snapshot");
+  MappedFile file;
+  if (!file.map(filename))
+    ip_error("BSPcomplex::loadSnapshot: FATAL ERROR cannot open the file\n");
+  clear();
+
+  SnapshotReader r(file);
+  const BSPsnapshotHeader h = *r.section<BSPsnapshotHeader>(1);
+  if (memcmp(h.magic, BSP_SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.one != 1)
+    ip_error("BSPcomplex::loadSnapshot: FATAL ERROR not a snapshot of this "
+             "machine\n");
+  if (h.version != BSP_SNAPSHOT_VERSION)
+    ip_error("BSPcomplex::loadSnapshot: FATAL ERROR unsupported version\n");
+  if (h.num_explicit > h.num_vertices || h.num_vertices > UINT32_MAX)
+    ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+
+  // Vertices
+  const double *coords = r.section<double>(3 * h.num_explicit);
+  const uint32_t *implicit =
+      r.section<uint32_t>(9 * (h.num_vertices - h.num_explicit));
+  vertices.resize(h.num_vertices);
+  for (uint64_t i = 0; i < h.num_explicit; i++)
+    vertices[i] = explicit_arena.create(coords[3 * i], coords[3 * i + 1],
+                                        coords[3 * i + 2]);
+  for (uint64_t i = h.num_explicit; i < h.num_vertices; i++) {
+    const uint32_t *rec = implicit + 9 * (i - h.num_explicit);
+    const bool lpi = (rec[5] == UINT32_MAX);
+    for (int j = 0; j < ((lpi) ? (5) : (9)); j++)
+      if (rec[j] >= h.num_explicit)
+        ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+    const explicitPoint3D *e[9];
+    for (int j = 0; j < ((lpi) ? (5) : (9)); j++)
+      e[j] = &vertices[rec[j]]->toExplicit3D();
+    if (lpi)
+      vertices[i] = lpi_arena.create(*e[0], *e[1], *e[2], *e[3], *e[4]);
+    else
+      vertices[i] = tpi_arena.create(*e[0], *e[1], *e[2], *e[3], *e[4],
+                                     *e[5], *e[6], *e[7], *e[8]);
+  }
+
+  // Edges
+  const BSPedge *edge_recs = r.section<BSPedge>(h.num_edges);
+  for (uint64_t i = 0; i < h.num_edges; i++)
+    if (edge_recs[i].vertices[0] >= h.num_vertices ||
+        edge_recs[i].vertices[1] >= h.num_vertices ||
+        edge_recs[i].conn_face_0 >= h.num_faces)
+      ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+  edges.assign(edge_recs, edge_recs + h.num_edges);
+
+  // Faces
+  const BSPsnapshotFace *face_recs = r.section<BSPsnapshotFace>(h.num_faces);
+  const uint64_t *face_edges = r.section<uint64_t>(h.num_face_edges);
+  const uint32_t *face_constraints =
+      r.section<uint32_t>(h.num_face_constraints);
+  faces.resize(h.num_faces);
+  uint64_t ne = 0, nc = 0;
+  for (uint64_t i = 0; i < h.num_faces; i++) {
+    const BSPsnapshotFace &rec = face_recs[i];
+    BSPface &face = faces[i];
+    if (rec.num_edges > h.num_face_edges - ne ||
+        rec.num_constraints > h.num_face_constraints - nc ||
+        rec.conn_cells[0] >= h.num_cells ||
+        (rec.conn_cells[1] >= h.num_cells && rec.conn_cells[1] != UINT64_MAX))
+      ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+    for (uint64_t j = ne; j < ne + rec.num_edges; j++)
+      if (face_edges[j] >= h.num_edges)
+        ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+    face.conn_cells[0] = rec.conn_cells[0];
+    face.conn_cells[1] = rec.conn_cells[1];
+    for (int j = 0; j < 3; j++)
+      face.meshVertices[j] = rec.meshVertices[j];
+    face.colour = rec.colour;
+    face.edges.assign(face_edges + ne, face_edges + ne + rec.num_edges);
+    face.coplanar_constraints.assign(face_constraints + nc,
+                                     face_constraints + nc +
+                                         rec.num_constraints);
+    ne += rec.num_edges;
+    nc += rec.num_constraints;
+  }
+
+  // Cells
+  const BSPsnapshotCell *cell_recs = r.section<BSPsnapshotCell>(h.num_cells);
+  const uint64_t *cell_faces = r.section<uint64_t>(h.num_cell_faces);
+  const uint32_t *cell_constraints =
+      r.section<uint32_t>(h.num_cell_constraints);
+  cells.resize(h.num_cells);
+  uint64_t nf = 0;
+  nc = 0;
+  for (uint64_t i = 0; i < h.num_cells; i++) {
+    const BSPsnapshotCell &rec = cell_recs[i];
+    BSPcell &cell = cells[i];
+    if (rec.num_faces > h.num_cell_faces - nf ||
+        rec.num_constraints > h.num_cell_constraints - nc)
+      ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+    for (uint64_t j = nf; j < nf + rec.num_faces; j++)
+      if (cell_faces[j] >= h.num_faces)
+        ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+    cell.place = rec.place;
+    cell.faces.assign(cell_faces + nf, cell_faces + nf + rec.num_faces);
+    cell.constraints.assign(cell_constraints + nc,
+                            cell_constraints + nc + rec.num_constraints);
+    nf += rec.num_faces;
+    nc += rec.num_constraints;
+  }
+
+  // Constraints
+  const uint32_t *cv = r.section<uint32_t>(h.num_constraints_verts);
+  constraints_verts.assign(cv, cv + h.num_constraints_verts);
+  const uint32_t *cg = r.section<uint32_t>(h.num_constraint_group);
+  constraint_group.assign(cg, cg + h.num_constraint_group);
+  first_virtual_constraint = (uint32_t)h.first_virtual_constraint;
+
+  if (!r.atEnd())
+    ip_error("BSPcomplex::loadSnapshot: FATAL ERROR invalid file\n");
+
+  // Supporting vectors
+  vrts_orBin.assign(vertices.size(), 2);
+  vrts_visit.assign(vertices.size(), 0);
+  edge_visit.assign(edges.size(), 0);
+}
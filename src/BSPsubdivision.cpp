@@ -0,0 +1,514 @@
+#include "BSP.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+
+// Parallel subdivision of the BSPcomplex.
+// Splitting a cell only modifies the cells that share an edge with it.
+// The initial cells are sorted along a Hilbert curve through their
+// barycenters and grouped in blocks of BSP_CELLS_PER_BLOCK consecutive cells
+// (the cells created by a split belong to the block of the split cell).
+// A cell whose vertices are shared with cells of its own block only can be
+// split without touching other blocks: such cells are split in a copy of
+// the block, that contains them and the cells sharing an edge with them.
+// The copies are processed concurrently and merged back in block order.
+// The cells that are left (close to the boundary of a block) are split at
+// the next level, where blocks are merged in pairs, and so on up to a
+// single block.
+// Blocks do not depend on the number of threads, hence neither does the
+// result.
+#define BSP_CELLS_PER_BLOCK 16384
+
+// A copy of some cells of a complex, with their faces, edges and vertices.
+struct BSPblock {
+  BSPcomplex local;
+
+  // Global indices of the copied elements (sorted)
+  std::vector<uint64_t> cells_g, faces_g, edges_g;
+  std::vector<uint32_t> vrts_g, constr_g;
+
+  std::vector<bool> split;    // Copied cells to be split
+  std::vector<bool> face_out; // Faces incident at a cell that is not copied
+  std::vector<bool> edge_out; // Edges of those faces
+
+  // Global indices of the first elements created by the splits
+  uint64_t cell_off, face_off, edge_off;
+  uint32_t vrt_off;
+};
+
+template <class T> static void sort_unique(std::vector<T> &v) {
+  std::sort(v.begin(), v.end());
+  v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+// Returns the position of i in the sorted vector g (UINT64_MAX if missing).
+template <class T>
+static inline uint64_t local_index(const std::vector<T> &g, const T i) {
+  typename std::vector<T>::const_iterator it =
+      std::lower_bound(g.begin(), g.end(), i);
+  return (it != g.end() && *it == i) ? ((uint64_t)(it - g.begin()))
+                                     : (UINT64_MAX);
+}
+
+static inline void atomic_min(std::atomic<uint32_t> &a, uint32_t v) {
+  uint32_t cur = a.load(std::memory_order_relaxed);
+  while (v < cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+    ;
+}
+
+static inline void atomic_max(std::atomic<uint32_t> &a, uint32_t v) {
+  uint32_t cur = a.load(std::memory_order_relaxed);
+  while (v > cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+    ;
+}
+
+//  Input: complex, a BSPcell of complex: cell,
+//         vector of vertices indices type: vrts.
+// Output: by using vrts returns the endpoints of the cell edges (a vertex is
+//         listed once for each edge of the cell faces it belongs to).
+static void cell_vertices(const BSPcomplex &complex, const BSPcell &cell,
+                          std::vector<uint32_t> &vrts) {
+  vrts.clear();
+  for (uint64_t f : cell.faces)
+    for (uint64_t e : complex.faces[f].edges)
+      if (e != UINT64_MAX) {
+        vrts.push_back(complex.edges[e].vertices[0]);
+        vrts.push_back(complex.edges[e].vertices[1]);
+      }
+}
+
+//  Input: complex,
+//         vector of blocks indices type: cell_block.
+// Output: by using cell_block returns the block of each cell at level 0,
+//         returns the number of blocks.
+static uint32_t hilbert_blocks(const BSPcomplex &complex,
+                               std::vector<uint32_t> &cell_block) {
+  const uint32_t num_cells = (uint32_t)complex.cells.size();
+  cell_block.resize(num_cells);
+  if (num_cells == 0)
+    return 0;
+
+  // Barycenters of the cell vertices
+  std::vector<vertex_t> coords(complex.vertices.size());
+  for (uint32_t v = 0; v < coords.size(); v++)
+    complex.vertices[v]->getApproxXYZCoordinates(
+        coords[v].coord[0], coords[v].coord[1], coords[v].coord[2]);
+  std::vector<vertex_t> centers(num_cells);
+  std::vector<uint32_t> vrts;
+  for (uint32_t c = 0; c < num_cells; c++) {
+    cell_vertices(complex, complex.cells[c], vrts);
+    double *bar = centers[c].coord;
+    bar[0] = bar[1] = bar[2] = 0;
+    for (uint32_t v : vrts)
+      for (int j = 0; j < 3; j++)
+        bar[j] += coords[v].coord[j];
+    for (int j = 0; j < 3; j++)
+      bar[j] /= vrts.size();
+  }
+
+  double bmin[3], bmax[3];
+  std::vector<uint64_t> key(num_cells);
+  vertices_bbox(centers.data(), num_cells, bmin, bmax);
+  vertices_hilbert_keys(centers.data(), 0, num_cells, bmin, bmax, key.data());
+
+  std::vector<std::pair<uint64_t, uint32_t>> order(num_cells);
+  for (uint32_t c = 0; c < num_cells; c++)
+    order[c] = std::make_pair(key[c], c);
+  std::sort(order.begin(), order.end());
+  for (uint32_t i = 0; i < num_cells; i++)
+    cell_block[order[i].second] = i / BSP_CELLS_PER_BLOCK;
+
+  return (num_cells + BSP_CELLS_PER_BLOCK - 1) / BSP_CELLS_PER_BLOCK;
+}
+
+//  Input: complex, a block with the global indices of the cells to be
+//         copied: b.cells_g.
+// Output: b.local is a copy of the cells, with all their faces, edges and
+//         vertices, and of the constraints they refer to.
+// Note. Cells that are not copied are replaced by UINT64_MAX in the copied
+//       faces (b.face_out). Such faces and their edges (b.edge_out) are not
+//       modified when the copy is split.
+static void copy_block(const BSPcomplex &complex, BSPblock &b) {
+  BSPcomplex &local = b.local;
+
+  // Elements to be copied.
+  for (uint64_t c : b.cells_g) {
+    const BSPcell &cell = complex.cells[c];
+    b.faces_g.insert(b.faces_g.end(), cell.faces.begin(), cell.faces.end());
+    b.constr_g.insert(b.constr_g.end(), cell.constraints.begin(),
+                      cell.constraints.end());
+  }
+  sort_unique(b.faces_g);
+  for (uint64_t f : b.faces_g) {
+    const BSPface &face = complex.faces[f];
+    for (uint64_t e : face.edges)
+      if (e != UINT64_MAX)
+        b.edges_g.push_back(e);
+    b.constr_g.insert(b.constr_g.end(), face.coplanar_constraints.begin(),
+                      face.coplanar_constraints.end());
+    b.vrts_g.insert(b.vrts_g.end(), face.meshVertices, face.meshVertices + 3);
+  }
+  sort_unique(b.edges_g);
+  sort_unique(b.constr_g);
+  for (uint64_t e : b.edges_g) {
+    const BSPedge &edge = complex.edges[e];
+    b.vrts_g.insert(b.vrts_g.end(), edge.vertices, edge.vertices + 2);
+    const uint32_t n = (edge.meshVertices[2] == UINT32_MAX) ? (2) : (6);
+    b.vrts_g.insert(b.vrts_g.end(), edge.meshVertices, edge.meshVertices + n);
+  }
+  for (uint32_t c : b.constr_g)
+    for (uint32_t k = 0; k < 3; k++)
+      b.vrts_g.push_back(complex.constraints_verts[3 * c + k]);
+  sort_unique(b.vrts_g);
+
+  // Vertices and constraints.
+  const uint32_t nv = (uint32_t)b.vrts_g.size();
+  local.vertices.resize(nv);
+  for (uint32_t v = 0; v < nv; v++)
+    local.vertices[v] = complex.vertices[b.vrts_g[v]];
+  local.vrts_orBin.resize(nv, 2);
+  local.vrts_visit.resize(nv, 0);
+
+  local.constraints_verts.resize(3 * b.constr_g.size());
+  for (uint32_t c = 0; c < b.constr_g.size(); c++)
+    for (uint32_t k = 0; k < 3; k++)
+      local.constraints_verts[3 * c + k] = (uint32_t)local_index(
+          b.vrts_g, complex.constraints_verts[3 * b.constr_g[c] + k]);
+  local.first_virtual_constraint =
+      (uint32_t)(std::lower_bound(b.constr_g.begin(), b.constr_g.end(),
+                                  complex.first_virtual_constraint) -
+                 b.constr_g.begin());
+
+  // Cells.
+  local.cells.resize(b.cells_g.size());
+  for (uint64_t c = 0; c < b.cells_g.size(); c++) {
+    const BSPcell &cell = complex.cells[b.cells_g[c]];
+    BSPcell &lcell = local.cells[c];
+    lcell.faces.resize(cell.faces.size());
+    for (uint64_t i = 0; i < cell.faces.size(); i++)
+      lcell.faces[i] = local_index(b.faces_g, cell.faces[i]);
+    lcell.constraints.resize(cell.constraints.size());
+    for (uint64_t i = 0; i < cell.constraints.size(); i++)
+      lcell.constraints[i] = (uint32_t)local_index(b.constr_g, cell.constraints[i]);
+    lcell.place = cell.place;
+  }
+
+  // Faces.
+  local.faces.resize(b.faces_g.size());
+  b.face_out.assign(b.faces_g.size(), false);
+  for (uint64_t f = 0; f < b.faces_g.size(); f++) {
+    const BSPface &face = complex.faces[b.faces_g[f]];
+    BSPface &lface = local.faces[f];
+    lface.edges.resize(face.edges.size());
+    for (uint64_t i = 0; i < face.edges.size(); i++)
+      lface.edges[i] = (face.edges[i] == UINT64_MAX)
+                           ? (UINT64_MAX)
+                           : (local_index(b.edges_g, face.edges[i]));
+    for (uint32_t k = 0; k < 2; k++) {
+      lface.conn_cells[k] = UINT64_MAX;
+      if (face.conn_cells[k] != UINT64_MAX) {
+        lface.conn_cells[k] = local_index(b.cells_g, face.conn_cells[k]);
+        if (lface.conn_cells[k] == UINT64_MAX)
+          b.face_out[f] = true;
+      }
+    }
+    lface.coplanar_constraints.resize(face.coplanar_constraints.size());
+    for (uint64_t i = 0; i < face.coplanar_constraints.size(); i++)
+      lface.coplanar_constraints[i] =
+          (uint32_t)local_index(b.constr_g, face.coplanar_constraints[i]);
+    for (uint32_t k = 0; k < 3; k++)
+      lface.meshVertices[k] =
+          (uint32_t)local_index(b.vrts_g, face.meshVertices[k]);
+    lface.colour = face.colour;
+  }
+
+  // Edges.
+  local.edges.resize(b.edges_g.size());
+  b.edge_out.assign(b.edges_g.size(), false);
+  for (uint64_t e = 0; e < b.edges_g.size(); e++) {
+    const BSPedge &edge = complex.edges[b.edges_g[e]];
+    BSPedge &ledge = local.edges[e];
+    for (uint32_t k = 0; k < 2; k++)
+      ledge.vertices[k] = (uint32_t)local_index(b.vrts_g, edge.vertices[k]);
+    const uint32_t n = (edge.meshVertices[2] == UINT32_MAX) ? (2) : (6);
+    for (uint32_t k = 0; k < 6; k++)
+      ledge.meshVertices[k] =
+          (k < n) ? ((uint32_t)local_index(b.vrts_g, edge.meshVertices[k]))
+                  : (UINT32_MAX);
+    ledge.conn_face_0 = local_index(b.faces_g, edge.conn_face_0);
+  }
+  for (uint64_t f = 0; f < local.faces.size(); f++)
+    for (uint64_t e : local.faces[f].edges)
+      if (e != UINT64_MAX) {
+        if (b.face_out[f])
+          b.edge_out[e] = true;
+        if (local.edges[e].conn_face_0 == UINT64_MAX)
+          local.edges[e].conn_face_0 = f;
+      }
+  local.edge_visit.resize(local.edges.size(), 0);
+}
+
+//  Input: complex, a block whose copy has been split: b.
+// Output: the copy is written back to the complex. Elements created by the
+//         splits are written from b.cell_off, b.face_off, b.edge_off and
+//         b.vrt_off on.
+// Note. The complex must have room for the new elements.
+static void merge_block(BSPcomplex &complex, const BSPblock &b) {
+  const BSPcomplex &local = b.local;
+  const uint64_t nc = b.cells_g.size(), nf = b.faces_g.size();
+  const uint64_t ne = b.edges_g.size();
+  const uint32_t nv = (uint32_t)b.vrts_g.size();
+
+  // Global indices of the local elements.
+  auto cell_g = [&](uint64_t c) -> uint64_t {
+    return (c == UINT64_MAX) ? (c) : ((c < nc) ? (b.cells_g[c]) : (b.cell_off + c - nc));
+  };
+  auto face_g = [&](uint64_t f) -> uint64_t {
+    return (f < nf) ? (b.faces_g[f]) : (b.face_off + f - nf);
+  };
+  auto edge_g = [&](uint64_t e) -> uint64_t {
+    return (e == UINT64_MAX) ? (e) : ((e < ne) ? (b.edges_g[e]) : (b.edge_off + e - ne));
+  };
+  auto vrt_g = [&](uint32_t v) -> uint32_t {
+    return (v == UINT32_MAX) ? (v) : ((v < nv) ? (b.vrts_g[v]) : (b.vrt_off + v - nv));
+  };
+
+  for (uint64_t c = 0; c < local.cells.size(); c++) {
+    const BSPcell &lcell = local.cells[c];
+    BSPcell &cell = complex.cells[cell_g(c)];
+    cell.faces.resize(lcell.faces.size());
+    for (uint64_t i = 0; i < lcell.faces.size(); i++)
+      cell.faces[i] = face_g(lcell.faces[i]);
+    cell.constraints.resize(lcell.constraints.size());
+    for (uint64_t i = 0; i < lcell.constraints.size(); i++)
+      cell.constraints[i] = b.constr_g[lcell.constraints[i]];
+    cell.place = lcell.place;
+  }
+
+  for (uint64_t f = 0; f < local.faces.size(); f++) {
+    if (f < nf && b.face_out[f])
+      continue; // Not modified
+    const BSPface &lface = local.faces[f];
+    BSPface &face = complex.faces[face_g(f)];
+    face.edges.resize(lface.edges.size());
+    for (uint64_t i = 0; i < lface.edges.size(); i++)
+      face.edges[i] = edge_g(lface.edges[i]);
+    face.conn_cells[0] = cell_g(lface.conn_cells[0]);
+    face.conn_cells[1] = cell_g(lface.conn_cells[1]);
+    face.coplanar_constraints.resize(lface.coplanar_constraints.size());
+    for (uint64_t i = 0; i < lface.coplanar_constraints.size(); i++)
+      face.coplanar_constraints[i] = b.constr_g[lface.coplanar_constraints[i]];
+    for (uint32_t k = 0; k < 3; k++)
+      face.meshVertices[k] = vrt_g(lface.meshVertices[k]);
+    face.colour = lface.colour;
+  }
+
+  for (uint64_t e = 0; e < local.edges.size(); e++) {
+    if (e < ne && b.edge_out[e])
+      continue; // Not modified
+    const BSPedge &ledge = local.edges[e];
+    BSPedge &edge = complex.edges[edge_g(e)];
+    edge.vertices[0] = vrt_g(ledge.vertices[0]);
+    edge.vertices[1] = vrt_g(ledge.vertices[1]);
+    const uint32_t n = (ledge.meshVertices[2] == UINT32_MAX) ? (2) : (6);
+    for (uint32_t k = 0; k < 6; k++)
+      edge.meshVertices[k] =
+          (k < n) ? (vrt_g(ledge.meshVertices[k])) : (UINT32_MAX);
+    edge.conn_face_0 = face_g(ledge.conn_face_0);
+  }
+
+  for (uint32_t v = nv; v < local.vertices.size(); v++)
+    complex.vertices[b.vrt_off + v - nv] = local.vertices[v];
+}
+
+//  Input: complex, level-0 block of each cell: cell_block,
+//         level, number of blocks at that level: num_blocks,
+//         number of threads: num_threads.
+// Output: the cells that can be split within their block (at the given
+//         level) are split, returns false if no cell has to be split.
+static bool split_blocks(BSPcomplex &complex, std::vector<uint32_t> &cell_block,
+                         uint32_t level, uint32_t num_blocks,
+                         uint32_t num_threads) {
+  const uint64_t num_cells = complex.cells.size();
+  const uint32_t num_vrts = (uint32_t)complex.vertices.size();
+
+  // Cells of block b: block_cells[first[b]], ..., block_cells[first[b+1]-1].
+  std::vector<uint64_t> first(num_blocks + 1, 0), block_cells(num_cells);
+  bool to_split = false;
+  for (uint64_t c = 0; c < num_cells; c++) {
+    first[(cell_block[c] >> level) + 1]++;
+    if (complex.cells[c].constraints.size() > 0)
+      to_split = true;
+  }
+  if (!to_split)
+    return false;
+  for (uint32_t b = 0; b < num_blocks; b++)
+    first[b + 1] += first[b];
+  {
+    std::vector<uint64_t> pos(first.begin(), first.end() - 1);
+    for (uint64_t c = 0; c < num_cells; c++)
+      block_cells[pos[cell_block[c] >> level]++] = c;
+  }
+
+  // Smallest (lo) and largest (hi) block of the cells incident at each
+  // vertex.
+  std::vector<std::atomic<uint32_t>> lo(num_vrts), hi(num_vrts);
+  parallel_run(num_threads, [&](uint32_t t) {
+    for (uint32_t v = t; v < num_vrts; v += num_threads) {
+      lo[v].store(UINT32_MAX, std::memory_order_relaxed);
+      hi[v].store(0, std::memory_order_relaxed);
+    }
+  });
+  parallel_run(num_threads, [&](uint32_t t) {
+    std::vector<uint32_t> vrts;
+    for (uint64_t c = t; c < num_cells; c += num_threads) {
+      const uint32_t b = cell_block[c] >> level;
+      cell_vertices(complex, complex.cells[c], vrts);
+      for (uint32_t v : vrts) {
+        atomic_min(lo[v], b);
+        atomic_max(hi[v], b);
+      }
+    }
+  });
+
+  // Split the blocks. Edges of the cells to be split are marked as hot: their
+  // vertices are incident at cells of one block only.
+  std::vector<BSPblock *> blocks(num_blocks, NULL);
+  std::vector<uint8_t> hot(complex.edges.size(), 0);
+  std::atomic<uint32_t> next_block(0);
+  parallel_run(num_threads, [&](uint32_t) {
+    std::vector<uint32_t> vrts;
+    std::vector<uint64_t> to_split;
+    for (uint32_t b = next_block++; b < num_blocks; b = next_block++) {
+      TraceSpan span("split_block");
+      to_split.clear();
+      for (uint64_t i = first[b]; i < first[b + 1]; i++) {
+        const uint64_t c = block_cells[i];
+        if (complex.cells[c].constraints.size() == 0)
+          continue;
+        cell_vertices(complex, complex.cells[c], vrts);
+        uint32_t v = 0;
+        while (v < vrts.size() && lo[vrts[v]] == b && hi[vrts[v]] == b)
+          v++;
+        if (v == vrts.size())
+          to_split.push_back(c);
+      }
+      if (to_split.size() == 0)
+        continue;
+      span.setCount(to_split.size());
+
+      // Copy the cells of the block that share an edge with a cell to split.
+      for (uint64_t c : to_split)
+        for (uint64_t f : complex.cells[c].faces)
+          for (uint64_t e : complex.faces[f].edges)
+            if (e != UINT64_MAX)
+              hot[e] = 1;
+      BSPblock *blk = new BSPblock;
+      for (uint64_t i = first[b]; i < first[b + 1]; i++) {
+        const uint64_t c = block_cells[i];
+        bool copy = false;
+        for (uint64_t f : complex.cells[c].faces)
+          for (uint64_t e : complex.faces[f].edges)
+            if (e != UINT64_MAX && hot[e])
+              copy = true;
+        if (copy)
+          blk->cells_g.push_back(c);
+      }
+      for (uint64_t c : to_split)
+        for (uint64_t f : complex.cells[c].faces)
+          for (uint64_t e : complex.faces[f].edges)
+            if (e != UINT64_MAX)
+              hot[e] = 0;
+      blk->split.resize(blk->cells_g.size());
+      for (uint64_t i = 0, j = 0; i < blk->cells_g.size(); i++) {
+        blk->split[i] = (j < to_split.size() && to_split[j] == blk->cells_g[i]);
+        if (blk->split[i])
+          j++;
+      }
+      copy_block(complex, *blk);
+
+      // Split the cells as the serial subdivision does: cells created by a
+      // split are split as well.
+      BSPcomplex &local = blk->local;
+      const uint64_t num_copied = blk->cells_g.size();
+      for (uint64_t i = 0; i < local.cells.size(); /*ignore */) {
+        if ((i >= num_copied || blk->split[i]) &&
+            local.cells[i].constraints.size() > 0)
+          local.splitCell(i);
+        else
+          i++;
+      }
+      blocks[b] = blk;
+    }
+  });
+
+  // New elements are appended to the complex in block order.
+  uint64_t nc = complex.cells.size(), nf = complex.faces.size();
+  uint64_t ne = complex.edges.size();
+  uint32_t nv = num_vrts;
+  for (uint32_t b = 0; b < num_blocks; b++) {
+    BSPblock *blk = blocks[b];
+    if (blk == NULL)
+      continue;
+    const BSPcomplex &local = blk->local;
+    blk->cell_off = nc;
+    blk->face_off = nf;
+    blk->edge_off = ne;
+    blk->vrt_off = nv;
+    nc += local.cells.size() - blk->cells_g.size();
+    nf += local.faces.size() - blk->faces_g.size();
+    ne += local.edges.size() - blk->edges_g.size();
+    nv += (uint32_t)(local.vertices.size() - blk->vrts_g.size());
+    cell_block.resize(nc, b << level);
+  }
+  complex.cells.resize(nc);
+  complex.faces.resize(nf);
+  complex.edges.resize(ne);
+  complex.vertices.resize(nv, NULL);
+  complex.vrts_orBin.resize(nv, 2);
+  complex.vrts_visit.resize(nv, 0);
+  complex.edge_visit.resize(ne, 0);
+
+  next_block = 0;
+  parallel_run(num_threads, [&](uint32_t) {
+    for (uint32_t b = next_block++; b < num_blocks; b = next_block++)
+      if (blocks[b] != NULL) {
+        TRACE_SPAN("merge_block");
+        merge_block(complex, *blocks[b]);
+      }
+  });
+
+  // The complex takes the storage of the new vertices.
+  for (uint32_t b = 0; b < num_blocks; b++)
+    if (blocks[b] != NULL) {
+      complex.lpi_arena.adopt(blocks[b]->local.lpi_arena);
+      complex.tpi_arena.adopt(blocks[b]->local.tpi_arena);
+      delete blocks[b];
+    }
+
+  return true;
+}
+
+void BSPcomplex::subdivide(uint32_t num_threads) {
+  TRACE_SPAN("subdivide");
+  if (num_threads == 0)
+    num_threads = 1;
+  std::vector<uint32_t> cell_block;
+  const uint32_t num_blocks = hilbert_blocks(*this, cell_block);
+
+  for (uint32_t level = 0; num_blocks > 0 && ((num_blocks - 1) >> level) > 0;
+       level++)
+    if (!split_blocks(*this, cell_block, level,
+                      ((num_blocks - 1) >> level) + 1, num_threads))
+      return;
+
+  // Cells left at the last level.
+  TRACE_SPAN("split_cells");
+  for (uint64_t i = 0; i < cells.size(); /*ignore */) {
+    if (cells[i].constraints.size() > 0)
+      splitCell(i);
+    else
+      i++;
+  }
+}
@@ -0,0 +1,214 @@
+#include "BSP.h"
+#include "parallel.h"
+#include <algorithm>
+
+// Tetrahedrization of the cells of the volume.
+// Cells are convex. A cell is split by joining one of its vertices, the
+// apex, with the triangles of the faces that do not contain it. The faces
+// that contain the apex must be triangles, and the apex is the vertex that
+// is on most faces among those that qualify. If none does, the centre of
+// the cell is the apex.
+// A face that is not a triangle is split by joining its centre with its
+// edges. This depends on the face only, so the two cells that share a face
+// agree on it and the tetrahedra are conforming.
+// Centres are new vertices: face centres follow the vertices of the complex,
+// and cell centres follow face centres. Cells are processed concurrently in
+// chunks of consecutive cells, and the result does not depend on the number
+// of threads.
+
+// Cell centres are numbered within their chunk, with this flag set, until
+// the chunks are merged. Vertex indices must thus stay below the flag.
+#define CELL_CENTRE 0x80000000
+
+// Tetrahedra of a chunk of cells.
+struct BSPtetChunk {
+  std::vector<uint32_t> tets;
+  std::vector<uint64_t> cell;
+  std::vector<double> centres; // Coordinates of the cell centres
+};
+
+//  Input: complex, index of a cell: c, vector of vectors: fvs.
+// Output: fvs[i] = vertices of the i-th face of the cell, counterclockwise
+//         when the face is seen from outside the cell.
+static void cell_face_vertices(BSPcomplex &complex, uint64_t c,
+                               std::vector<std::vector<uint32_t>> &fvs) {
+  const BSPcell &cell = complex.cells[c];
+  fvs.resize(cell.faces.size());
+  for (uint64_t i = 0; i < cell.faces.size(); i++) {
+    BSPface &face = complex.faces[cell.faces[i]];
+    fvs[i].resize(face.edges.size());
+    complex.list_faceVertices(face, fvs[i]);
+    if (face.conn_cells[0] == c)
+      std::reverse(fvs[i].begin(), fvs[i].end());
+  }
+}
+
+//  Input: vertices of the faces of a cell: fvs,
+//         vector of pairs type: vf (supporting vector).
+// Output: returns the apex of the cell, or UINT32_MAX if no vertex qualifies.
+static uint32_t cell_apex(const std::vector<std::vector<uint32_t>> &fvs,
+                          std::vector<std::pair<uint32_t, bool>> &vf) {
+  // Pairs (vertex, the face is a triangle) for every vertex of every face
+  vf.clear();
+  for (const std::vector<uint32_t> &fv : fvs)
+    for (uint32_t v : fv)
+      vf.push_back(std::make_pair(v, fv.size() == 3));
+  std::sort(vf.begin(), vf.end());
+
+  uint32_t apex = UINT32_MAX;
+  size_t apex_faces = 0;
+  for (size_t i = 0, j; i < vf.size(); i = j) {
+    bool triangles = true;
+    for (j = i; j < vf.size() && vf[j].first == vf[i].first; j++)
+      triangles = triangles && vf[j].second;
+    if (triangles && j - i > apex_faces) {
+      apex = vf[i].first;
+      apex_faces = j - i;
+    }
+  }
+  return apex;
+}
+
+void BSPcomplex::tetrahedrize(const char bool_opcode, BSPtetrahedra &out,
+                              uint32_t num_threads) {
+  if (num_threads == 0)
+    num_threads = 1;
+  // Approximate coordinates are computed as in the rest of the pipeline
+  FPUscope fpu_scope;
+  initFPU();
+
+  // Cells of the volume and their vertices.
+  std::vector<uint64_t> vol_cells;
+  for (size_t i = 0; i < vrts_visit.size(); i++)
+    vrts_visit[i] = 0;
+  for (uint64_t c = 0; c < cells.size(); c++)
+    if (place_in_volume(cells[c].place, bool_opcode)) {
+      vol_cells.push_back(c);
+      for (uint64_t f_i : cells[c].faces)
+        for (uint64_t eid : faces[f_i].edges)
+          vrts_visit[edges[eid].vertices[0]] =
+              vrts_visit[edges[eid].vertices[1]] = 1;
+    }
+
+  std::vector<uint32_t> vmap(vertices.size(), UINT32_MAX);
+  std::vector<uint32_t> used_vrts;
+  for (uint32_t v = 0; v < vertices.size(); v++)
+    if (vrts_visit[v]) {
+      vmap[v] = (uint32_t)used_vrts.size();
+      used_vrts.push_back(v);
+    }
+
+  // Faces that need a centre.
+  std::vector<uint32_t> face_centre(faces.size(), UINT32_MAX);
+  std::vector<uint64_t> centre_faces;
+  for (uint64_t c : vol_cells)
+    for (uint64_t f_i : cells[c].faces)
+      if (faces[f_i].edges.size() > 3 && face_centre[f_i] == UINT32_MAX) {
+        face_centre[f_i] = 0;
+        centre_faces.push_back(f_i);
+      }
+  std::sort(centre_faces.begin(), centre_faces.end());
+  const uint32_t num_vrts = (uint32_t)used_vrts.size();
+  for (uint32_t i = 0; i < centre_faces.size(); i++)
+    face_centre[centre_faces[i]] = num_vrts + i;
+
+  // Rounded coordinates of the vertices and of the face centres.
+  const uint64_t num_fixed = num_vrts + centre_faces.size();
+  out.coords.resize(3 * num_fixed);
+  parallel_run(num_threads, [&](uint32_t t) {
+    for (uint32_t i = t; i < num_vrts; i += num_threads) {
+      double *p = out.coords.data() + 3 * (uint64_t)i;
+      vertices[used_vrts[i]]->getApproxXYZCoordinates(p[0], p[1], p[2]);
+    }
+  });
+  parallel_run(num_threads, [&](uint32_t t) {
+    for (uint64_t i = t; i < centre_faces.size(); i += num_threads) {
+      const BSPface &face = faces[centre_faces[i]];
+      double *p = out.coords.data() + 3 * (num_vrts + i);
+      p[0] = p[1] = p[2] = 0;
+      for (uint64_t eid : face.edges)
+        for (uint32_t k = 0; k < 2; k++)
+          for (int j = 0; j < 3; j++)
+            p[j] += out.coords[3 * (uint64_t)vmap[edges[eid].vertices[k]] + j];
+      for (int j = 0; j < 3; j++)
+        p[j] /= 2 * face.edges.size();
+    }
+  });
+
+  // Tetrahedra of the cells, by chunks. There is at most one cell centre
+  // per cell: with all the vertices below CELL_CENTRE, the flag tells cell
+  // centres apart.
+  if (num_fixed + vol_cells.size() > CELL_CENTRE)
+    ip_error("BSPcomplex::tetrahedrize: too many vertices\n");
+  std::vector<BSPtetChunk> chunks(num_threads);
+  parallel_run(num_threads, [&](uint32_t t) {
+    BSPtetChunk &chunk = chunks[t];
+    std::vector<std::vector<uint32_t>> fvs;
+    std::vector<std::pair<uint32_t, bool>> vf;
+    const uint64_t begin = vol_cells.size() * t / num_threads;
+    const uint64_t end = vol_cells.size() * (t + 1) / num_threads;
+    for (uint64_t i = begin; i < end; i++) {
+      const uint64_t c = vol_cells[i];
+      cell_face_vertices(*this, c, fvs);
+      uint32_t apex = cell_apex(fvs, vf);
+      if (apex == UINT32_MAX) {
+        double centre[3] = {0, 0, 0};
+        uint64_t n = 0;
+        for (const std::vector<uint32_t> &fv : fvs)
+          for (uint32_t v : fv) {
+            for (int j = 0; j < 3; j++)
+              centre[j] += out.coords[3 * (uint64_t)vmap[v] + j];
+            n++;
+          }
+        apex = CELL_CENTRE | (uint32_t)(chunk.centres.size() / 3);
+        for (int j = 0; j < 3; j++)
+          chunk.centres.push_back(centre[j] / n);
+      } else
+        apex = vmap[apex];
+
+      const BSPcell &cell = cells[c];
+      for (uint64_t k = 0; k < fvs.size(); k++) {
+        std::vector<uint32_t> &fv = fvs[k];
+        for (uint32_t &v : fv)
+          v = vmap[v];
+        if (std::find(fv.begin(), fv.end(), apex) != fv.end())
+          continue;
+        if (fv.size() == 3) {
+          chunk.tets.insert(chunk.tets.end(), {apex, fv[0], fv[1], fv[2]});
+          chunk.cell.push_back(i);
+          continue;
+        }
+        const uint32_t fc = face_centre[cell.faces[k]];
+        for (size_t j = 0; j < fv.size(); j++) {
+          chunk.tets.insert(chunk.tets.end(),
+                            {apex, fc, fv[j], fv[(j + 1) % fv.size()]});
+          chunk.cell.push_back(i);
+        }
+      }
+    }
+  });
+
+  // Merge the chunks.
+  std::vector<uint64_t> tet_off(num_threads + 1, 0);
+  std::vector<uint64_t> centre_off(num_threads + 1, num_fixed);
+  for (uint32_t t = 0; t < num_threads; t++) {
+    tet_off[t + 1] = tet_off[t] + chunks[t].cell.size();
+    centre_off[t + 1] = centre_off[t] + chunks[t].centres.size() / 3;
+  }
+  out.tets.resize(4 * tet_off[num_threads]);
+  out.cell.resize(tet_off[num_threads]);
+  out.coords.resize(3 * centre_off[num_threads]);
+  parallel_run(num_threads, [&](uint32_t t) {
+    const BSPtetChunk &chunk = chunks[t];
+    for (uint64_t i = 0; i < chunk.tets.size(); i++) {
+      const uint32_t v = chunk.tets[i];
+      out.tets[4 * tet_off[t] + i] =
+          (v & CELL_CENTRE) ? ((uint32_t)(centre_off[t] + (v & ~CELL_CENTRE)))
+                            : (v);
+    }
+    std::copy(chunk.cell.begin(), chunk.cell.end(),
+              out.cell.begin() + tet_off[t]);
+    std::copy(chunk.centres.begin(), chunk.centres.end(),
+              out.coords.begin() + 3 * centre_off[t]);
+  });
+}
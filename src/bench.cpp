@@ -0,0 +1,292 @@
+#include "BSP.h"
+#include "mesh_io.h"
+#include "parallel.h"
+#include "synthetic_mesh.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Directory of the models benchmarked by default (set by CMake)
+#ifndef BENCH_MODELS_DIR
+#define BENCH_MODELS_DIR "models"
+#endif
+
+static const char *default_models[] = {"mannequin.off", "bust.off",
+                                       "hilbert.off", "wood_fish.off"};
+
+// A model, loaded once and meshed many times
+struct BenchModel {
+  std::string name; // File name without directory and extension, or
+                    // kind_triangles for synthetic models
+  double *coords;
+  uint32_t npts;
+  uint32_t *tri_idx;
+  uint32_t ntri;
+  std::vector<double> moved; // Copy of coords moved by a tenth of the
+                             // bounding box: the second operand of the
+                             // boolean cases, so that the two overlap.
+};
+
+// Median and range of a sample
+struct Spread {
+  double median, min, max;
+};
+
+// Times of a stage in all the repetitions of a case
+struct StageSamples {
+  std::string name;
+  std::vector<double> wall, cpu;
+};
+
+// A model meshed with an operator
+struct BenchCase {
+  std::string model;
+  char op;
+  MeshStats stats; // Statistics of the last repetition (counts)
+  std::vector<StageSamples> stages;
+};
+
+//  Input: sample: v (not empty).
+// Output: returns its median, minimum and maximum.
+static Spread spread(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  const size_t n = v.size();
+  Spread s;
+  s.median = (n % 2) ? (v[n / 2]) : ((v[n / 2 - 1] + v[n / 2]) / 2);
+  s.min = v.front();
+  s.max = v.back();
+  return s;
+}
+
+//  Input: model with coords and tri_idx set: m.
+// Output: sets the moved copy of m.
+static void move_copy(BenchModel &m) {
+  double bmin[3], bmax[3];
+  for (int j = 0; j < 3; j++)
+    bmin[j] = bmax[j] = m.coords[j];
+  for (uint32_t i = 0; i < m.npts; i++)
+    for (int j = 0; j < 3; j++) {
+      bmin[j] = std::min(bmin[j], m.coords[3 * i + j]);
+      bmax[j] = std::max(bmax[j], m.coords[3 * i + j]);
+    }
+  m.moved.assign(m.coords, m.coords + 3 * (size_t)m.npts);
+  for (uint32_t i = 0; i < m.npts; i++)
+    for (int j = 0; j < 3; j++)
+      m.moved[3 * i + j] += (bmax[j] - bmin[j]) / 10;
+}
+
+//  Input: path of a mesh file: filename, threads: num_threads.
+// Output: returns the model stored in the file.
+static BenchModel load_model(const char *filename, uint32_t num_threads) {
+  BenchModel m;
+  read_mesh_file(filename, &m.coords, &m.npts, &m.tri_idx, &m.ntri, false,
+                 num_threads);
+
+  const char *base = strrchr(filename, '/');
+  m.name = (base) ? (base + 1) : (filename);
+  m.name = m.name.substr(0, m.name.rfind('.'));
+  move_copy(m);
+  return m;
+}
+
+//  Input: synthetic model (see synthetic_mesh.h) "kind:triangles": spec.
+// Output: returns the generated model, named "kind_triangles".
+static BenchModel synthetic_model(const std::string &spec) {
+  const size_t colon = spec.find(':');
+  const std::string kind = spec.substr(0, colon);
+  const long num_triangles =
+      (colon == std::string::npos) ? (0) : (atol(spec.c_str() + colon + 1));
+  if (!is_synthetic_kind(kind.c_str()) || num_triangles <= 0)
+    ip_error("Invalid synthetic model\n");
+
+  BenchModel m;
+  make_synthetic_mesh(kind.c_str(), (uint32_t)num_triangles, 1, &m.coords,
+                      &m.npts, &m.tri_idx, &m.ntri);
+  m.name = kind + "_" + spec.substr(colon + 1);
+  move_copy(m);
+  return m;
+}
+
+//  Input: model: m, boolean operator: op, repetitions: repeats,
+//         threads: num_threads.
+// Output: returns the times of the stages of makePolyhedralMesh in each
+//         repetition, plus their sum ("total").
+static BenchCase run_case(const BenchModel &m, char op, uint32_t repeats,
+                          uint32_t num_threads) {
+  BenchCase c;
+  c.model = m.name;
+  c.op = op;
+  const MeshView A(m.coords, m.npts, m.tri_idx, m.ntri);
+  const MeshView B = (op == '0')
+                         ? (MeshView())
+                         : (MeshView(m.moved.data(), m.npts, m.tri_idx,
+                                     m.ntri));
+  for (uint32_t r = 0; r < repeats; r++) {
+    MeshStats stats;
+    makePolyhedralMesh(A, B, op, false, num_threads, &stats);
+
+    stats.stages.push_back(stats.total());
+    if (c.stages.empty()) {
+      c.stages.resize(stats.stages.size());
+      for (size_t i = 0; i < stats.stages.size(); i++)
+        c.stages[i].name = stats.stages[i].name;
+    }
+    for (size_t i = 0; i < stats.stages.size(); i++) {
+      c.stages[i].wall.push_back(stats.stages[i].wall);
+      c.stages[i].cpu.push_back(stats.stages[i].cpu);
+    }
+    c.stats = stats;
+  }
+  return c;
+}
+
+//  Input: benchmark results: cases, file name: filename.
+// Output: saves one row per stage of each case, with the median, minimum
+//         and maximum of its wall-clock and CPU times.
+static void save_CSV(const std::vector<BenchCase> &cases,
+                     const char *filename) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    ip_error("save_CSV: FATAL ERROR cannot open the file\n");
+  fprintf(f, "model,op,stage,runs,wall_median,wall_min,wall_max,"
+             "cpu_median,cpu_min,cpu_max\n");
+  for (const BenchCase &c : cases)
+    for (const StageSamples &s : c.stages) {
+      const Spread w = spread(s.wall), u = spread(s.cpu);
+      fprintf(f, "%s,%c,%s,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+              c.model.c_str(), c.op, s.name.c_str(), (uint32_t)s.wall.size(),
+              w.median, w.min, w.max, u.median, u.min, u.max);
+    }
+  if (fclose(f) != 0)
+    ip_error("save_CSV: FATAL ERROR cannot write the file\n");
+}
+
+//  Input: benchmark results: cases, threads: num_threads, file name:
+//         filename.
+// Output: saves the results as JSON: the stage times of each case, as in
+//         save_CSV, and the sizes of its structures.
+static void save_JSON(const std::vector<BenchCase> &cases,
+                      uint32_t num_threads, const char *filename) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    ip_error("save_JSON: FATAL ERROR cannot open the file\n");
+  fprintf(f, "{\n  \"num_threads\": %u,\n", num_threads);
+  fprintf(f, "  \"peak_rss_bytes\": %llu,\n",
+          (unsigned long long)process_peak_rss());
+  fprintf(f, "  \"cases\": [");
+  for (size_t k = 0; k < cases.size(); k++) {
+    const BenchCase &c = cases[k];
+    const MeshStats &st = c.stats;
+    fprintf(f, "%s\n    {\"model\": \"%s\", \"op\": \"%c\",\n",
+            (k) ? (",") : (""), c.model.c_str(), c.op);
+    fprintf(f,
+            "     \"counts\": {\"vertices\": %llu, \"constraints\": %llu, "
+            "\"virtual_constraints\": %llu, \"initial_cells\": %llu, "
+            "\"final_cells\": %llu, \"lpi_vertices\": %llu, "
+            "\"tpi_vertices\": %llu},\n",
+            (unsigned long long)st.vertices,
+            (unsigned long long)st.constraints,
+            (unsigned long long)st.virtual_constraints,
+            (unsigned long long)st.initial_cells,
+            (unsigned long long)st.final_cells,
+            (unsigned long long)st.lpi_vertices,
+            (unsigned long long)st.tpi_vertices);
+    fprintf(f, "     \"stages\": [");
+    for (size_t i = 0; i < c.stages.size(); i++) {
+      const StageSamples &s = c.stages[i];
+      const Spread w = spread(s.wall), u = spread(s.cpu);
+      fprintf(f,
+              "%s\n       {\"name\": \"%s\", \"runs\": %u, "
+              "\"wall_median\": %.6f, \"wall_min\": %.6f, "
+              "\"wall_max\": %.6f, \"cpu_median\": %.6f, \"cpu_min\": %.6f, "
+              "\"cpu_max\": %.6f}",
+              (i) ? (",") : (""), s.name.c_str(), (uint32_t)s.wall.size(),
+              w.median, w.min, w.max, u.median, u.min, u.max);
+    }
+    fprintf(f, "\n     ]}");
+  }
+  fprintf(f, "\n  ]\n}\n");
+  if (fclose(f) != 0)
+    ip_error("save_JSON: FATAL ERROR cannot write the file\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t repeats = 5, num_threads = 1;
+  const char *out_prefix = "bench";
+  std::string ops = "0UID";
+  std::vector<std::string> files, synthetic;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') {
+      if (argv[i][1] == 'p')
+        num_threads = parallel_num_threads();
+      else if (argv[i][1] != '\0' && strchr("robg", argv[i][1]) != NULL) {
+        if (++i == argc)
+          ip_error("Missing option argument\n");
+        const char opt = argv[i - 1][1];
+        if (opt == 'o')
+          out_prefix = argv[i];
+        else if (opt == 'b')
+          ops = argv[i];
+        else if (opt == 'g')
+          synthetic.push_back(argv[i]);
+        else if ((repeats = (uint32_t)atoi(argv[i])) == 0)
+          ip_error("The number of repetitions must be positive\n");
+      } else if (argv[i][1] == 'h') {
+        printf("\nUsage: mesh_generator_bench [-p | -r repeats | -o prefix | "
+               "-b ops | -g kind:triangles] [model ...]\n\n"
+               "Meshes each model alone and in union, intersection and "
+               "difference with a copy of itself moved by a tenth of its "
+               "bounding box, repeatedly, and reports the median, minimum "
+               "and maximum time of each stage.\n\n"
+               "-p = use all the available processors\n"
+               "-r repeats = repetitions of each case (default 5)\n"
+               "-o prefix = save the results to prefix.csv and prefix.json "
+               "(default 'bench')\n"
+               "-b ops = operators to benchmark, among 0 (single input), U, I "
+               "and D (default '0UID')\n"
+               "-g kind:triangles = add a synthetic model (see "
+               "mesh_generator_synth), e.g. spheres:1000000; it can be "
+               "repeated to measure how the stages scale\n"
+               "The default models are the ones in %s (unless models or "
+               "synthetic models are given)\n",
+               BENCH_MODELS_DIR);
+        return 0;
+      } else
+        ip_error("Unknown option\n");
+    } else
+      files.push_back(argv[i]);
+  }
+
+  for (char op : ops)
+    if (strchr("0UID", op) == NULL)
+      ip_error("Unknown boolean operator\n");
+  if (files.empty() && synthetic.empty())
+    for (const char *m : default_models)
+      files.push_back(std::string(BENCH_MODELS_DIR) + "/" + m);
+
+  std::vector<BenchCase> cases;
+  for (size_t k = 0; k < files.size() + synthetic.size(); k++) {
+    BenchModel m = (k < files.size())
+                       ? (load_model(files[k].c_str(), num_threads))
+                       : (synthetic_model(synthetic[k - files.size()]));
+    for (char op : ops) {
+      cases.push_back(run_case(m, op, repeats, num_threads));
+      const Spread t = spread(cases.back().stages.back().wall);
+      printf("%s %c: median %f s, min %f s, max %f s (%u runs)\n",
+             m.name.c_str(), op, t.median, t.min, t.max, repeats);
+      fflush(stdout);
+    }
+    free(m.coords);
+    free(m.tri_idx);
+  }
+
+  save_CSV(cases, (std::string(out_prefix) + ".csv").c_str());
+  save_JSON(cases, num_threads, (std::string(out_prefix) + ".json").c_str());
+  printf("Done.\n");
+
+  return 0;
+}
@@ -0,0 +1,445 @@
+#include "delaunay.h"
+#include "extended_predicates.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cfenv>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Microbenchmark of the predicates called by the inner loops of the
+// pipeline: orient3d and insphere of the Delaunay stage, the extended
+// predicates of the constraint insertion, and genericPoint::orient3D on the
+// implicit vertices of the subdivision. Every predicate is timed on three
+// kinds of input:
+//   random          - generic points, decided by the floating point filters
+//                     (fast path),
+//   near-degenerate - configurations that are degenerate up to rounding, so
+//                     that the filters fail and the exact evaluation runs,
+//   degenerate      - exactly degenerate configurations (exact evaluation,
+//                     zero result).
+
+// Inputs per case. They are reused by all the passes of a measure.
+static const size_t num_inputs = 4096;
+
+// Deterministic generator of doubles in [0, 1)
+class BenchRandom {
+  uint64_t s;
+
+public:
+  BenchRandom(uint64_t seed) : s(seed) {}
+
+  uint64_t next() { // splitmix64
+    uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  double uniform() {
+    return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+};
+
+struct Vec3 {
+  double c[3];
+};
+
+static Vec3 random_point(BenchRandom &r) {
+  Vec3 p = {{r.uniform(), r.uniform(), r.uniform()}};
+  return p;
+}
+
+// a + u * (b - a) + v * (c - a), rounded: a point on the plane of a, b, c up
+// to rounding.
+static Vec3 on_plane(const Vec3 &a, const Vec3 &b, const Vec3 &c, double u,
+                     double v) {
+  Vec3 p;
+  for (int j = 0; j < 3; j++)
+    p.c[j] = a.c[j] + u * (b.c[j] - a.c[j]) + v * (c.c[j] - a.c[j]);
+  return p;
+}
+
+// A point of the sphere (center, radius), up to rounding.
+static Vec3 on_sphere(BenchRandom &r, const Vec3 &center, double radius) {
+  double d[3], l2;
+  do {
+    for (int j = 0; j < 3; j++)
+      d[j] = 2 * r.uniform() - 1;
+    l2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+  } while (l2 < 0.01 || l2 > 1);
+  const double s = radius / sqrt(l2);
+  Vec3 p;
+  for (int j = 0; j < 3; j++)
+    p.c[j] = center.c[j] + s * d[j];
+  return p;
+}
+
+// Timing of a case
+struct PredResult {
+  std::string family, input;
+  double ns_median, ns_min, ns_max; // Nanoseconds per call
+  uint64_t positive, zero, negative;
+};
+
+//  Input: predicate: pred (pred(i) evaluates the i-th input), repetitions:
+//         repeats, calls per repetition: min_calls.
+// Output: returns the time per call of each repetition (the calls go through
+//         the inputs as many times as needed) and the signs of the results.
+template <class Pred>
+static PredResult time_predicate(const char *family, const char *input,
+                                 Pred pred, uint32_t repeats,
+                                 uint64_t min_calls) {
+  PredResult res;
+  res.family = family;
+  res.input = input;
+  res.positive = res.zero = res.negative = 0;
+  for (size_t i = 0; i < num_inputs; i++) { // Also warms the caches up
+    const int s = pred(i);
+    if (s > 0)
+      res.positive++;
+    else if (s < 0)
+      res.negative++;
+    else
+      res.zero++;
+  }
+
+  const uint64_t passes = (min_calls + num_inputs - 1) / num_inputs;
+  std::vector<double> ns(repeats);
+  volatile int sink = 0;
+  for (uint32_t r = 0; r < repeats; r++) {
+    int acc = 0;
+    const std::chrono::steady_clock::time_point t0 =
+        std::chrono::steady_clock::now();
+    for (uint64_t k = 0; k < passes; k++)
+      for (size_t i = 0; i < num_inputs; i++)
+        acc += pred(i);
+    const std::chrono::steady_clock::time_point t1 =
+        std::chrono::steady_clock::now();
+    sink = sink + acc;
+    ns[r] = std::chrono::duration<double, std::nano>(t1 - t0).count() /
+            (double)(passes * num_inputs);
+  }
+  std::sort(ns.begin(), ns.end());
+  res.ns_median = (repeats % 2) ? (ns[repeats / 2])
+                                : ((ns[repeats / 2 - 1] + ns[repeats / 2]) / 2);
+  res.ns_min = ns.front();
+  res.ns_max = ns.back();
+  return res;
+}
+
+//  Input: repetitions: repeats, calls per repetition: min_calls.
+// Output: appends to results the timings of orient3d and insphere.
+static void bench_delaunay_predicates(std::vector<PredResult> &results,
+                                      uint32_t repeats, uint64_t min_calls) {
+  BenchRandom r(1);
+  std::vector<Vec3> o_rand, o_near, o_degn; // 4 points per input
+  std::vector<Vec3> s_rand, s_near, s_degn; // 5 points per input
+  for (size_t i = 0; i < num_inputs; i++) {
+    Vec3 p[5];
+    for (int j = 0; j < 5; j++)
+      p[j] = random_point(r);
+    o_rand.insert(o_rand.end(), p, p + 4);
+    s_rand.insert(s_rand.end(), p, p + 5);
+
+    const Vec3 q = on_plane(p[0], p[1], p[2], r.uniform(), r.uniform());
+    o_near.insert(o_near.end(), p, p + 3);
+    o_near.push_back(q);
+
+    // Points of the plane z = 1/2, exactly
+    for (int j = 0; j < 4; j++) {
+      Vec3 z = p[j];
+      z.c[2] = 0.5;
+      o_degn.push_back(z);
+    }
+
+    const Vec3 center = random_point(r);
+    const double radius = 0.1 + r.uniform();
+    for (int j = 0; j < 5; j++)
+      s_near.push_back(on_sphere(r, center, radius));
+
+    // Five of the six points (center +- radius along the axes): exactly
+    // cospherical, with radius a power of 2
+    const int skip = (int)(r.next() % 6);
+    for (int j = 0; j < 6; j++)
+      if (j != skip) {
+        Vec3 e = {{0.5, 0.5, 0.5}};
+        e.c[j / 2] += (j % 2) ? (-0.25) : (0.25);
+        s_degn.push_back(e);
+      }
+  }
+
+  const std::vector<Vec3> *o_sets[] = {&o_rand, &o_near, &o_degn};
+  const std::vector<Vec3> *s_sets[] = {&s_rand, &s_near, &s_degn};
+  const char *inputs[] = {"random", "near-degenerate", "degenerate"};
+  for (int k = 0; k < 3; k++) {
+    const Vec3 *o = o_sets[k]->data();
+    results.push_back(time_predicate(
+        "orient3d", inputs[k],
+        [o](size_t i) {
+          const Vec3 *p = o + 4 * i;
+          return orient3d(p[0].c[0], p[0].c[1], p[0].c[2], p[1].c[0],
+                          p[1].c[1], p[1].c[2], p[2].c[0], p[2].c[1],
+                          p[2].c[2], p[3].c[0], p[3].c[1], p[3].c[2]);
+        },
+        repeats, min_calls));
+  }
+  for (int k = 0; k < 3; k++) {
+    const Vec3 *s = s_sets[k]->data();
+    results.push_back(time_predicate(
+        "insphere", inputs[k],
+        [s](size_t i) {
+          const Vec3 *p = s + 5 * i;
+          return insphere(p[0].c[0], p[0].c[1], p[0].c[2], p[1].c[0],
+                          p[1].c[1], p[1].c[2], p[2].c[0], p[2].c[1],
+                          p[2].c[2], p[3].c[0], p[3].c[1], p[3].c[2],
+                          p[4].c[0], p[4].c[1], p[4].c[2]);
+        },
+        repeats, min_calls));
+  }
+}
+
+//  Input: repetitions: repeats, calls per repetition: min_calls.
+// Output: appends to results the timings of innerSegmentCrossesInnerTriangle
+//         and pointInInnerTriangle.
+static void bench_extended_predicates(std::vector<PredResult> &results,
+                                      uint32_t repeats, uint64_t min_calls) {
+  BenchRandom r(2);
+  std::vector<Vec3> x_rand, x_near, x_degn; // Segment + triangle
+  std::vector<Vec3> t_rand, t_near, t_degn; // Point + triangle
+  for (size_t i = 0; i < num_inputs; i++) {
+    Vec3 p[5];
+    for (int j = 0; j < 5; j++)
+      p[j] = random_point(r);
+    x_rand.insert(x_rand.end(), p, p + 5);
+
+    // A segment through a point of the edge p[2] p[3], up to rounding
+    const Vec3 m = on_plane(p[2], p[3], p[4], r.uniform(), 0);
+    Vec3 u1, u2;
+    for (int j = 0; j < 3; j++) {
+      u1.c[j] = m.c[j] + (p[0].c[j] - 0.5) / 4;
+      u2.c[j] = m.c[j] - (p[0].c[j] - 0.5) / 4;
+    }
+    x_near.push_back(u1);
+    x_near.push_back(u2);
+    x_near.insert(x_near.end(), p + 2, p + 5);
+
+    // Segment and triangle in the plane z = 1/2
+    for (int j = 0; j < 5; j++) {
+      Vec3 z = p[j];
+      z.c[2] = 0.5;
+      x_degn.push_back(z);
+    }
+
+    // A point in the plane of the triangle, up to rounding
+    const double u = r.uniform(), v = r.uniform() * (1 - u);
+    t_rand.push_back(on_plane(p[0], p[1], p[2], u, v));
+    t_rand.insert(t_rand.end(), p, p + 3);
+
+    // A point of the edge p[0] p[1], up to rounding
+    t_near.push_back(on_plane(p[0], p[1], p[2], u, 0));
+    t_near.insert(t_near.end(), p, p + 3);
+
+    // A point of an edge in the plane z = 1/2, exactly
+    Vec3 a = {{0.25, 0.25, 0.5}}, b = {{0.75, 0.25, 0.5}};
+    Vec3 c = {{0.5, 0.75, 0.5}}, e = {{0.25 + u / 2, 0.25, 0.5}};
+    t_degn.push_back(e);
+    t_degn.push_back(a);
+    t_degn.push_back(b);
+    t_degn.push_back(c);
+  }
+
+  const std::vector<Vec3> *x_sets[] = {&x_rand, &x_near, &x_degn};
+  const std::vector<Vec3> *t_sets[] = {&t_rand, &t_near, &t_degn};
+  const char *inputs[] = {"random", "near-degenerate", "degenerate"};
+  for (int k = 0; k < 3; k++) {
+    const Vec3 *x = x_sets[k]->data();
+    results.push_back(time_predicate(
+        "innerSegmentCrossesInnerTriangle", inputs[k],
+        [x](size_t i) {
+          const Vec3 *p = x + 5 * i;
+          return (int)innerSegmentCrossesInnerTriangle(p[0].c, p[1].c, p[2].c,
+                                                       p[3].c, p[4].c);
+        },
+        repeats, min_calls));
+  }
+  for (int k = 0; k < 3; k++) {
+    const Vec3 *t = t_sets[k]->data();
+    results.push_back(time_predicate(
+        "pointInInnerTriangle", inputs[k],
+        [t](size_t i) {
+          const Vec3 *p = t + 4 * i;
+          return (int)pointInInnerTriangle(p[0].c, p[1].c, p[2].c, p[3].c);
+        },
+        repeats, min_calls));
+  }
+}
+
+//  Input: repetitions: repeats, calls per repetition: min_calls.
+// Output: appends to results the timings of genericPoint::orient3D on LPI
+//         and TPI points w.r.t. the plane of three explicit points, as in
+//         BSPcomplex::vrts_orient_wrtPlane.
+static void bench_implicit_predicates(std::vector<PredResult> &results,
+                                      uint32_t repeats, uint64_t min_calls) {
+  BenchRandom r(3);
+
+  // LPI: line p q, plane r s t. TPI: planes (v1 v2 v3), (w1 w2 w3),
+  // (u1 u2 u3). Each input is followed by the three points of the plane it is
+  // tested against.
+  std::vector<explicitPoint3D> pts;
+  pts.reserve(num_inputs * (5 + 3 * 3 + 9 + 3 * 3));
+  std::vector<implicitPoint3D_LPI> lpi;
+  std::vector<implicitPoint3D_TPI> tpi;
+  lpi.reserve(num_inputs);
+  tpi.reserve(num_inputs);
+  std::vector<const explicitPoint3D *> lpi_planes, tpi_planes;
+
+  const auto add = [&pts](const Vec3 &v) -> const explicitPoint3D & {
+    pts.emplace_back(v.c[0], v.c[1], v.c[2]);
+    return pts.back();
+  };
+
+  for (size_t i = 0; i < num_inputs; i++) {
+    Vec3 v[9];
+    for (int j = 0; j < 9; j++)
+      v[j] = random_point(r);
+
+    const explicitPoint3D &p = add(v[0]), &q = add(v[1]);
+    const explicitPoint3D &a = add(v[2]), &b = add(v[3]), &c = add(v[4]);
+    lpi.emplace_back(p, q, a, b, c);
+    // random, near-degenerate (near the plane a b c), degenerate (a b c)
+    lpi_planes.push_back(&add(random_point(r)));
+    lpi_planes.push_back(&add(random_point(r)));
+    lpi_planes.push_back(&add(random_point(r)));
+    lpi_planes.push_back(&a);
+    lpi_planes.push_back(&b);
+    lpi_planes.push_back(
+        &add(on_plane(v[2], v[3], v[4], r.uniform(), r.uniform())));
+    lpi_planes.push_back(&a);
+    lpi_planes.push_back(&b);
+    lpi_planes.push_back(&c);
+
+    const explicitPoint3D *e[9];
+    for (int j = 0; j < 9; j++)
+      e[j] = &add(v[j]);
+    tpi.emplace_back(*e[0], *e[1], *e[2], *e[3], *e[4], *e[5], *e[6], *e[7],
+                     *e[8]);
+    tpi_planes.push_back(&add(random_point(r)));
+    tpi_planes.push_back(&add(random_point(r)));
+    tpi_planes.push_back(&add(random_point(r)));
+    tpi_planes.push_back(e[0]);
+    tpi_planes.push_back(e[1]);
+    tpi_planes.push_back(
+        &add(on_plane(v[0], v[1], v[2], r.uniform(), r.uniform())));
+    tpi_planes.push_back(e[0]);
+    tpi_planes.push_back(e[1]);
+    tpi_planes.push_back(e[2]);
+  }
+
+  const char *inputs[] = {"random", "near-degenerate", "degenerate"};
+  for (int k = 0; k < 3; k++) {
+    const implicitPoint3D_LPI *l = lpi.data();
+    const explicitPoint3D *const *pl = lpi_planes.data() + 3 * k;
+    results.push_back(time_predicate(
+        "orient3D LPI", inputs[k],
+        [l, pl](size_t i) {
+          const explicitPoint3D *const *t = pl + 9 * i;
+          return genericPoint::orient3D(l[i], *t[0], *t[1], *t[2]);
+        },
+        repeats, min_calls));
+  }
+  for (int k = 0; k < 3; k++) {
+    const implicitPoint3D_TPI *t3 = tpi.data();
+    const explicitPoint3D *const *pl = tpi_planes.data() + 3 * k;
+    results.push_back(time_predicate(
+        "orient3D TPI", inputs[k],
+        [t3, pl](size_t i) {
+          const explicitPoint3D *const *t = pl + 9 * i;
+          return genericPoint::orient3D(t3[i], *t[0], *t[1], *t[2]);
+        },
+        repeats, min_calls));
+  }
+}
+
+//  Input: results, file name: filename.
+// Output: saves the results as CSV, one row per case.
+static void save_CSV(const std::vector<PredResult> &results,
+                     const char *filename) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    ip_error("save_CSV: FATAL ERROR cannot open the file\n");
+  fprintf(f, "predicate,input,ns_median,ns_min,ns_max,positive,zero,"
+             "negative\n");
+  for (const PredResult &res : results)
+    fprintf(f, "%s,%s,%.3f,%.3f,%.3f,%llu,%llu,%llu\n", res.family.c_str(),
+            res.input.c_str(), res.ns_median, res.ns_min, res.ns_max,
+            (unsigned long long)res.positive, (unsigned long long)res.zero,
+            (unsigned long long)res.negative);
+  if (fclose(f) != 0)
+    ip_error("save_CSV: FATAL ERROR cannot write the file\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t repeats = 7;
+  uint64_t min_calls = 1 << 20;
+  const char *out_name = "bench_predicates.csv";
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-' && (argv[i][1] == 'r' || argv[i][1] == 'n' ||
+                              argv[i][1] == 'o')) {
+      if (++i == argc)
+        ip_error("Missing option argument\n");
+      if (argv[i - 1][1] == 'o')
+        out_name = argv[i];
+      else if (argv[i - 1][1] == 'r')
+        repeats = (uint32_t)atoi(argv[i]);
+      else
+        min_calls = (uint64_t)atoll(argv[i]);
+      if (repeats == 0 || min_calls == 0)
+        ip_error("Repetitions and calls must be positive\n");
+    } else {
+      printf("\nUsage: mesh_generator_bench_predicates [-r repeats | "
+             "-n calls | -o file.csv]\n\n"
+             "Times the predicates of the pipeline on random (filtered fast "
+             "path), near-degenerate (exact fallback) and degenerate "
+             "inputs.\n\n"
+             "-r repeats = repetitions of each measure (default 7)\n"
+             "-n calls = calls per repetition (default 1048576)\n"
+             "-o file.csv = save the results to file.csv (default "
+             "'bench_predicates.csv')\n");
+      return 0;
+    }
+  }
+
+  std::vector<PredResult> results;
+  {
+    // The Delaunay and constraint insertion stages run in the default
+    // floating point environment...
+    FPUscope fpu_scope;
+    fesetenv(FE_DFL_ENV);
+    bench_delaunay_predicates(results, repeats, min_calls);
+    bench_extended_predicates(results, repeats, min_calls);
+  }
+  {
+    // ...and the subdivision in the one of initFPU
+    FPUscope fpu_scope;
+    initFPU();
+    bench_implicit_predicates(results, repeats, min_calls);
+  }
+
+  printf("%-34s %-16s %10s %10s %10s %8s %8s %8s\n", "predicate", "input",
+         "ns/call", "min", "max", "+", "0", "-");
+  for (const PredResult &res : results)
+    printf("%-34s %-16s %10.2f %10.2f %10.2f %8llu %8llu %8llu\n",
+           res.family.c_str(), res.input.c_str(), res.ns_median, res.ns_min,
+           res.ns_max, (unsigned long long)res.positive,
+           (unsigned long long)res.zero, (unsigned long long)res.negative);
+
+  save_CSV(results, out_name);
+  printf("Done.\n");
+
+  return 0;
+}
@@ -1,6 +1,10 @@
 #include "conforming_mesh.h"
 #include "extended_predicates.h"
 #include "implicit_point.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
 
 #define INTERSECTION 1
 #define IMPROPER_INTERSECTION 2
@@ -344,6 +348,7 @@ static inline uint32_t tet_faceID(uint32_t v0, uint32_t v1, uint32_t v2,
 
 //  Input: trinagle <v0,v1,v2>,
 //         pointer to the mesh,
+//         array of tetrahedra marks for incident_tetrahedra: mark_incTet,
 //         pointer of face_ID type.
 // Output: returns 1 if <v0,v1,v2> is a face of one tetrahedron between those
 //         incident in v0, 0 otherwise.
@@ -351,11 +356,12 @@ static inline uint32_t tet_faceID(uint32_t v0, uint32_t v1, uint32_t v2,
 //         of the face equal to the constraint.
 // Note. Check if the triangle is a face of a tetrahedron incident in v0.
 bool triangle_in_VT(uint32_t v0, uint32_t v1, uint32_t v2, TetMesh *mesh,
-                    uint64_t *tet_face_ind) {
+                    uint32_t *mark_incTet, uint64_t *tet_face_ind) {
 
   bool found = false;
   uint64_t num_incTet_v0 = 0, tet_ID;
-  uint64_t *incTet_v0 = mesh->incident_tetrahedra(v0, &num_incTet_v0);
+  uint64_t *incTet_v0 =
+      mesh->incident_tetrahedra(v0, &num_incTet_v0, mark_incTet);
 
   for (uint64_t i = 0; i < num_incTet_v0; i++) {
     tet_ID = 4 * incTet_v0[i];
@@ -1277,6 +1283,7 @@ static inline void fill_connecting_vrts(uint32_t *connecting_vrts,
 //         index of the constraint vertex that do not belong to the side of the
 //         constraint we are travelling: other_constr_vrt,
 //         array of tetrahedra marker: mark_TetIntersection,
+//         array of tetrahedra marks for incident_tetrahedra: mark_incTet,
 //         pointer to array of vertex index type: connecting_vrts[4],
 //         pointer to tetrahedron index type: nextTet_ind,
 //         pointer to a tetrahedron index type: num_intersecated_tet.
@@ -1292,8 +1299,9 @@ static inline void fill_connecting_vrts(uint32_t *connecting_vrts,
 //         continue the side travelling.
 uint64_t *intersections_TetVrtOnConstraintSide(
     TetMesh *mesh, uint32_t v_curr, uint32_t v_stop, uint32_t other_constr_vrt,
-    uint32_t *mark_TetIntersection, uint32_t *connecting_vrts,
-    uint64_t *nextTet_ind, uint64_t *num_intersecated_tet) {
+    uint32_t *mark_TetIntersection, uint32_t *mark_incTet,
+    uint32_t *connecting_vrts, uint64_t *nextTet_ind,
+    uint64_t *num_intersecated_tet) {
 
   //   Consider the intersection between the constraint side (v_start,v_stop)
   //   and a tetrahedron incident in v_curr.
@@ -1307,7 +1315,8 @@ uint64_t *intersections_TetVrtOnConstraintSide(
   //   (3') like 3), but the other endpoint of the common edge is v_stop.
 
   uint64_t num_incTet;
-  uint64_t *incTet = mesh->incident_tetrahedra(v_curr, &num_incTet);
+  uint64_t *incTet =
+      mesh->incident_tetrahedra(v_curr, &num_incTet, mark_incTet);
   // ghost-tets are NOT returned.
 
   // Not already visited tet_
@@ -1911,7 +1920,8 @@ uint32_t tet_intersects_triInterior(uint64_t tet_ind, const uint32_t *c,
 //         the vertices of the constraint: constraint_vrts,
 //         pointer to a tetrahedron index type: num_intersecatedTet,
 //         pointer to array tetrahedra indices: intersecatedTet,
-//         array of tetrahedra marker: mark_TetIntersection.
+//         array of tetrahedra marker: mark_TetIntersection,
+//         array of tetrahedra marks for incident_tetrahedra: mark_incTet.
 // Output: by using num_intersecatedTet returns the number of tetrahedra
 //           intersecated by the boundary of the constraint-triangle,
 //         by using intersecatedTet returns the indices of tetrahedra
@@ -1922,7 +1932,8 @@ void intersections_constraint_sides(TetMesh *mesh,
                                     const uint32_t *constraint_vrts,
                                     uint64_t *num_intersecatedTet,
                                     uint64_t **intersecatedTet,
-                                    uint32_t *mark_TetIntersection) {
+                                    uint32_t *mark_TetIntersection,
+                                    uint32_t *mark_incTet) {
 
   // Cycle over the 3 sides of the constraints.
   for (uint32_t constr_side = 0; constr_side < 3; constr_side++) {
@@ -1960,7 +1971,7 @@ void intersections_constraint_sides(TetMesh *mesh,
     uint64_t num_found_tet = 0;
     uint64_t *found_tet = intersections_TetVrtOnConstraintSide(
         mesh, v_start, v_stop, other_constr_vrt, mark_TetIntersection,
-        connecting_vrts, &nextTet_ind, &num_found_tet);
+        mark_incTet, connecting_vrts, &nextTet_ind, &num_found_tet);
 
     enqueueTets(found_tet, num_found_tet, intersecatedTet, num_intersecatedTet);
     free(found_tet);
@@ -1982,7 +1993,7 @@ void intersections_constraint_sides(TetMesh *mesh,
         // intersect the constraint side.
         found_tet = intersections_TetVrtOnConstraintSide(
             mesh, connecting_vrts[1], v_stop, other_constr_vrt,
-            mark_TetIntersection, connecting_vrts, &nextTet_ind,
+            mark_TetIntersection, mark_incTet, connecting_vrts, &nextTet_ind,
             &num_found_tet);
         break;
 
@@ -2093,52 +2104,12 @@ uint32_t constrInterior_firstStep(const TetMesh *mesh,
   return 0;
 }
 
-//  Input: pointer to the mesh,
-//         indices of a constraint-tiangle vertices: constraints_verts,
-//         index of a tetrahedron tet intersecting the constraint: tet_ind,
+//  Input: index of a tetrahedron tet marked by constrInterior_found: tet_ind,
 //         pointer to the array of tetrahedra marker: mark_TetIntersection.
-// Output: return the number of not-already-visited tetrahedron that intersects
-//         the interior of the constraint in a connected region limitated by
-//         the already-visited tetrahedra (all that intersects constraint
-//         boundary + all the alraedy-visited of those that intersectcontraint
-//         interior).
-uint64_t constrInterior_count(const TetMesh *mesh,
-                              const uint32_t *constraints_verts,
-                              uint64_t tet_ind,
-                              uint32_t *mark_TetIntersection) {
-  uint64_t num_tets_intersects = 1; // tet intersects (only)
-                                    // the interior of the constraint.
-
-  // Cycle over the tetrahedra adjacent to tet.
-  for (uint64_t i = 0; i < 4; i++) {
-
-    uint64_t adj_tet_ind = mesh->tet_neigh[4 * tet_ind + i] >> 2;
-
-    if (constrInterior_found(mesh, constraints_verts, adj_tet_ind,
-                             mark_TetIntersection))
-      num_tets_intersects += constrInterior_count(
-          mesh, constraints_verts, adj_tet_ind, mark_TetIntersection);
-  }
-
-  return num_tets_intersects;
-}
-
-//  Input: pointer to the mesh,
-//         index of a tetrahedron tet intersecting the constraint: tet_ind,
-//         pointer to the array of tetrahedra marker: mark_TetIntersection,
-//         pointer to the current last-position (length-1) of tet_list: pos,
-//         pointer to an array of tetrahedra index type: tet_list.
-// Output: by using pos returns the current last-position (length-1) of
-// tet_list. Note. this recursive function enqueue to tet_list each tetrahedra
-// adjacent
-//       to tet that intersects the only the interior of the constraint.
-void constrInterior_save(const TetMesh *mesh, uint64_t tet_ind,
-                         uint32_t *mark_TetIntersection, uint64_t *pos,
-                         uint64_t *tet_list) {
-
-  tet_list[*pos] = tet_ind;
-  (*pos)++;
-
+// Output: by using mark_TetIntersection turns the "COUNTED" mark of tet into
+//         the corresponding final one.
+static inline void constrInterior_mark(uint64_t tet_ind,
+                                       uint32_t *mark_TetIntersection) {
   if (mark_TetIntersection[tet_ind] == IMPROPER_INTERSECTION_COUNTED)
     mark_TetIntersection[tet_ind] = IMPROPER_INTERSECTION;
   else if (mark_TetIntersection[tet_ind] == OVERLAP2D_F0_COUNTED)
@@ -2151,27 +2122,14 @@ void constrInterior_save(const TetMesh *mesh, uint64_t tet_ind,
     mark_TetIntersection[tet_ind] = OVERLAP2D_F3;
   else
     mark_TetIntersection[tet_ind] = INTERSECTION;
-
-  for (uint64_t i = 0; i < 4; i++) {
-    uint64_t adj_tet_ind = mesh->tet_neigh[4 * tet_ind + i] >> 2;
-
-    if (mark_TetIntersection[adj_tet_ind] == IMPROPER_INTERSECTION_COUNTED ||
-        mark_TetIntersection[adj_tet_ind] == OVERLAP2D_F0_COUNTED ||
-        mark_TetIntersection[adj_tet_ind] == OVERLAP2D_F1_COUNTED ||
-        mark_TetIntersection[adj_tet_ind] == OVERLAP2D_F2_COUNTED ||
-        mark_TetIntersection[adj_tet_ind] == OVERLAP2D_F3_COUNTED ||
-        mark_TetIntersection[adj_tet_ind] == PROPER_INTERSECTION_COUNTED)
-      constrInterior_save(mesh, adj_tet_ind, mark_TetIntersection, pos,
-                          tet_list);
-  }
-  return;
 }
 
 //  Input: pointer to the mesh,
 //         the vertices of the constraint: constraint_vrts,
 //         pointer to a tetrahedron index type: num_intersecatedTet,
 //         pointer to array tetrahedra indices: intersecatedTet,
-//         pinter to a tetrahedra marker: mark_TetIntersection.
+//         pinter to a tetrahedra marker: mark_TetIntersection,
+//         work queue (any content is discarded): queue.
 // Output: by using num_intersecatedTet returns the sum between the number of
 //         tetrahedra intersecated by the boundary and the number of tetrahedra
 //         intersecated by the interior of the constraint-triangle,
@@ -2184,7 +2142,8 @@ void intersections_constraint_interior(TetMesh *mesh,
                                        const uint32_t *constraint_vrts,
                                        uint64_t *num_intersecatedTet,
                                        uint64_t **intersecatedTet,
-                                       uint32_t *mark_TetIntersection) {
+                                       uint32_t *mark_TetIntersection,
+                                       std::vector<uint64_t> &queue) {
 
   uint64_t num_bnd_tets = *num_intersecatedTet;
   uint64_t bnd_tet;
@@ -2203,86 +2162,43 @@ void intersections_constraint_interior(TetMesh *mesh,
                                  mark_TetIntersection, &adjIN_tet) == 0)
       continue;
 
-    // RecursiveFun-call:
-    // explore a connected region of the interior of the constraint -> COUNT
-    uint64_t num = constrInterior_count(mesh, constraint_vrts, adjIN_tet,
-                                        mark_TetIntersection);
-
-    if (num > 1) {
-      uint64_t *interiorConstrInterct_tet =
-          (uint64_t *)malloc(sizeof(uint64_t) * num);
-      // RecursiveFun-call:
-      // explore a connected region of the constraint interior -> SAVE
-      uint64_t pos = 0;
-      constrInterior_save(mesh, adjIN_tet, mark_TetIntersection, &pos,
-                          interiorConstrInterct_tet);
-
-      enqueueTets(interiorConstrInterct_tet, num, intersecatedTet, num_intersecatedTet);
-      free(interiorConstrInterct_tet);
-    } else {
-      if (mark_TetIntersection[adjIN_tet] == IMPROPER_INTERSECTION_COUNTED)
-        mark_TetIntersection[adjIN_tet] = IMPROPER_INTERSECTION;
-      else if (mark_TetIntersection[adjIN_tet] == OVERLAP2D_F0_COUNTED)
-        mark_TetIntersection[adjIN_tet] = OVERLAP2D_F0;
-      else if (mark_TetIntersection[adjIN_tet] == OVERLAP2D_F1_COUNTED)
-        mark_TetIntersection[adjIN_tet] = OVERLAP2D_F1;
-      else if (mark_TetIntersection[adjIN_tet] == OVERLAP2D_F2_COUNTED)
-        mark_TetIntersection[adjIN_tet] = OVERLAP2D_F2;
-      else if (mark_TetIntersection[adjIN_tet] == OVERLAP2D_F3_COUNTED)
-        mark_TetIntersection[adjIN_tet] = OVERLAP2D_F3;
-      else
-        mark_TetIntersection[adjIN_tet] = INTERSECTION;
-
-      enqueueTets(&adjIN_tet, 1, intersecatedTet, num_intersecatedTet);
+    // Breadth-first visit of the connected region of the constraint
+    // interior that contains adjIN_tet. Tetrahedra get their final mark as
+    // soon as they are found, hence each one is visited once.
+    queue.clear();
+    queue.push_back(adjIN_tet);
+    constrInterior_mark(adjIN_tet, mark_TetIntersection);
+    for (size_t q = 0; q < queue.size(); q++) {
+      const uint64_t tet_ind = queue[q];
+      for (uint64_t i = 0; i < 4; i++) {
+        uint64_t adj_tet_ind = mesh->tet_neigh[4 * tet_ind + i] >> 2;
+        if (constrInterior_found(mesh, constraint_vrts, adj_tet_ind,
+                                 mark_TetIntersection)) {
+          constrInterior_mark(adj_tet_ind, mark_TetIntersection);
+          queue.push_back(adj_tet_ind);
+        }
+      }
     }
-  }
-}
-
-static inline void compile_map_innerInt(uint32_t tri_ind, uint64_t tet_ind,
-                                        uint32_t *num_map, uint32_t **map) {
-  num_map[tet_ind]++; // Number of intersections increases for the tetrahedron.
-
-  if (num_map[tet_ind] == 1) // 1st intersection for the tetrahedron.
-    map[tet_ind] = (uint32_t *)malloc(sizeof(uint32_t));
-  else // New intersection has to be added to the existing ones.
-    map[tet_ind] =
-        (uint32_t *)realloc(map[tet_ind], sizeof(uint32_t) * num_map[tet_ind]);
 
-  map[tet_ind][num_map[tet_ind] - 1] = tri_ind;
+    enqueueTets(queue.data(), queue.size(), intersecatedTet,
+                num_intersecatedTet);
+  }
 }
 
-static inline void compile_map_fi(uint32_t tri_ind, uint64_t tet_ind,
-                                  uint32_t *num_map_fi, uint32_t **map_fi) {
-
-  num_map_fi[tet_ind]++; // The number of overlapping constraints increases
-                         // for the tetrahedron tet_ind face_i.
-
-  if (num_map_fi[tet_ind] == 1) // It is the first overlapping constraint.
-    map_fi[tet_ind] = (uint32_t *)malloc(sizeof(uint32_t));
-  else // The new overlapping constraints has to be added
-       // to the existing ones.
-    map_fi[tet_ind] = (uint32_t *)realloc(
-        map_fi[tet_ind], sizeof(uint32_t) * num_map_fi[tet_ind]);
-
-  map_fi[tet_ind][num_map_fi[tet_ind] - 1] = tri_ind;
-}
+// A constraint that has to be added to one of the maps of a tetrahedron.
+// map_ID is 0 for map, j+1 for map_fj.
+struct tet_constr_t {
+  uint64_t tet_ind;
+  uint32_t tri_ind;
+  uint32_t map_ID;
+};
 
-static inline void
-compile_tetfFaces_map(uint32_t tri_ind, uint64_t tet_face_ind,
-                      uint32_t *num_map_f0, uint32_t **map_f0,
-                      uint32_t *num_map_f1, uint32_t **map_f1,
-                      uint32_t *num_map_f2, uint32_t **map_f2,
-                      uint32_t *num_map_f3, uint32_t **map_f3) {
+static inline void compile_tetfFaces_map(uint32_t tri_ind,
+                                         uint64_t tet_face_ind,
+                                         std::vector<tet_constr_t> &pairs) {
   uint64_t i = tet_face_ind % 4;       // tet_face_ind%4
   uint64_t tet_ind = tet_face_ind / 4; // tet_face_ind/4
-  if (i == 0)
-    compile_map_fi(tri_ind, tet_ind, num_map_f0, map_f0);
-  else if (i == 1)
-    compile_map_fi(tri_ind, tet_ind, num_map_f1, map_f1);
-  else if (i == 2)
-    compile_map_fi(tri_ind, tet_ind, num_map_f2, map_f2);
-  else if (i == 3)
-    compile_map_fi(tri_ind, tet_ind, num_map_f3, map_f3);
+  pairs.push_back({tet_ind, tri_ind, (uint32_t)(i + 1)});
 }
 
 //  Input: index of the constraint tri: tri_ind,
@@ -2291,41 +2207,94 @@ compile_tetfFaces_map(uint32_t tri_ind, uint64_t tet_face_ind,
 //         constraint tri: tets,
 //         array of marker to distiguish between general intersection and
 //         intersection that have to be mapped,
-//         array, i-th elemet counts the number of constraints intersecated
-//         by i-th tetrahedron: num_map,
-//         array, i-th elemet points to the array listing the constraints
-//         intersecated by i-th tetrahedron: map.
-// Output: by using map returns the map updated with information of tets,
-//         by using num_map returns the num_map updated with
-//         information of tets.
-// Note1. Update means that, at the lists of map relative to tetrahedra in tets
-//        is added tri_ind, consequently the relative num_map are incrementated.
+//         list of pairs to be added to the maps: pairs.
+// Output: by using pairs returns the list updated with information of tets.
+// Note1. Update means that, for the tetrahedra in tets that have to be
+//        mapped, a pair (tet, tri_ind) is added to pairs.
 // Note2. The entries of the array of marker have to be set to 0 after their
 //        iformation have been used.
 void compile_maps(uint32_t tri_ind, uint64_t n, const uint64_t *tets,
-                  uint32_t *mark_TetIntersection, uint32_t *num_map,
-                  uint32_t **map, uint32_t *num_map_f0, uint32_t **map_f0,
-                  uint32_t *num_map_f1, uint32_t **map_f1, uint32_t *num_map_f2,
-                  uint32_t **map_f2, uint32_t *num_map_f3, uint32_t **map_f3) {
+                  uint32_t *mark_TetIntersection,
+                  std::vector<tet_constr_t> &pairs) {
 
   for (uint64_t i = 0; i < n; i++) {
     uint64_t tet_ind = tets[i];
 
     if (mark_TetIntersection[tet_ind] == IMPROPER_INTERSECTION)
-      compile_map_innerInt(tri_ind, tet_ind, num_map, map);
+      pairs.push_back({tet_ind, tri_ind, 0});
     else if (mark_TetIntersection[tet_ind] == OVERLAP2D_F0)
-      compile_map_fi(tri_ind, tet_ind, num_map_f0, map_f0);
+      pairs.push_back({tet_ind, tri_ind, 1});
     else if (mark_TetIntersection[tet_ind] == OVERLAP2D_F1)
-      compile_map_fi(tri_ind, tet_ind, num_map_f1, map_f1);
+      pairs.push_back({tet_ind, tri_ind, 2});
     else if (mark_TetIntersection[tet_ind] == OVERLAP2D_F2)
-      compile_map_fi(tri_ind, tet_ind, num_map_f2, map_f2);
+      pairs.push_back({tet_ind, tri_ind, 3});
     else if (mark_TetIntersection[tet_ind] == OVERLAP2D_F3)
-      compile_map_fi(tri_ind, tet_ind, num_map_f3, map_f3);
+      pairs.push_back({tet_ind, tri_ind, 4});
 
     mark_TetIntersection[tet_ind] = 0; // Reset the tetrahedron marker.
   }
 }
 
+//  Input: pointer to the mesh,
+//         pointer to the constraints,
+//         index of the constraint tri: tri_ind,
+//         array of tetrahedra marker: mark_TetIntersection,
+//         array of tetrahedra marks for incident_tetrahedra: mark_incTet,
+//         work queue for the visit of the constraint interior: queue,
+//         list of pairs to be added to the maps: pairs.
+// Output: by using pairs returns the list updated with the tetrahedra
+//         that intersect tri.
+// Note. Only the marker arrays and the queue are modified: threads with
+//       their own markers and queue can trace different constraints
+//       concurrently.
+void trace_constraint(TetMesh *mesh, const Constraint *constraints,
+                      uint32_t tri_ind, uint32_t *mark_TetIntersection,
+                      uint32_t *mark_incTet, std::vector<uint64_t> &queue,
+                      std::vector<tet_constr_t> &pairs) {
+  uint32_t v[3]; // vertices of the constraint-triangle.
+  uint32_t tri_ID = 3 * tri_ind;
+  v[0] = constraints->tri_vertices[tri_ID];
+  v[1] = constraints->tri_vertices[tri_ID + 1];
+  v[2] = constraints->tri_vertices[tri_ID + 2];
+
+  // ---STEP 0--- [The very trivial case]
+  // Check if the constraint-triangle is a face of a tetrahedron
+  // incident in v0. In this case there is a proper intersection,
+  // but there is a (2D)overlapping.
+  uint64_t tet_face_ind = UINT64_MAX;
+  if (triangle_in_VT(v[0], v[1], v[2], mesh, mark_incTet, &tet_face_ind) ==
+      1) {
+    const uint64_t ng = mesh->tet_neigh[tet_face_ind];
+    compile_tetfFaces_map(tri_ind, ng, pairs);
+    compile_tetfFaces_map(tri_ind, tet_face_ind, pairs);
+    return;
+  }
+
+  // We use an array to save the indices all tetrahedra that intersect
+  // the constraint, properly or improperly.
+  uint64_t num_intersecatedTet = 0;
+  uint64_t *intersecatedTet = NULL;
+
+  // ---STEP 1--- [Intersections with the BOUNDARY of the constraint]
+  intersections_constraint_sides(mesh, v, &num_intersecatedTet,
+                                 &intersecatedTet, mark_TetIntersection,
+                                 mark_incTet);
+
+  // ---STEP 2--- [Search for improper intersections]
+  find_improperIntersection(v, intersecatedTet, num_intersecatedTet,
+                            mark_TetIntersection, mesh);
+
+  // ---STEP 3--- [Intersections with the constraint INTERIOR]
+  intersections_constraint_interior(mesh, v, &num_intersecatedTet,
+                                    &intersecatedTet, mark_TetIntersection,
+                                    queue);
+
+  // ---STEP 4--- [Fill intersection pairs & reset mark_TetIntersection]
+  compile_maps(tri_ind, num_intersecatedTet, intersecatedTet,
+               mark_TetIntersection, pairs);
+  free(intersecatedTet);
+}
+
 /***********************************/
 /** Constraint insertion GENERAL **/
 /***********************************/
@@ -2354,13 +2323,24 @@ void compile_maps(uint32_t tri_ind, uint64_t n, const uint64_t *tets,
 //        - ONLY a face of the tetrahedron,
 //        - ONLY an edge of the tetrahedron,
 //        - ONLY a vertex of the tetrahedron.
+// Constraints are traced by num_threads threads, in chunks of
+// CONSTRAINTS_PER_CHUNK. Each thread has its own markers. The pairs found
+// in each chunk are added to the maps in constraint order, so that the
+// maps do not depend on the number of threads.
+// The markers take 8 bytes per tetrahedron and thread (the first thread
+// uses mark_tetrahedra for half of them). At most MAX_TRACING_THREADS
+// threads are used, so that the markers take less memory than the
+// tetrahedra themselves (tet_node and tet_neigh, 48 bytes per tetrahedron).
+// Maps are filled in two serial passes over the pairs: the first one counts
+// the constraints of each tetrahedron, the second one stores them.
+#define CONSTRAINTS_PER_CHUNK 64
+#define MAX_TRACING_THREADS 6
 
 void insert_constraints(TetMesh *mesh, Constraint *constraints,
-                        uint32_t *num_map, uint32_t **map, uint32_t *num_map_f0,
-                        uint32_t **map_f0, uint32_t *num_map_f1,
-                        uint32_t **map_f1, uint32_t *num_map_f2,
-                        uint32_t **map_f2, uint32_t *num_map_f3,
-                        uint32_t **map_f3) {
+                        TetConstraintMap &map, TetConstraintMap &map_f0,
+                        TetConstraintMap &map_f1, TetConstraintMap &map_f2,
+                        TetConstraintMap &map_f3, uint32_t num_threads) {
+  TRACE_SPAN("insert_constraints");
 
   // We will cycle over constraints using an array of marker to mark the
   // tetrahedra that intersect a constraint.
@@ -2375,57 +2355,77 @@ void insert_constraints(TetMesh *mesh, Constraint *constraints,
   // - faces (2D)overlapping with constraints, wherever its the face opposite
   //   to vertex j=0,1,2 or 3...
   //      -> marked as OVERLAP2D_Fj
-  uint32_t *mark_TetIntersection = (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
+  const uint32_t num_chunks =
+      (constraints->num_triangles + CONSTRAINTS_PER_CHUNK - 1) /
+      CONSTRAINTS_PER_CHUNK;
+  if (num_threads > MAX_TRACING_THREADS)
+    num_threads = MAX_TRACING_THREADS;
+  if (num_threads > num_chunks)
+    num_threads = (num_chunks > 0) ? num_chunks : 1;
 
-  // Search interections on each constraint.
-  for (uint32_t tri_ind = 0; tri_ind < constraints->num_triangles; tri_ind++) {
-    uint32_t v[3]; // vertices of the constraint-triangle.
-    uint32_t tri_ID = 3 * tri_ind;
-    v[0] = constraints->tri_vertices[tri_ID];
-    v[1] = constraints->tri_vertices[tri_ID + 1];
-    v[2] = constraints->tri_vertices[tri_ID + 2];
-
-    // ---STEP 0--- [The very trivial case]
-    // Check if the constraint-triangle is a face of a tetrahedron
-    // incident in v0. In this case there is a proper intersection,
-    // but there is a (2D)overlapping.
-    uint64_t tet_face_ind = UINT64_MAX;
-    if (triangle_in_VT(v[0], v[1], v[2], mesh, &tet_face_ind) == 1) {
-      const uint64_t ng = mesh->tet_neigh[tet_face_ind];
-      compile_tetfFaces_map(tri_ind, ng, num_map_f0, map_f0, num_map_f1, map_f1,
-                            num_map_f2, map_f2, num_map_f3, map_f3);
-      compile_tetfFaces_map(tri_ind, tet_face_ind, num_map_f0, map_f0,
-                            num_map_f1, map_f1, num_map_f2, map_f2, num_map_f3,
-                            map_f3);
+  std::vector<std::vector<tet_constr_t>> chunk_pairs(num_chunks);
+  std::atomic<uint32_t> next_chunk(0);
 
-      continue;
+  // Search interections on each constraint.
+  parallel_run(num_threads, [&](uint32_t t) {
+    uint32_t *mark_TetIntersection =
+        (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
+    uint32_t *mark_incTet =
+        (t == 0) ? (mesh->mark_tetrahedra)
+                 : ((uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t)));
+    if (mark_TetIntersection == NULL || mark_incTet == NULL)
+      ip_error("insert_constraints: FATAL ERROR out of memory\n");
+    std::vector<uint64_t> queue;
+
+    for (uint32_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+      const uint32_t first = c * CONSTRAINTS_PER_CHUNK;
+      const uint32_t last =
+          std::min(first + CONSTRAINTS_PER_CHUNK, constraints->num_triangles);
+      for (uint32_t tri_ind = first; tri_ind < last; tri_ind++)
+        trace_constraint(mesh, constraints, tri_ind, mark_TetIntersection,
+                         mark_incTet, queue, chunk_pairs[c]);
     }
 
-    // We use an array to save the indices all tetrahedra that intersect
-    // the constraint, properly or improperly.
-    uint64_t num_intersecatedTet = 0;
-    uint64_t *intersecatedTet = NULL;
-
-    // ---STEP 1--- [Intersections with the BOUNDARY of the constraint]
-    intersections_constraint_sides(mesh, v, &num_intersecatedTet,
-                                   &intersecatedTet, mark_TetIntersection);
-
-    // ---STEP 2--- [Search for improper intersections]
-    find_improperIntersection(v, intersecatedTet, num_intersecatedTet,
-                              mark_TetIntersection, mesh);
-
-    // ---STEP 3--- [Intersections with the constraint INTERIOR]
-    intersections_constraint_interior(mesh, v, &num_intersecatedTet,
-                                      &intersecatedTet, mark_TetIntersection);
-
-    // ---STEP 4--- [Fill intersection map & reset mark_TetIntersection]
-    compile_maps(tri_ind, num_intersecatedTet, intersecatedTet,
-                 mark_TetIntersection, num_map, map, num_map_f0, map_f0,
-                 num_map_f1, map_f1, num_map_f2, map_f2, num_map_f3, map_f3);
-    free(intersecatedTet);
-    intersecatedTet = NULL;
+    if (t != 0)
+      free(mark_incTet);
+    free(mark_TetIntersection);
+  });
+
+  // Fill the maps. Each pass is a single sweep over the pairs, much shorter
+  // than the tracing: splitting it among threads would make each of them
+  // scan all the pairs, and write to the same cache lines of off.
+  TetConstraintMap *map_fi[5] = {&map, &map_f0, &map_f1, &map_f2, &map_f3};
+  const uint64_t tet_num = mesh->tet_num;
+  for (uint32_t m = 0; m < 5; m++) {
+    map_fi[m]->clear();
+    map_fi[m]->off = (uint64_t *)calloc(tet_num + 1, sizeof(uint64_t));
+  }
+
+  // Count the constraints of each tetrahedron (in off[tet_ind + 1]).
+  for (uint32_t c = 0; c < num_chunks; c++)
+    for (const tet_constr_t &p : chunk_pairs[c])
+      map_fi[p.map_ID]->off[p.tet_ind + 1]++;
+
+  // Turn counts into offsets: off[tet_ind] is where the constraints of
+  // tet_ind begin.
+  for (uint32_t m = 0; m < 5; m++) {
+    uint64_t *off = map_fi[m]->off;
+    for (uint64_t i = 0; i < tet_num; i++)
+      off[i + 1] += off[i];
+    map_fi[m]->ind = (uint32_t *)malloc(sizeof(uint32_t) * (off[tet_num] + 1));
   }
 
-  free(mark_TetIntersection);
-  mark_TetIntersection = NULL;
+  // Store the constraints. off[tet_ind] is used as a cursor and ends up
+  // being the offset of tet_ind + 1.
+  for (uint32_t c = 0; c < num_chunks; c++)
+    for (const tet_constr_t &p : chunk_pairs[c]) {
+      TetConstraintMap *m = map_fi[p.map_ID];
+      m->ind[m->off[p.tet_ind]++] = p.tri_ind;
+    }
+
+  for (uint32_t m = 0; m < 5; m++) {
+    uint64_t *off = map_fi[m]->off;
+    memmove(off + 1, off, sizeof(uint64_t) * tet_num);
+    off[0] = 0;
+  }
 }
@@ -35,12 +35,44 @@ public:
   }
 };
 
+// Map from tetrahedra to lists of constraints, in compressed (CSR) form:
+// the constraints of tetrahedron t are ind[off[t]], ..., ind[off[t+1]-1].
+class TetConstraintMap {
+public:
+  uint64_t *off; // Offsets (one per tetrahedron, plus one)
+  uint32_t *ind; // Constraint indices
+
+  TetConstraintMap() : off(NULL), ind(NULL) {}
+  ~TetConstraintMap() { clear(); }
+
+  // The map owns its arrays
+  TetConstraintMap(const TetConstraintMap &) = delete;
+  TetConstraintMap &operator=(const TetConstraintMap &) = delete;
+
+  // Number of constraints of tetrahedron t
+  inline uint32_t count(uint64_t t) const {
+    return (uint32_t)(off[t + 1] - off[t]);
+  }
+  // Constraints of tetrahedron t
+  inline const uint32_t *list(uint64_t t) const { return ind + off[t]; }
+
+  void clear() {
+    if (off)
+      free(off);
+    if (ind)
+      free(ind);
+    off = NULL;
+    ind = NULL;
+  }
+};
+
 void fill_half_edges(const Constraint *constraints, half_edge_t *half_edges);
 void sort_half_edges(half_edge_t *half_edges, uint32_t num_half_edges);
 uint32_t place_virtual_constraints(TetMesh *mesh, Constraint *constraints,
                                    half_edge_t *half_edges);
-void insert_constraints(TetMesh *, Constraint *, uint32_t *, uint32_t **,
-                        uint32_t *, uint32_t **, uint32_t *, uint32_t **,
-                        uint32_t *, uint32_t **, uint32_t *, uint32_t **);
+void insert_constraints(TetMesh *, Constraint *, TetConstraintMap &map,
+                        TetConstraintMap &map_f0, TetConstraintMap &map_f1,
+                        TetConstraintMap &map_f2, TetConstraintMap &map_f3,
+                        uint32_t num_threads = 1);
 
 #endif
@@ -1,7 +1,12 @@
 #include "delaunay.h"
+#include "parallel.h"
+#include "predicate_counters.h"
+#include "trace.h"
+#include <algorithm>
 #include <float.h>
 #include <fstream>
 #include <iostream>
+#include <math.h>
 
 /* This file contains modified source code from hxt_SeqDel (Copyright (C) 2018
  * Célestin Marot), a sequential Delaunay triangulator hosted at
@@ -11,9 +16,7 @@
 TetMesh::TetMesh()
     : vertices(NULL), num_vertices(0), tet_node(NULL), tet_neigh(NULL),
       tet_subdet(NULL), tet_num(0), tet_size(0), tet_num_vertices(0),
-      mark_tetrahedra(NULL), Del_size_tmp(1024), Del_num_tmp(0), Del_tmp(NULL),
-      Del_size_deleted(1024), Del_num_deleted(0), Del_deleted(NULL),
-      Del_buffer(NULL) {}
+      mark_tetrahedra(NULL) {}
 
 TetMesh::~TetMesh() {
   free(vertices);
@@ -134,42 +137,46 @@ void TetMesh::init() {
     vertices[i].inc_tet = 0;
 }
 
-void TetMesh::removeDelTets() {
-  uint64_t j;
-  for (uint64_t i = 0; i < Del_num_deleted; i++) {
-    uint64_t to_delete = Del_deleted[i];
+void TetMesh::removeDelTets(DelWork &w) {
+  // Deleted slots are filled with the last tetrahedra. Sorting them first
+  // avoids a quadratic search when many of them are at the end.
+  std::sort(w.deleted, w.deleted + w.num_deleted);
 
+  uint64_t lo = 0, hi = w.num_deleted;
+  while (lo < hi) {
     tet_num--;
     uint64_t lastTet = tet_num * 4;
 
-    if (tet_subdet[lastTet + 3] == -1.0) {
-      for (j = i; j < Del_num_deleted; j++)
-        if (Del_deleted[j] == lastTet)
-          break;
+    if (w.deleted[hi - 1] == lastTet) {
+      hi--;
+      continue;
+    }
 
-      Del_deleted[j] = Del_deleted[i];
-    } else {
-      for (j = 0; j < 4; j++) {
-        tet_node[to_delete + j] = tet_node[lastTet + j];
-        tet_subdet[to_delete + j] = tet_subdet[lastTet + j];
+    uint64_t to_delete = w.deleted[lo++];
+    for (uint64_t j = 0; j < 4; j++) {
+      tet_node[to_delete + j] = tet_node[lastTet + j];
+      tet_subdet[to_delete + j] = tet_subdet[lastTet + j];
 
-        uint64_t neigh = tet_neigh[lastTet + j];
-        tet_neigh[to_delete + j] = neigh;
-        tet_neigh[neigh] = to_delete + j;
+      uint64_t neigh = tet_neigh[lastTet + j];
+      tet_neigh[to_delete + j] = neigh;
+      tet_neigh[neigh] = to_delete + j;
 
-        if (tet_node[lastTet + j] != UINT32_MAX &&
-            vertices[tet_node[lastTet + j]].inc_tet == lastTet >> 2)
-          vertices[tet_node[lastTet + j]].inc_tet = to_delete >> 2;
-      }
+      if (tet_node[lastTet + j] != UINT32_MAX &&
+          vertices[tet_node[lastTet + j]].inc_tet == lastTet >> 2)
+        vertices[tet_node[lastTet + j]].inc_tet = to_delete >> 2;
     }
   }
 
-  Del_num_deleted = 0;
+  w.num_deleted = 0;
 }
 
-uint64_t TetMesh::searchTetrahedron(uint64_t tet, const uint32_t v_id) {
-  if (tet_node[tet + 3] == UINT32_MAX)
+uint64_t TetMesh::searchTetrahedron(uint64_t tet, const uint32_t v_id,
+                                    const uint16_t *owner, uint16_t part) {
+  if (tet_node[tet + 3] == UINT32_MAX) {
     tet = getNeighbor(tet, 3);
+    if (owner != NULL && !ownedTet(tet, owner, part))
+      return UINT64_MAX;
+  }
 
   const double *vc = vertices[v_id].coord;
 
@@ -187,6 +194,8 @@ uint64_t TetMesh::searchTetrahedron(uint64_t tet, const uint32_t v_id) {
 
       if (i != f0 && orient3d(a, b, c, vc) < 0.0) {
         tet = getIthNeighbor(Neigh, i);
+        if (owner != NULL && !ownedTet(tet, owner, part))
+          return UINT64_MAX;
         f0 = Neigh[i] & 3;
         break;
       }
@@ -245,19 +254,24 @@ double TetMesh::vertexInTetSphere(uint64_t tet, uint32_t v_id) {
 
   if (Node[3] == UINT32_MAX) {
     double det = aex * SubDet[0] + aey * SubDet[1] + aez * SubDet[2];
-    if (fabs(det) > o3d_static_filter)
+    if (fabs(det) > o3d_static_filter) {
+      COUNT_PREDICATE(PRED_ORIENT3D, PRED_EXPLICIT);
+      COUNT_PREDICATE_STATIC_FILTER(PRED_ORIENT3D, PRED_EXPLICIT);
       return det;
+    }
 
     const double *b = vertices[Node[1]].coord;
     const double *c = vertices[Node[2]].coord;
 
     det = orient3d(a, b, c, e);
+    COUNT_PREDICATE_RESULT(PRED_ORIENT3D, PRED_EXPLICIT, det);
     if (det != 0.0)
       return det;
 
     const uint32_t oppositeNode = tet_node[tet_neigh[tet + 3]];
     const double *oppositeVertex = vertices[oppositeNode].coord;
     det = -insphere(a, b, c, oppositeVertex, e);
+    COUNT_PREDICATE_RESULT(PRED_INSPHERE, PRED_EXPLICIT, det);
 
     if (det == 0.0) {
       uint32_t nn[5] = {Node[0], Node[1], Node[2], oppositeNode, v_id};
@@ -271,14 +285,18 @@ double TetMesh::vertexInTetSphere(uint64_t tet, uint32_t v_id) {
   const double aer = aex * aex + aey * aey + aez * aez;
   double det =
       aex * SubDet[0] - aey * SubDet[1] + aez * SubDet[2] - aer * SubDet[3];
-  if (fabs(det) > isp_static_filter)
+  if (fabs(det) > isp_static_filter) {
+    COUNT_PREDICATE(PRED_INSPHERE, PRED_EXPLICIT);
+    COUNT_PREDICATE_STATIC_FILTER(PRED_INSPHERE, PRED_EXPLICIT);
     return det;
+  }
 
   const double *b = vertices[Node[1]].coord;
   const double *c = vertices[Node[2]].coord;
   const double *d = vertices[Node[3]].coord;
 
   det = insphere(a, b, c, d, e);
+  COUNT_PREDICATE_RESULT(PRED_INSPHERE, PRED_EXPLICIT, det);
 
   if (det == 0.0) {
     uint32_t nn[5] = {Node[0], Node[1], Node[2], Node[3], v_id};
@@ -289,44 +307,47 @@ double TetMesh::vertexInTetSphere(uint64_t tet, uint32_t v_id) {
   return det;
 }
 
-void TetMesh::bnd_push(uint32_t v_id, uint32_t node1, uint32_t node2,
-                       uint32_t node3, uint64_t bnd) {
-  uint64_t n = Del_num_tmp;
-  Del_tmp[n].node[0] = v_id;
-  Del_tmp[n].node[1] = node1;
-  Del_tmp[n].node[2] = node2;
-  Del_tmp[n].node[3] = node3;
-  Del_tmp[n].bnd = bnd;
-  Del_num_tmp++;
+void TetMesh::bnd_push(DelWork &w, uint32_t v_id, uint32_t node1,
+                       uint32_t node2, uint32_t node3, uint64_t bnd) {
+  uint64_t n = w.num_tmp;
+  w.tmp[n].node[0] = v_id;
+  w.tmp[n].node[1] = node1;
+  w.tmp[n].node[2] = node2;
+  w.tmp[n].node[3] = node3;
+  w.tmp[n].bnd = bnd;
+  w.num_tmp++;
 }
 
-void TetMesh::deleteInSphereTets(uint64_t tet, const uint32_t v_id) {
+bool TetMesh::deleteInSphereTets(DelWork &w, uint64_t tet, const uint32_t v_id,
+                                 const uint16_t *owner, uint16_t part) {
   uint64_t start;
-  Del_deleted[Del_num_deleted++] = tet;
+  w.deleted[w.num_deleted++] = tet;
   tet_subdet[tet + 3] = -1.0;
 
-  for (start = Del_num_deleted - 1; start < Del_num_deleted; start++) {
-    uint64_t tet = Del_deleted[start];
+  for (start = w.num_deleted - 1; start < w.num_deleted; start++) {
+    uint64_t tet = w.deleted[start];
     uint64_t *Neigh = tet_neigh + tet;
     uint32_t *Node = tet_node + tet;
 
-    if (Del_num_tmp + 4 > Del_size_tmp) {
-      Del_tmp = (DelTmp *)realloc(Del_tmp, 2 * Del_num_tmp * sizeof(Del_tmp[0]));
-      Del_size_tmp = 2 * Del_num_tmp;
+    if (w.num_tmp + 4 > w.size_tmp) {
+      w.tmp = (DelTmp *)realloc(w.tmp, 2 * w.num_tmp * sizeof(w.tmp[0]));
+      w.size_tmp = 2 * w.num_tmp;
     }
 
-    if (Del_num_deleted + 4 > Del_size_deleted) {
-      Del_deleted = (uint64_t *)realloc(Del_deleted,
-                                        2 * Del_num_deleted * sizeof(uint64_t));
-      Del_size_deleted = 2 * Del_num_deleted;
+    if (w.num_deleted + 4 > w.size_deleted) {
+      w.deleted =
+          (uint64_t *)realloc(w.deleted, 2 * w.num_deleted * sizeof(uint64_t));
+      w.size_deleted = 2 * w.num_deleted;
     }
 
     uint64_t neigh = getIthNeighbor(Neigh, 0);
     if (tet_subdet[neigh + 3] != -1.0) {
       if (vertexInTetSphere(neigh, v_id) < 0.0) {
-        bnd_push(v_id, Node[1], Node[2], Node[3], Neigh[0]);
+        bnd_push(w, v_id, Node[1], Node[2], Node[3], Neigh[0]);
       } else {
-        Del_deleted[Del_num_deleted++] = neigh;
+        if (owner != NULL && !ownedTet(neigh, owner, part))
+          return false;
+        w.deleted[w.num_deleted++] = neigh;
         tet_subdet[neigh + 3] = -1.0;
       }
     }
@@ -334,9 +355,11 @@ void TetMesh::deleteInSphereTets(uint64_t tet, const uint32_t v_id) {
     neigh = getIthNeighbor(Neigh, 1);
     if (tet_subdet[neigh + 3] != -1.0) {
       if (vertexInTetSphere(neigh, v_id) < 0.0) {
-        bnd_push(v_id, Node[2], Node[0], Node[3], Neigh[1]);
+        bnd_push(w, v_id, Node[2], Node[0], Node[3], Neigh[1]);
       } else {
-        Del_deleted[Del_num_deleted++] = neigh;
+        if (owner != NULL && !ownedTet(neigh, owner, part))
+          return false;
+        w.deleted[w.num_deleted++] = neigh;
         tet_subdet[neigh + 3] = -1.0;
       }
     }
@@ -344,9 +367,11 @@ void TetMesh::deleteInSphereTets(uint64_t tet, const uint32_t v_id) {
     neigh = getIthNeighbor(Neigh, 2);
     if (tet_subdet[neigh + 3] != -1.0) {
       if (vertexInTetSphere(neigh, v_id) < 0.0) {
-        bnd_push(v_id, Node[0], Node[1], Node[3], Neigh[2]);
+        bnd_push(w, v_id, Node[0], Node[1], Node[3], Neigh[2]);
       } else {
-        Del_deleted[Del_num_deleted++] = neigh;
+        if (owner != NULL && !ownedTet(neigh, owner, part))
+          return false;
+        w.deleted[w.num_deleted++] = neigh;
         tet_subdet[neigh + 3] = -1.0;
       }
     }
@@ -355,33 +380,37 @@ void TetMesh::deleteInSphereTets(uint64_t tet, const uint32_t v_id) {
     if (tet_subdet[neigh + 3] != -1.0) {
       if (vertexInTetSphere(neigh, v_id) < 0.0) {
         if (Node[1] < Node[2])
-          bnd_push(v_id, Node[0], Node[2], Node[1], Neigh[3]);
+          bnd_push(w, v_id, Node[0], Node[2], Node[1], Neigh[3]);
         else
-          bnd_push(v_id, Node[1], Node[0], Node[2], Neigh[3]);
+          bnd_push(w, v_id, Node[1], Node[0], Node[2], Neigh[3]);
       } else {
-        Del_deleted[Del_num_deleted++] = neigh;
+        if (owner != NULL && !ownedTet(neigh, owner, part))
+          return false;
+        w.deleted[w.num_deleted++] = neigh;
         tet_subdet[neigh + 3] = -1.0;
       }
     }
   }
+
+  return true;
 }
 
-void TetMesh::tetrahedrizeHole(uint64_t *tet) {
-  uint64_t clength = Del_num_deleted;
-  uint64_t blength = Del_num_tmp;
+void TetMesh::tetrahedrizeHole(DelWork &w, uint64_t *tet) {
+  uint64_t clength = w.num_deleted;
+  uint64_t blength = w.num_tmp;
 
   if (blength > clength) {
-    if (blength > Del_size_deleted) {
-      Del_deleted =
-          (uint64_t *)realloc(Del_deleted, 2 * blength * sizeof(uint64_t));
-      Del_size_deleted = 2 * blength;
+    if (blength > w.size_deleted) {
+      w.deleted = (uint64_t *)realloc(w.deleted, 2 * blength * sizeof(uint64_t));
+      w.size_deleted = 2 * blength;
     }
 
     uint64_t i;
-    for (i = clength; i < blength; i++) {
-      Del_deleted[i] = tet_num << 2;
-      tet_num++;
-    }
+    for (i = clength; i < blength; i++)
+      if (w.fresh_end)
+        w.deleted[i] = (w.fresh_begin++) << 2;
+      else
+        w.deleted[i] = (tet_num++) << 2;
 
     clength = blength;
 
@@ -392,18 +421,18 @@ void TetMesh::tetrahedrizeHole(uint64_t *tet) {
   uint64_t start = clength - blength;
 
   for (uint64_t i = 0; i < blength; i++) {
-    const uint64_t tet = Del_deleted[i + start];
+    const uint64_t tet = w.deleted[i + start];
     uint32_t *Node = tet_node + tet;
 
-    Node[0] = Del_tmp[i].node[0];
-    Node[1] = Del_tmp[i].node[1];
-    Node[2] = Del_tmp[i].node[2];
-    Node[3] = Del_tmp[i].node[3];
+    Node[0] = w.tmp[i].node[0];
+    Node[1] = w.tmp[i].node[1];
+    Node[2] = w.tmp[i].node[2];
+    Node[3] = w.tmp[i].node[3];
 
-    uint64_t bnd = Del_tmp[i].bnd;
+    uint64_t bnd = w.tmp[i].bnd;
     tet_neigh[tet] = bnd;
     tet_neigh[bnd] = tet;
-    Del_tmp[i].bnd = tet;
+    w.tmp[i].bnd = tet;
 
     compute_subDet(tet);
 
@@ -417,12 +446,12 @@ void TetMesh::tetrahedrizeHole(uint64_t *tet) {
   uint64_t tlength = 0;
   const uint64_t middle = blength * 3 / 2;
 
-  uint64_t *Tmp = (uint64_t *)Del_tmp;
+  uint64_t *Tmp = (uint64_t *)w.tmp;
   const unsigned index[4] = {2, 3, 1, 2};
 
   uint64_t i;
   for (i = 0; i < blength; i++) {
-    uint64_t tet = Del_deleted[start + i];
+    uint64_t tet = w.deleted[start + i];
     const uint32_t *const Node = tet_node + tet;
 
     uint64_t j;
@@ -453,10 +482,10 @@ void TetMesh::tetrahedrizeHole(uint64_t *tet) {
     }
   }
 
-  Del_num_tmp = 0;
-  Del_num_deleted = start;
+  w.num_tmp = 0;
+  w.num_deleted = start;
 
-  *tet = Del_deleted[start];
+  *tet = w.deleted[start];
 }
 
 void TetMesh::compute_subDet(const uint64_t tet) {
@@ -515,61 +544,6 @@ void TetMesh::compute_subDet(const uint64_t tet) {
 // incident tetrahedra in a vertex
 //---------------------------------
 
-// - Recursive function -
-//  Input: tetrahedra (tet) index: tet_ind,
-//         the index of the vertex in which incidences are searched:
-//         central_vertex_ind, pointer to mesh, pointer to a tetraheron index
-//         type: tot_incTet.
-// Output: by using tot_incTet increments of one unity the number of incident
-// tetrahedra each
-//         time one of tetrahedra sharing a face with tet
-//         - is INCIDENT in central_vertex_ind,
-//         - is NOT a GHOST TETRHEDRON,
-//         - is NOT been already VISITED (mark_tetrahedra=0).
-//         If tot_incTet is incremented the relative tetrahedra is passed to
-//         this function...
-void count_incTet(uint64_t tet_ind, const uint32_t central_vertex_ind,
-                  TetMesh *mesh, uint64_t *tot_incTet) { // Mod.1
-  for (uint32_t i = 0; i < 4; i++) {
-    if (mesh->tet_node[4 * tet_ind + i] != central_vertex_ind) {
-      uint64_t neigh_tet_ind = mesh->tet_neigh[4 * tet_ind + i] >> 2;
-      // ghost vertex is always in the last slot of the tetrahedron vertices.
-
-      if (mesh->mark_tetrahedra[neigh_tet_ind] == 1 ||
-          mesh->tet_node[4 * neigh_tet_ind + 3] == UINT32_MAX)
-        continue;
-
-      mesh->mark_tetrahedra[neigh_tet_ind] = 1;
-      (*tot_incTet)++;
-      count_incTet(neigh_tet_ind, central_vertex_ind, mesh, tot_incTet);
-    }
-  }
-}
-
-// - Recursive function -
-//  Input: tetrahedra (tet) index: tet_ind,
-//         pointer to mesh,
-//         pointer to a tetraheron index type: incTet,
-//         pointer to a tetraheron index type: pos.
-// Output: by using incTet returns the indices of the tetrahedra icident in a
-// common vertex,
-//         those tetrahedra have been counted by the function count_incTet and
-//         marked as 1. Face neighbour of tet is added to incTet if its marker
-//         is equal to 1. pos stores the number of elements of incTet.
-void save_incTet(uint64_t tet_ind, TetMesh *mesh, uint64_t *incTet,
-                 uint64_t *pos) { // Mod.1
-  for (uint32_t i = 0; i < 4; i++) {
-    if (mesh->mark_tetrahedra[mesh->tet_neigh[4 * tet_ind + i] >> 2] == 1) {
-      (*pos)++;
-      uint64_t neigh_tet_ind = mesh->tet_neigh[4 * tet_ind + i] >> 2;
-      incTet[*pos] = neigh_tet_ind;
-      mesh->mark_tetrahedra[neigh_tet_ind] = 0;
-
-      save_incTet(neigh_tet_ind, mesh, incTet, pos);
-    }
-  }
-}
-
 //  Input: the index of the vertex in which incidences are searched:
 //  central_vertex_ind,
 //         pointer to mesh,
@@ -581,19 +555,45 @@ void save_incTet(uint64_t tet_ind, TetMesh *mesh, uint64_t *incTet,
 uint64_t *TetMesh::incident_tetrahedra(const uint32_t central_vertex_ind,
                                        uint64_t *num_incTet) // Mod.1
 {
+  return incident_tetrahedra(central_vertex_ind, num_incTet, mark_tetrahedra);
+}
+
+// Incident tetrahedra are found by a breadth-first visit that uses the
+// output array as its queue: a tetrahedron is marked when it is added to
+// the array, so that each one is visited once.
+uint64_t *TetMesh::incident_tetrahedra(const uint32_t central_vertex_ind,
+                                       uint64_t *num_incTet,
+                                       uint32_t *marks) const {
   uint64_t tet_ind = vertices[central_vertex_ind].inc_tet;
 
-  // count the number of incident tetrahedra
+  uint64_t size_incTet = 32;
+  uint64_t *incTet = (uint64_t *)malloc(sizeof(uint64_t) * size_incTet);
   uint64_t l_incTet = 1;
-  mark_tetrahedra[tet_ind] = 1;
-  count_incTet(tet_ind, central_vertex_ind, this, &l_incTet);
-
-  // collect the indices of incident tetrahedra
-  uint64_t *incTet = (uint64_t *)malloc(sizeof(uint64_t) * l_incTet);
   incTet[0] = tet_ind;
-  mark_tetrahedra[tet_ind] = 0;
-  uint64_t pos = 0;
-  save_incTet(tet_ind, this, incTet, &pos);
+  marks[tet_ind] = 1;
+
+  for (uint64_t q = 0; q < l_incTet; q++) {
+    const uint64_t tet = incTet[q];
+    for (uint32_t i = 0; i < 4; i++) {
+      if (tet_node[4 * tet + i] == central_vertex_ind)
+        continue;
+      const uint64_t neigh_tet_ind = tet_neigh[4 * tet + i] >> 2;
+      // ghost vertex is always in the last slot of the tetrahedron vertices.
+      if (marks[neigh_tet_ind] == 1 ||
+          tet_node[4 * neigh_tet_ind + 3] == UINT32_MAX)
+        continue;
+
+      if (l_incTet == size_incTet) {
+        size_incTet *= 2;
+        incTet = (uint64_t *)realloc(incTet, sizeof(uint64_t) * size_incTet);
+      }
+      marks[neigh_tet_ind] = 1;
+      incTet[l_incTet++] = neigh_tet_ind;
+    }
+  }
+
+  for (uint64_t i = 0; i < l_incTet; i++)
+    marks[incTet[i]] = 0;
 
   *num_incTet = l_incTet;
   return incTet;
@@ -695,40 +695,561 @@ uint64_t *TetMesh::ETrelation(const uint32_t *edge_ends,
   return related_tet;
 }
 
-void TetMesh::allocTmpStruct(uint32_t num_vertices) {
-  Del_tmp = (DelTmp *)malloc(Del_size_tmp * sizeof(Del_tmp[0]));
-  Del_deleted = (uint64_t *)malloc(Del_size_deleted * sizeof(uint64_t));
-  Del_buffer = (uint32_t *)malloc((num_vertices + 1) * sizeof(uint64_t));
+static inline uint32_t fast_hash(uint32_t x) {
+  x = ((x >> 16) ^ x) * 0x45d9f3b;
+  x = ((x >> 16) ^ x) * 0x45d9f3b;
+  x = (x >> 16) ^ x;
+  return x;
 }
 
-void TetMesh::releaseTmpStruct() {
-  free(Del_buffer);
-  free(Del_deleted);
-  free(Del_tmp);
+// Position along a 3D Hilbert curve of the grid point X[0..2], whose
+// coordinates have 'bits' bits each (Skilling's transpose algorithm).
+static uint64_t hilbert_key(uint32_t X[3], int bits) {
+  const uint32_t M = 1u << (bits - 1);
+  for (uint32_t Q = M; Q > 1; Q >>= 1) {
+    const uint32_t P = Q - 1;
+    for (int i = 0; i < 3; i++)
+      if (X[i] & Q)
+        X[0] ^= P;
+      else {
+        const uint32_t t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+  }
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+  uint32_t t = 0;
+  for (uint32_t Q = M; Q > 1; Q >>= 1)
+    if (X[2] & Q)
+      t ^= Q - 1;
+  X[0] ^= t;
+  X[1] ^= t;
+  X[2] ^= t;
+
+  uint64_t key = 0;
+  for (int b = bits - 1; b >= 0; b--)
+    for (int i = 0; i < 3; i++)
+      key = (key << 1) | ((X[i] >> b) & 1);
+  return key;
 }
 
-void TetMesh::tetrahedrize() {
-  init();
-  allocTmpStruct(num_vertices);
+// LSD radix sort of (key[i], id[i]) pairs by the lowest nbits of key.
+// tkey and tid are buffers of the same size. Result is in key and id.
+static void radix_sort_keys(uint64_t *key, uint32_t *id, uint64_t *tkey,
+                            uint32_t *tid, uint32_t n, int nbits) {
+  uint32_t h[2048];
+  int npass = (nbits + 10) / 11;
+  for (int pass = 0; pass < npass; pass++) {
+    const int shift = 11 * pass;
+    memset(h, 0, sizeof(h));
+    for (uint32_t i = 0; i < n; i++)
+      h[(key[i] >> shift) & 2047]++;
+    uint32_t sum = 0;
+    for (int i = 0; i < 2048; i++) {
+      const uint32_t c = h[i];
+      h[i] = sum;
+      sum += c;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      const uint32_t d = h[(key[i] >> shift) & 2047]++;
+      tkey[d] = key[i];
+      tid[d] = id[i];
+    }
+    std::swap(key, tkey);
+    std::swap(id, tid);
+  }
+  if (npass & 1) { // Result is in the buffers
+    memcpy(tkey, key, n * sizeof(uint64_t));
+    memcpy(tid, id, n * sizeof(uint32_t));
+  }
+}
 
-  uint64_t ct = 0;
-  for (uint32_t i = 4; i < num_vertices; i++) {
-    ct = searchTetrahedron(ct, i);
+// Output: bounding box of n vertices
+void vertices_bbox(const vertex_t *vertices, uint32_t n, double *bmin,
+                          double *bmax) {
+  for (int j = 0; j < 3; j++)
+    bmin[j] = bmax[j] = vertices[0].coord[j];
+  for (uint32_t i = 1; i < n; i++)
+    for (int j = 0; j < 3; j++) {
+      const double c = vertices[i].coord[j];
+      if (c < bmin[j])
+        bmin[j] = c;
+      if (c > bmax[j])
+        bmax[j] = c;
+    }
+}
+
+//  Input: vertices from begin to end-1, box [bmin, bmax]
+// Output: key[i] = position of vertices[i] along a Hilbert curve that
+//         visits a grid with 2^HILBERT_BITS cells per axis covering the box
+#define HILBERT_BITS 21
+void vertices_hilbert_keys(const vertex_t *vertices, uint32_t begin,
+                           uint32_t end, const double *bmin, const double *bmax,
+                           uint64_t *key) {
+  const double grid_max = (double)((1u << HILBERT_BITS) - 1);
+  double scale[3];
+  for (int j = 0; j < 3; j++)
+    scale[j] = (bmax[j] > bmin[j]) ? (grid_max / (bmax[j] - bmin[j])) : (0.0);
+  for (uint32_t i = begin; i < end; i++) {
+    const double *c = vertices[i].coord;
+    uint32_t X[3];
+    for (int j = 0; j < 3; j++) {
+      const double g = (c[j] - bmin[j]) * scale[j];
+      X[j] = (g >= grid_max) ? ((uint32_t)grid_max) : ((uint32_t)g);
+    }
+    key[i] = hilbert_key(X, HILBERT_BITS);
+  }
+}
 
-    deleteInSphereTets(ct, i);
-    tetrahedrizeHole(&ct);
+void TetMesh::spatialSort() {
+  const uint32_t n = num_vertices;
+  if (n < 2)
+    return;
 
-    uint64_t Tet2update = ct;
-    if (tet_node[Tet2update + 3] == UINT32_MAX)
-      Tet2update = tet_neigh[Tet2update + 3];
+  uint64_t *key = (uint64_t *)malloc(n * sizeof(uint64_t) * 3);
+  uint32_t *id = (uint32_t *)malloc(n * sizeof(uint32_t) * 2);
+  uint64_t *tkey = key + n;
+  uint64_t *hkey = key + 2 * n;
+  uint32_t *tid = id + n;
 
-    vertices[i].inc_tet = Tet2update >> 2;
+  double bmin[3], bmax[3];
+  vertices_bbox(vertices, n, bmin, bmax);
+  vertices_hilbert_keys(vertices, 0, n, bmin, bmax, hkey);
+
+  // Shuffle (first two passes of the hashed index are enough)
+  for (uint32_t i = 0; i < n; i++) {
+    key[i] = fast_hash(i);
+    id[i] = i;
+  }
+  radix_sort_keys(key, id, tkey, tid, n, 22);
+
+  for (uint32_t i = 0; i < n; i++)
+    key[i] = hkey[id[i]];
+
+  // Rounds: each round is about 7.5 times larger than the previous one
+  // (roughly the ratio between tetrahedra and vertices).
+  uint32_t end = n;
+  while (end > 1500) {
+    const uint32_t start = (uint32_t)(end / 7.5);
+    radix_sort_keys(key + start, id + start, tkey, tid, end - start,
+                    3 * HILBERT_BITS);
+    end = start;
+  }
+
+  vertex_t *sorted = (vertex_t *)malloc(n * sizeof(vertex_t));
+  for (uint32_t i = 0; i < n; i++)
+    sorted[i] = vertices[id[i]];
+  free(vertices);
+  vertices = sorted;
+
+  free(key);
+  free(id);
+}
+
+void TetMesh::allocTmpStruct(DelWork &w) {
+  w.size_tmp = 1024;
+  w.num_tmp = 0;
+  w.tmp = (DelTmp *)malloc(w.size_tmp * sizeof(w.tmp[0]));
+  w.size_deleted = 1024;
+  w.num_deleted = 0;
+  w.deleted = (uint64_t *)malloc(w.size_deleted * sizeof(uint64_t));
+  w.fresh_begin = w.fresh_end = 0;
+}
+
+void TetMesh::releaseTmpStruct(DelWork &w) {
+  free(w.deleted);
+  free(w.tmp);
+}
+
+void TetMesh::insertVertex(DelWork &w, uint64_t *tet, const uint32_t v_id) {
+  uint64_t ct = searchTetrahedron(*tet, v_id);
+
+  deleteInSphereTets(w, ct, v_id);
+  tetrahedrizeHole(w, &ct);
+
+  uint64_t Tet2update = ct;
+  if (tet_node[Tet2update + 3] == UINT32_MAX)
+    Tet2update = tet_neigh[Tet2update + 3];
+
+  vertices[v_id].inc_tet = Tet2update >> 2;
+  *tet = ct;
+}
+
+// Parameters of the parallel insertion
+#define PAR_MIN_VERTICES_PER_THREAD 4096 // Smaller parts are not worth a thread
+#define PAR_FIRST_VERTICES 8192 // Inserted before going parallel (at least)
+#define PAR_FIRST_VERTICES_PER_THREAD 1024 // (and per thread)
+#define PAR_TETS_PER_VERTEX 8 // Unused tets reserved to a thread per vertex
+
+uint64_t TetMesh::nearTetrahedron(const uint32_t v, const uint16_t *owner,
+                                  uint16_t part, const uint8_t *done,
+                                  const uint32_t *sid,
+                                  const uint32_t *rank) const {
+  const uint64_t r = rank[v];
+  for (uint64_t d = 1; d <= 32; d++) {
+    for (int side = 0; side < 2; side++) {
+      if ((side == 0 && r < d) || (side == 1 && r + d >= num_vertices))
+        continue;
+      const uint32_t u = sid[(side == 0) ? (r - d) : (r + d)];
+      if (owner[u] != part || !done[u])
+        continue;
+      const uint64_t tet = vertices[u].inc_tet << 2;
+      if (ownedTet(tet, owner, part))
+        return tet;
+    }
+  }
+  return UINT64_MAX;
+}
+
+void TetMesh::parallelInsertion(DelWork &w, uint64_t *tet, uint32_t first,
+                                uint32_t num_threads,
+                                std::vector<uint32_t> &pending) {
+  // At each round a Hilbert curve is split into parts, one per thread. Each
+  // thread inserts the vertices of its part. Insertions that need to visit
+  // or modify a tetrahedron having a vertex outside the part are postponed
+  // to the next round, where the curve is moved so that parts have
+  // different boundaries.
+  // Two threads never access the same tetrahedron, except for neighbors
+  // of a cavity, whose only modified field is the neighbor slot facing the
+  // cavity. Since the result of each insertion does not depend on timing,
+  // neither does the final tetrahedrization.
+  const uint32_t n = num_vertices;
+  if (num_threads > UINT16_MAX)
+    num_threads = UINT16_MAX;
+
+  // Vertices along the curve (sid), position of each vertex (rank),
+  // vertices already inserted (done) and part of each vertex (owner)
+  std::vector<uint64_t> key(n), tkey(n);
+  std::vector<uint32_t> sid(n), rank(n), tid(n);
+  std::vector<uint8_t> done(n, 0);
+  std::vector<uint16_t> owner(n);
+  memset(done.data(), 1, first);
+
+  double bmin[3], bmax[3];
+  vertices_bbox(vertices, n, bmin, bmax);
+
+  std::vector<DelWork> work(num_threads);
+  for (uint32_t t = 0; t < num_threads; t++)
+    allocTmpStruct(work[t]);
+  std::vector<std::vector<uint32_t>> todo(num_threads), postponed(num_threads);
+  std::vector<uint64_t> last_tet(num_threads);
+  std::vector<uint64_t> num_fresh(num_threads);
+
+  // Each round inserts the vertices before limit. As in spatialSort, the
+  // next BRIO round is added when the previous one is (almost) done, so
+  // that the mesh is refined evenly.
+  std::vector<uint32_t> brio_end;
+  for (uint32_t end = n; end > first; end = (uint32_t)(end / 7.5))
+    brio_end.push_back(end);
+  uint32_t limit = first;
+  uint64_t m = 0; // Vertices to be inserted in this round
+  for (uint32_t round = 0;; round++) {
+    while (m < 2 * PAR_MIN_VERTICES_PER_THREAD && limit < n) {
+      const uint32_t next = brio_end.back();
+      brio_end.pop_back();
+      m += next - limit;
+      limit = next;
+    }
+    uint32_t nt = (uint32_t)(m / PAR_MIN_VERTICES_PER_THREAD);
+    if (nt > num_threads)
+      nt = num_threads;
+    if (nt < 2)
+      break;
+
+    // The curve visits a grid twice as large as the bounding box, whose
+    // position changes at each round (quasi-random offsets)
+    const double alpha[3] = {0.8191725134, 0.6710436067, 0.5497004779};
+    double lo[3], hi[3];
+    for (int j = 0; j < 3; j++) {
+      const double ext = bmax[j] - bmin[j];
+      lo[j] = bmin[j] - ext * fmod(round * alpha[j], 1.0);
+      hi[j] = lo[j] + 2 * ext;
+    }
+    parallel_run(nt, [&](uint32_t t) {
+      const uint32_t b = (uint32_t)(((uint64_t)n * t) / nt);
+      const uint32_t e = (uint32_t)(((uint64_t)n * (t + 1)) / nt);
+      vertices_hilbert_keys(vertices, b, e, lo, hi, key.data());
+      for (uint32_t v = b; v < e; v++)
+        sid[v] = v;
+    });
+    radix_sort_keys(key.data(), sid.data(), tkey.data(), tid.data(), n,
+                    3 * HILBERT_BITS);
+
+    // Parts are consecutive pieces of the curve with the same number of
+    // vertices
+    parallel_run(nt, [&](uint32_t t) {
+      const uint32_t b = (uint32_t)(((uint64_t)n * t) / nt);
+      const uint32_t e = (uint32_t)(((uint64_t)n * (t + 1)) / nt);
+      for (uint32_t i = b; i < e; i++) {
+        rank[sid[i]] = i;
+        owner[sid[i]] = (uint16_t)t;
+      }
+    });
+
+    for (uint32_t t = 0; t < nt; t++)
+      todo[t].clear();
+    for (uint32_t i = 0; i < n; i++)
+      if (sid[i] < limit && !done[sid[i]])
+        todo[owner[sid[i]]].push_back(sid[i]);
+
+    // Reserve unused tetrahedra for each thread (on top of the deleted ones
+    // it can reuse)
+    uint64_t tot_fresh = 0;
+    for (uint32_t t = 0; t < nt; t++) {
+      num_fresh[t] = PAR_TETS_PER_VERTEX * todo[t].size() + 64;
+      num_fresh[t] -= std::min(num_fresh[t], work[t].num_deleted);
+      tot_fresh += num_fresh[t];
+    }
+    if (tet_num + tot_fresh > tet_size)
+      reserve((uint32_t)(tot_fresh + tet_num / 4));
+    for (uint32_t t = 0; t < nt; t++) {
+      work[t].fresh_begin = tet_num;
+      tet_num += num_fresh[t];
+      work[t].fresh_end = tet_num;
+    }
+
+    parallel_run(nt, [&](uint32_t t) {
+      const uint16_t *own = owner.data();
+      DelWork &tw = work[t];
+      postponed[t].clear();
+      uint64_t ct = UINT64_MAX;
+      for (uint32_t v : todo[t]) {
+        // Start from a vertex inserted next to v along the curve, if any
+        const uint64_t st = nearTetrahedron(v, own, (uint16_t)t, done.data(),
+                                            sid.data(), rank.data());
+        if (st != UINT64_MAX)
+          ct = st;
+
+        const uint64_t first_deleted = tw.num_deleted;
+        uint64_t vt = UINT64_MAX;
+        bool ok = false;
+        if (ct != UINT64_MAX) {
+          vt = searchTetrahedron(ct, v, own, (uint16_t)t);
+          ok = (vt != UINT64_MAX) &&
+               deleteInSphereTets(tw, vt, v, own, (uint16_t)t);
+        }
+        if (ok && tw.num_tmp > tw.num_deleted &&
+            tw.num_tmp - tw.num_deleted > tw.fresh_end - tw.fresh_begin)
+          ok = false;
+
+        if (!ok) { // Undo the cavity
+          for (uint64_t i = first_deleted; i < tw.num_deleted; i++)
+            compute_subDet(tw.deleted[i]);
+          tw.num_deleted = first_deleted;
+          tw.num_tmp = 0;
+          postponed[t].push_back(v);
+          continue;
+        }
+        tetrahedrizeHole(tw, &vt);
+
+        uint64_t Tet2update = vt;
+        if (tet_node[Tet2update + 3] == UINT32_MAX)
+          Tet2update = tet_neigh[Tet2update + 3];
+        vertices[v].inc_tet = Tet2update >> 2;
+        done[v] = 1;
+        ct = vt;
+      }
+      last_tet[t] = ct;
+    });
+
+    // Unused tetrahedra become deleted ones
+    for (uint32_t t = 0; t < nt; t++) {
+      DelWork &tw = work[t];
+      const uint64_t num_unused = tw.fresh_end - tw.fresh_begin;
+      if (tw.num_deleted + num_unused > tw.size_deleted) {
+        tw.size_deleted = 2 * (tw.num_deleted + num_unused);
+        tw.deleted = (uint64_t *)realloc(tw.deleted,
+                                         tw.size_deleted * sizeof(uint64_t));
+      }
+      for (uint64_t i = tw.fresh_begin; i < tw.fresh_end; i++) {
+        tet_subdet[4 * i + 3] = -1.0;
+        tw.deleted[tw.num_deleted++] = 4 * i;
+      }
+      tw.fresh_begin = tw.fresh_end = 0;
+      if (last_tet[t] != UINT64_MAX)
+        *tet = last_tet[t];
+    }
+
+    uint64_t num_postponed = 0;
+    for (uint32_t t = 0; t < nt; t++)
+      num_postponed += postponed[t].size();
+
+    // Too many conflicts: use fewer (i.e. larger) parts
+    if (num_postponed > (3 * m) / 4)
+      num_threads = nt / 2;
+    m = num_postponed;
+  }
+
+  // Vertices left, in insertion order
+  pending.clear();
+  for (uint32_t v = first; v < n; v++)
+    if (!done[v])
+      pending.push_back(v);
+
+  // Deleted tetrahedra go back to the sequential workspace
+  for (uint32_t t = 0; t < work.size(); t++) {
+    DelWork &tw = work[t];
+    if (w.num_deleted + tw.num_deleted > w.size_deleted) {
+      w.size_deleted = 2 * (w.num_deleted + tw.num_deleted);
+      w.deleted =
+          (uint64_t *)realloc(w.deleted, w.size_deleted * sizeof(uint64_t));
+    }
+    memcpy(w.deleted + w.num_deleted, tw.deleted,
+           tw.num_deleted * sizeof(uint64_t));
+    w.num_deleted += tw.num_deleted;
+    releaseTmpStruct(tw);
+  }
+}
+
+// The 12 even permutations of the vertices of a tetrahedron (i.e. those
+// that keep its orientation). Vertex i of the permuted tet is vertex
+// even_perm[p][i] of the original one. The first three keep the ghost
+// vertex in the last position.
+static const uint8_t even_perm[12][4] = {
+    {0, 1, 2, 3}, {1, 2, 0, 3}, {2, 0, 1, 3}, {0, 2, 3, 1},
+    {0, 3, 1, 2}, {1, 0, 3, 2}, {1, 3, 2, 0}, {2, 1, 3, 0},
+    {2, 3, 0, 1}, {3, 0, 2, 1}, {3, 1, 0, 2}, {3, 2, 1, 0}};
+
+static inline bool lex_less(const uint32_t *a, const uint32_t *b) {
+  for (int i = 0; i < 4; i++)
+    if (a[i] != b[i])
+      return a[i] < b[i];
+  return false;
+}
+
+void TetMesh::sortTetrahedra(uint32_t num_threads) {
+  const uint64_t nt = tet_num;
+  if (nt < (1 << 16))
+    num_threads = 1;
+
+  uint8_t inv_perm[12][4];
+  for (int p = 0; p < 12; p++)
+    for (int i = 0; i < 4; i++)
+      inv_perm[p][even_perm[p][i]] = (uint8_t)i;
+
+  // Canonical vertex order: lexicographically smallest even permutation
+  // (with the ghost vertex in the last position).
+  uint8_t *perm = (uint8_t *)malloc(nt * sizeof(uint8_t));
+  uint32_t *node = (uint32_t *)malloc(4 * nt * sizeof(uint32_t));
+  parallel_run(num_threads, [&](uint32_t t) {
+    const uint64_t b = (nt * t) / num_threads, e = (nt * (t + 1)) / num_threads;
+    for (uint64_t i = b; i < e; i++) {
+      const uint32_t *tn = tet_node + 4 * i;
+      const int np = (tn[3] == UINT32_MAX) ? 3 : 12;
+      uint32_t best[4], cand[4];
+      uint8_t best_p = 0;
+      for (int j = 0; j < 4; j++)
+        best[j] = tn[j];
+      for (int p = 1; p < np; p++) {
+        for (int j = 0; j < 4; j++)
+          cand[j] = tn[even_perm[p][j]];
+        if (lex_less(cand, best)) {
+          memcpy(best, cand, sizeof(best));
+          best_p = (uint8_t)p;
+        }
+      }
+      perm[i] = best_p;
+      memcpy(node + 4 * i, best, sizeof(best));
+    }
+  });
+
+  // Tetrahedra sorted by their canonical vertices: bucket by first vertex
+  uint64_t *bucket = (uint64_t *)calloc(num_vertices + 1, sizeof(uint64_t));
+  for (uint64_t i = 0; i < nt; i++)
+    bucket[node[4 * i] + 1]++;
+  for (uint32_t v = 0; v < num_vertices; v++)
+    bucket[v + 1] += bucket[v];
+  uint64_t *order = (uint64_t *)malloc(nt * sizeof(uint64_t)); // new -> old
+  for (uint64_t i = 0; i < nt; i++)
+    order[bucket[node[4 * i]]++] = i;
+  for (uint32_t v = num_vertices; v > 0; v--)
+    bucket[v] = bucket[v - 1];
+  bucket[0] = 0;
+  parallel_run(num_threads, [&](uint32_t t) {
+    const uint32_t b = (uint32_t)(((uint64_t)num_vertices * t) / num_threads);
+    const uint32_t e =
+        (uint32_t)(((uint64_t)num_vertices * (t + 1)) / num_threads);
+    for (uint32_t v = b; v < e; v++)
+      std::sort(order + bucket[v], order + bucket[v + 1],
+                [&](uint64_t x, uint64_t y) {
+                  return lex_less(node + 4 * x, node + 4 * y);
+                });
+  });
+  free(bucket);
+
+  uint64_t *new_index = (uint64_t *)malloc(nt * sizeof(uint64_t));
+  for (uint64_t i = 0; i < nt; i++)
+    new_index[order[i]] = i;
+
+  uint64_t *neigh = (uint64_t *)malloc(4 * nt * sizeof(uint64_t));
+  parallel_run(num_threads, [&](uint32_t t) {
+    const uint64_t b = (nt * t) / num_threads, e = (nt * (t + 1)) / num_threads;
+    for (uint64_t i = b; i < e; i++) {
+      const uint64_t o = order[i];
+      for (int j = 0; j < 4; j++) {
+        const uint64_t nb = tet_neigh[4 * o + even_perm[perm[o]][j]];
+        const uint64_t nb_tet = nb >> 2;
+        neigh[4 * i + j] =
+            4 * new_index[nb_tet] + inv_perm[perm[nb_tet]][nb & 3];
+      }
+    }
+  });
+  free(tet_neigh);
+  tet_neigh = neigh;
+
+  parallel_run(num_threads, [&](uint32_t t) {
+    const uint64_t b = (nt * t) / num_threads, e = (nt * (t + 1)) / num_threads;
+    for (uint64_t i = b; i < e; i++) {
+      memcpy(tet_node + 4 * i, node + 4 * order[i], 4 * sizeof(uint32_t));
+      compute_subDet(4 * i);
+    }
+  });
+
+  // Incident tetrahedron: the first non ghost one
+  for (uint64_t i = nt; i-- > 0;)
+    if (tet_node[4 * i + 3] != UINT32_MAX)
+      for (uint64_t j = 0; j < 4; j++)
+        vertices[tet_node[4 * i + j]].inc_tet = i;
+
+  free(new_index);
+  free(order);
+  free(node);
+  free(perm);
+}
+
+void TetMesh::tetrahedrize(uint32_t num_threads) {
+  TRACE_SPAN("tetrahedrize");
+  spatialSort();
+  init();
+  DelWork w;
+  allocTmpStruct(w);
+
+  uint64_t ct = 0;
+  uint32_t first_parallel = num_vertices;
+  if (num_threads > 1)
+    first_parallel = std::max<uint32_t>(PAR_FIRST_VERTICES,
+                                        PAR_FIRST_VERTICES_PER_THREAD *
+                                            num_threads);
+  if (num_vertices < first_parallel + 2 * PAR_MIN_VERTICES_PER_THREAD)
+    first_parallel = num_vertices;
+
+  for (uint32_t i = 4; i < first_parallel; i++)
+    insertVertex(w, &ct, i);
+
+  if (first_parallel < num_vertices) {
+    std::vector<uint32_t> pending;
+    parallelInsertion(w, &ct, first_parallel, num_threads, pending);
+    for (uint32_t v : pending)
+      insertVertex(w, &ct, v);
   }
 
   tet_num_vertices = num_vertices;
 
-  removeDelTets();
-  releaseTmpStruct();
+  removeDelTets(w);
+  releaseTmpStruct(w);
+
+  sortTetrahedra(num_threads);
 
   mark_tetrahedra =
       (uint32_t *)realloc(mark_tetrahedra, (tet_num) * sizeof(uint32_t));
@@ -8,6 +8,7 @@
 
 #include "implicit_point.h"
 #include <cstring>
+#include <vector>
 
 // Constrained Delaunay Tetrahedrization (CDT)
 
@@ -46,6 +47,16 @@ struct vertex_t {
   uint32_t original_index; // Index to support reordering
 };
 
+// Bounding box [bmin, bmax] of n vertices
+void vertices_bbox(const vertex_t *vertices, uint32_t n, double *bmin,
+                   double *bmax);
+
+// key[i] = position of vertices[i] (begin <= i < end) along a Hilbert curve
+// that visits a fine grid covering the box [bmin, bmax]
+void vertices_hilbert_keys(const vertex_t *vertices, uint32_t begin,
+                           uint32_t end, const double *bmin, const double *bmax,
+                           uint64_t *key);
+
 // Tetrahedral mesh
 class TetMesh {
 public:
@@ -63,13 +74,22 @@ public:
   TetMesh();
   ~TetMesh();
 
-  // Create a Delaunay tetrahedrization by incremental insertion
-  void tetrahedrize();
+  // Create a Delaunay tetrahedrization by incremental insertion.
+  // With num_threads > 1 most of the vertices are inserted by concurrent
+  // threads. The result (including the numbering of tetrahedra) does not
+  // depend on num_threads.
+  void tetrahedrize(uint32_t num_threads = 1);
 
   // Return an array containing incident tetrahedra at a given vertex v.
   // Store the array length in numtets
   uint64_t *incident_tetrahedra(const uint32_t v, uint64_t *numtets);
 
+  // Same as above, but visited tetrahedra are marked in marks instead of
+  // mark_tetrahedra (marks must be zero and are zero on return). Threads
+  // using different marks can call this concurrently.
+  uint64_t *incident_tetrahedra(const uint32_t v, uint64_t *numtets,
+                                uint32_t *marks) const;
+
   // Return an array containing incident tetrahedra at a given edge
   // edge_ends[2]. The first element of the array is first_tet_ind, which is
   // assumed to be incident at the edge. Store the array length in numtets
@@ -87,14 +107,20 @@ protected:
   struct DelTmp {
     uint32_t node[4];
     uint64_t bnd;
-  } * Del_tmp;
-
-  uint64_t Del_num_tmp;
-  uint64_t Del_size_tmp;
-  uint64_t *Del_deleted;
-  uint64_t Del_num_deleted;
-  uint64_t Del_size_deleted;
-  uint32_t *Del_buffer; // xxxx3333
+  };
+
+  // Workspace for vertex insertion. Each thread of the parallel insertion
+  // has its own one.
+  struct DelWork {
+    DelTmp *tmp;           // Faces on the boundary of the cavity
+    uint64_t num_tmp;
+    uint64_t size_tmp;
+    uint64_t *deleted;     // Deleted tets (cavity, then reusable slots)
+    uint64_t num_deleted;
+    uint64_t size_deleted;
+    uint64_t fresh_begin;  // Unused tets [fresh_begin, fresh_end) reserved
+    uint64_t fresh_end;    // to a thread (fresh_end = 0 if sequential)
+  };
 
   // Return the i'th tet adjacent to 't'
   inline uint64_t getNeighbor(const uint64_t t, const uint64_t i) const {
@@ -104,23 +130,63 @@ protected:
   // Init the mesh with a tet connecting four non coplanar points in vertices
   void init();
 
+  // Reorder vertices for insertion: biased randomized insertion order (BRIO)
+  // with Hilbert curve order within each round. Vertex original_index
+  // values follow the permutation.
+  void spatialSort();
+
 
   // Return the i'th tet in neighbors 'n'
   inline uint64_t getIthNeighbor(const uint64_t *n, const uint64_t i) const {
     return n[i] & 0xFFFFFFFFFFFFFFFC;
   }
 
-  void allocTmpStruct(uint32_t num_v);
-  void releaseTmpStruct();
-  void bnd_push(uint32_t vta, uint32_t node1, uint32_t node2, uint32_t node3,
-                uint64_t bnd);
-
-  uint64_t searchTetrahedron(uint64_t tet, const uint32_t v_id);
-  void deleteInSphereTets(uint64_t tet, const uint32_t v_id);
-  void tetrahedrizeHole(uint64_t *tet);
-  void removeDelTets();
+  void allocTmpStruct(DelWork &w);
+  void releaseTmpStruct(DelWork &w);
+  void bnd_push(DelWork &w, uint32_t vta, uint32_t node1, uint32_t node2,
+                uint32_t node3, uint64_t bnd);
+
+  // In parallel insertion (owner != NULL) a thread may only visit and
+  // modify tets whose vertices belong to its part (owner[v] == part).
+  // searchTetrahedron returns UINT64_MAX and deleteInSphereTets returns
+  // false if this is not possible.
+  uint64_t searchTetrahedron(uint64_t tet, const uint32_t v_id,
+                             const uint16_t *owner = NULL, uint16_t part = 0);
+  bool deleteInSphereTets(DelWork &w, uint64_t tet, const uint32_t v_id,
+                          const uint16_t *owner = NULL, uint16_t part = 0);
+  void tetrahedrizeHole(DelWork &w, uint64_t *tet);
+  void removeDelTets(DelWork &w);
   void compute_subDet(const uint64_t tet);
 
+  // Return true if all the (non ghost) vertices of tet belong to part
+  inline bool ownedTet(const uint64_t tet, const uint16_t *owner,
+                       const uint16_t part) const {
+    for (uint64_t i = 0; i < 4; i++)
+      if (tet_node[tet + i] != UINT32_MAX && owner[tet_node[tet + i]] != part)
+        return false;
+    return true;
+  }
+
+  // Insert vertex v_id starting the search from tet
+  void insertVertex(DelWork &w, uint64_t *tet, const uint32_t v_id);
+
+  // Return an owned tetrahedron incident to an inserted vertex close to
+  // v along the Hilbert curve (sid = vertices in curve order, rank =
+  // inverse of sid), or UINT64_MAX.
+  uint64_t nearTetrahedron(const uint32_t v, const uint16_t *owner,
+                           uint16_t part, const uint8_t *done,
+                           const uint32_t *sid, const uint32_t *rank) const;
+
+  // Insert vertices from first to num_vertices-1 with num_threads threads.
+  // Vertices that could not be inserted are returned in pending, and tet
+  // is set to a valid tetrahedron.
+  void parallelInsertion(DelWork &w, uint64_t *tet, uint32_t first,
+                         uint32_t num_threads, std::vector<uint32_t> &pending);
+
+  // Renumber tetrahedra and rotate their vertices in a canonical order that
+  // only depends on the tetrahedrization.
+  void sortTetrahedra(uint32_t num_threads);
+
   double vertexInTetSphere(uint64_t tet, uint32_t v_id);
 
   // Pre-allocate memory to store tetrahedra
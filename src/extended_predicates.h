@@ -2,6 +2,7 @@
 #define extended_predicates_h
 
 #include "implicit_point.h"
+#include "predicate_counters.h"
 #include <stdio.h>
 
 #include "delaunay.h"
@@ -25,13 +26,17 @@ static inline uint32_t same_point(const double *p, const double *q) {
 
 static inline int sign_orient2d(const double *p, const double *q,
                                  const double *r) {
-  return orient2d(p[0], p[1], q[0], q[1], r[0], r[1]);
+  const int o = orient2d(p[0], p[1], q[0], q[1], r[0], r[1]);
+  COUNT_PREDICATE_RESULT(PRED_ORIENT2D, PRED_EXPLICIT, o);
+  return o;
 }
 
 static inline int sign_orient3d(const double *p, const double *q,
                                  const double *r, const double *s) {
-  return orient3d(p[0], p[1], p[2], q[0], q[1], q[2], r[0], r[1], r[2], s[0],
-                  s[1], s[2]);
+  const int o = orient3d(p[0], p[1], p[2], q[0], q[1], q[2], r[0], r[1], r[2],
+                         s[0], s[1], s[2]);
+  COUNT_PREDICATE_RESULT(PRED_ORIENT3D, PRED_EXPLICIT, o);
+  return o;
 }
 
 bool misAlignment(const double *p, const double *q, const double *r);
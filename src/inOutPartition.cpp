@@ -1,4 +1,5 @@
 #include "BSP.h"
+#include "trace.h"
 #include <algorithm>
 #include <fstream>
 #include <iostream>
@@ -32,7 +33,7 @@ bool isFirstConnCellBelowFace(BSPface &f, BSPcomplex *complex) {
   for (uint32_t vi : cell_vrts)
     if (!complex->vrts_visit[vi]) {
       const genericPoint *cv = complex->vertices[vi];
-      const int o = genericPoint::orient3D(*cv, *pv1, *pv2, *pv3);
+      const int o = CountedPredicates::orient3D(*cv, *pv1, *pv2, *pv3);
       if (o) {
         for (uint64_t ei : f.edges)
           complex->vrts_visit[complex->edges[ei].vertices[0]] =
@@ -80,6 +81,7 @@ inline bool isSkinFace(const BSPface &face, uint32_t skin_colour) {
 void BSPcomplex::markInternalCells(uint32_t skin_colour,
                                    uint32_t internal_label,
                                    const std::vector<double> &face_areas) {
+  TRACE_SPAN("mark_internal_cells");
   // Allocate dual graph: num cells + 1 to account for the external "ghost" cell
   GCoptimizationGeneralGraph gc((GCoptimization::SiteID)cells.size() + 1, 2);
 
@@ -171,7 +173,10 @@ void BSPcomplex::markInternalCells(uint32_t skin_colour,
   // Run graph cut algorithm
   // I.e., label all the cells so that the total data cost + smooth cost is
   // minimized
-  gc.swap();
+  {
+    TRACE_SPAN("graph_cut");
+    gc.swap();
+  }
 
   for (size_t i = 0; i < cells.size(); i++)
     if (gc.whatLabel((GCoptimization::SiteID)i))
@@ -179,6 +184,7 @@ void BSPcomplex::markInternalCells(uint32_t skin_colour,
 }
 
 void BSPcomplex::constraintsSurface_complexPartition(bool two_files) {
+  TRACE_SPAN("partition");
   // Make all cells external
   for (size_t i = 0; i < cells.size(); i++)
     cells[i].place = EXTERNAL;
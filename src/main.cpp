@@ -1,114 +1,125 @@
 #include "BSP.h"
+#include "mesh_io.h"
+#include "parallel.h"
+#include "trace.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <string>
 
-void read_OFF_file(const char *filename, double **vertices_p, uint32_t *npts,
-                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose) {
-
-  FILE *file = fopen(filename, "r");
-  if (file == NULL)
-    ip_error("read_nodes_and_constraints: FATAL ERROR "
-             "cannot open input file.\n");
-
-  // Check OFF mark (1st line).
-  char file_ext_read[3];
-  char file_ext_target[] = {'O', 'F', 'F'};
-  if (fscanf(file, "%3c", file_ext_read) == 0)
-    ip_error("read_nodes_and_constraints: FATAL ERROR "
-             "cannot read 1st line of input file\n");
-
-  for (uint32_t i = 0; i < 3; i++)
-    if (file_ext_read[i] != file_ext_target[i])
-      ip_error("read_nodes_and_constraints: FATAL ERROR "
-               "1st line of input file is different from OFF\n");
-
-  // Reading number of points and triangles.
-  if (fscanf(file, " %d %d %*d ", npts, ntri) == 0)
-    ip_error("read_nodes_and_constraints: FATAL ERROR 2st line of "
-             "input file do not contanins point and triangles numbers.\n");
-
-  if (verbose)
-    printf("file %s contains %d vertices and %d constraints (triangles)\n",
-           filename, *npts, *ntri);
-
-  // Reading points coordinates.
-  *vertices_p = (double *)malloc(sizeof(double) * 3 * (*npts));
-  *tri_vertices_p = (uint32_t *)malloc(sizeof(uint32_t) * 3 * (*ntri));
-
-  for (uint32_t i = 0; i < (*npts); i++) {
-    if (fscanf(file, " %lf %lf %lf ", (*vertices_p) + (i * 3),
-               (*vertices_p) + (i * 3 + 1), (*vertices_p) + (i * 3 + 2)) == 0)
-      ip_error("error reading input file\n");
-  }
-
-  uint32_t nv;
-  for (uint32_t i = 0; i < (*ntri); i++) {
-    if (fscanf(file, " %u %u %u %u ", &nv, (*tri_vertices_p) + (i * 3),
-               (*tri_vertices_p) + (i * 3 + 1),
-               (*tri_vertices_p) + (i * 3 + 2)) == 0)
-      ip_error("error reading input file\n");
-    if (nv != 3)
-      ip_error("Non-triangular faces not supported\n");
-  }
-  fclose(file);
-}
-
-/// <summary>
-/// Main function
-/// </summary>
-/// <param name="argc"></param>
-/// <param name="argv"></param>
-/// <returns></returns>
-int main(int argc, char **argv) {
-  if (argc < 2) {
-    printf("\nUsage: mesh_generator [-v | -s | -b | -t] inputfile_A.off "
-           "[bool_opcode inputfile_B.off]\n\n"
-           "Defines the volume enclosed by the input OFF file(s) and saves a "
-           "volume mesh to 'volume.msh'\n\n"
-           "Command line arguments:\n"
-           "-v = verbose mode\n"
-           "-s = save the mesh bounding surface to 'skin.off'\n"
-           "-b = save the subdivided constraints to 'black_faces.off'\n"
-           "bool_opcode: {U, I, D}\n"
-           "  U -> union (AuB),\n"
-           "  I -> intersection (A^B),\n"
-           "  D -> difference (A\\B)\n\n"
-           "Example:\n"
-           "mesh_generator ant.off U pig.off\n");
-    return 0;
-  }
-
+// Options of a run: the command line, or a line of a job list.
+struct RunOptions {
   bool verbose = false;
   bool surfmesh = false;
   bool blackfaces = false;
-  char *fileA_name = NULL;
-  char *fileB_name = NULL;
+  bool tetrahedrize = false;
+  bool save_snapshot = false;
+  bool save_stats = false;
+  bool save_trace = false;
+  uint32_t num_threads = 1;
+  const char *fileA_name = NULL;
+  const char *fileB_name = NULL;
   char bool_opcode = '0';
+  const char *out_prefix = "";
+  const char *job_list = NULL;
+};
 
-  for (int i = 1; i < argc; i++) {
+//  Input: arguments: argv[0], ..., argv[argc - 1], options: o.
+// Output: updates o with the arguments, returns NULL or, if the arguments
+//         are not valid, the reason why.
+static const char *parse_options(int argc, char **argv, RunOptions &o) {
+  for (int i = 0; i < argc; i++) {
     if (argv[i][0] == '-') {
       if (argv[i][1] == 'v')
-        verbose = true;
+        o.verbose = true;
       else if (argv[i][1] == 'b')
-        blackfaces = true;
+        o.blackfaces = true;
       else if (argv[i][1] == 's')
-        surfmesh = true;
-      else
-        ip_error("Unknown option\n");
-    } else if (fileA_name == NULL)
-      fileA_name = argv[i];
-    else if (bool_opcode == '0')
-      bool_opcode = argv[i][0];
-    else if (fileB_name == NULL)
-      fileB_name = argv[i];
+        o.surfmesh = true;
+      else if (argv[i][1] == 't')
+        o.tetrahedrize = true;
+      else if (argv[i][1] == 'k')
+        o.save_snapshot = true;
+      else if (argv[i][1] == 'm')
+        o.save_stats = true;
+      else if (argv[i][1] == 'r')
+        o.save_trace = true;
+      else if (argv[i][1] == 'p')
+        o.num_threads = parallel_num_threads();
+      else if (argv[i][1] == 'o' || argv[i][1] == 'j') {
+        if (++i == argc)
+          return "Missing option argument";
+        if (argv[i - 1][1] == 'o')
+          o.out_prefix = argv[i];
+        else
+          o.job_list = argv[i];
+      } else
+        return "Unknown option";
+    } else if (o.fileA_name == NULL)
+      o.fileA_name = argv[i];
+    else if (o.bool_opcode == '0')
+      o.bool_opcode = argv[i][0];
+    else if (o.fileB_name == NULL)
+      o.fileB_name = argv[i];
     else
-      ip_error("Too many args passed\n");
+      return "Too many args passed";
   }
+  return NULL;
+}
+
+//  Input: path of a file: filename.
+// Output: returns true if the file can be opened for reading.
+static bool is_readable(const char *filename) {
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL)
+    return false;
+  fclose(f);
+  return true;
+}
 
+//  Input: options of a run: o.
+// Output: returns NULL or, if the run cannot be done, the reason why.
+// Note. Checks the operator, the number of inputs and that they can be
+//       read, not their content.
+static const char *check_run(const RunOptions &o) {
+  if (o.fileA_name == NULL)
+    return "Missing input file";
+  if (o.bool_opcode == '\0' || strchr("0UID", o.bool_opcode) == NULL)
+    return "Invalid boolean operator";
+
+  const char *ext = strrchr(o.fileA_name, '.');
+  const bool from_snapshot = (ext != NULL && strcmp(ext, ".bsp") == 0);
+  if (!from_snapshot && o.bool_opcode != '0' && o.fileB_name == NULL)
+    return "Missing second input file";
+  if ((from_snapshot || o.bool_opcode == '0') && o.fileB_name != NULL)
+    return "Too many input files";
+
+  if (!is_readable(o.fileA_name))
+    return "Cannot open the first input file";
+  if (o.fileB_name != NULL && !is_readable(o.fileB_name))
+    return "Cannot open the second input file";
+  return NULL;
+}
+
+//  Input: options accepted by check_run: o, complex to reuse (or NULL):
+//         complex.
+// Output: meshes the input (or loads the snapshot) and writes the outputs.
+//         complex is the resulting complex, which the caller deletes. stats
+//         are the statistics of the run: reading ("read"), the stages of
+//         makePolyhedralMesh and writing ("write").
+static void run(const RunOptions &o, BSPcomplex *&complex, MeshStats &stats) {
+  // A complex saved with -k replaces the whole meshing pipeline
+  const char *ext = strrchr(o.fileA_name, '.');
+  const bool from_snapshot = (ext != NULL && strcmp(ext, ".bsp") == 0);
+
+  const char bool_opcode = o.bool_opcode;
   bool two_input = (bool_opcode != '0');
 
-  if (verbose) {
-    if (fileB_name == NULL) {
+  if (o.verbose) {
+    if (!two_input) {
       printf("\nResolve auto-intersections and/or repair.\n\n");
-      printf("Loading %s\n", fileA_name);
+      printf("Loading %s\n", o.fileA_name);
     } else {
       printf("\nBoolean operator: ");
       if (bool_opcode == 'U')
@@ -117,34 +128,186 @@ int main(int argc, char **argv) {
         printf(" intersection.\n\n");
       else if (bool_opcode == 'D')
         printf(" difference.\n\n");
-      else {
-        printf("INVALID\n\n");
-        return 0;
-      }
-      printf("Loading %s and %s.\n\n", fileA_name, fileB_name);
+      if (from_snapshot)
+        printf("Loading %s.\n\n", o.fileA_name);
+      else
+        printf("Loading %s and %s.\n\n", o.fileA_name, o.fileB_name);
     }
   }
 
-  double *coords_A, *coords_B = NULL;
-  uint32_t ncoords_A, ncoords_B;
-  uint32_t *tri_idx_A, *tri_idx_B;
-  uint32_t ntriidx_A, ntriidx_B;
+  if (o.save_trace)
+    trace_start();
+  StageClock timer;
+  stats.num_threads = o.num_threads;
+  if (from_snapshot) {
+    if (complex == NULL)
+      complex = new BSPcomplex();
+    complex->loadSnapshot(o.fileA_name);
+    stats.addStage(timer, "read");
+  } else {
+    double *coords_A, *coords_B = NULL;
+    uint32_t ncoords_A, ncoords_B;
+    uint32_t *tri_idx_A, *tri_idx_B;
+    uint32_t ntriidx_A, ntriidx_B;
 
-  read_OFF_file(fileA_name, &coords_A, &ncoords_A, &tri_idx_A, &ntriidx_A,
-                verbose);
-  if (two_input)
-    read_OFF_file(fileB_name, &coords_B, &ncoords_B, &tri_idx_B, &ntriidx_B,
-                  verbose);
+    read_mesh_file(o.fileA_name, &coords_A, &ncoords_A, &tri_idx_A,
+                   &ntriidx_A, o.verbose, o.num_threads);
+    if (two_input)
+      read_mesh_file(o.fileB_name, &coords_B, &ncoords_B, &tri_idx_B,
+                     &ntriidx_B, o.verbose, o.num_threads);
+    stats.addStage(timer, "read");
 
-  BSPcomplex *complex = makePolyhedralMesh(coords_A, ncoords_A, tri_idx_A, ntriidx_A,
-                          coords_B, ncoords_B, tri_idx_B, ntriidx_B, bool_opcode, verbose);
+    complex = makePolyhedralMesh(coords_A, ncoords_A, tri_idx_A, ntriidx_A,
+                                 coords_B, ncoords_B, tri_idx_B, ntriidx_B,
+                                 bool_opcode, o.verbose, o.num_threads,
+                                 complex, &stats);
+    timer.restart();
+  }
 
   printf("Writing output files ...\n");
-  if (blackfaces)
-    complex->saveBlackFaces("black_faces.off");
+  const std::string prefix(o.out_prefix);
+  if (o.save_snapshot)
+    complex->saveSnapshot((prefix + "complex.bsp").c_str());
+
+  if (o.blackfaces)
+    complex->saveBlackFaces((prefix + "black_faces.off").c_str(),
+                            o.num_threads);
+
+  if (o.surfmesh)
+    complex->saveSkin((prefix + "skin.off").c_str(), bool_opcode,
+                      o.tetrahedrize, o.num_threads);
+
+  complex->saveMesh((prefix + "volume.msh").c_str(), bool_opcode,
+                    o.tetrahedrize, o.num_threads);
+  stats.addStage(timer, "write");
+
+  if (o.save_stats)
+    stats.saveJSON((prefix + "stats.json").c_str());
+
+  if (o.save_trace)
+    trace_save((prefix + "trace.json").c_str());
+}
+
+//  Input: options of the command line: o.
+// Output: runs the jobs listed in the file o.job_list ('-' is the standard
+//         input), one per line, with the syntax of the command line.
+//         Options of the command line are the defaults of every job.
+//         A complex is kept between jobs, so that its memory is reused.
+static void run_jobs(const RunOptions &o) {
+  std::ifstream file;
+  std::istream *in = &std::cin;
+  if (strcmp(o.job_list, "-") != 0) {
+    file.open(o.job_list);
+    if (!file)
+      ip_error("Cannot open the job list\n");
+    in = &file;
+  }
+
+  BSPcomplex *complex = NULL;
+  std::string line;
+  uint64_t num_jobs = 0;
+  while (std::getline(*in, line)) {
+    std::istringstream ss(line);
+    std::vector<std::string> words;
+    std::string w;
+    while (ss >> w)
+      words.push_back(w);
+    if (words.empty() || words[0][0] == '#')
+      continue;
+
+    std::vector<char *> args;
+    for (std::string &word : words)
+      args.push_back(&word[0]);
+    RunOptions jo = o;
+    jo.fileA_name = jo.fileB_name = jo.job_list = NULL;
+    jo.bool_opcode = '0';
+    const char *error = parse_options((int)args.size(), args.data(), jo);
+    if (error == NULL && jo.job_list != NULL)
+      error = "Job lists cannot be nested";
+    if (error == NULL)
+      error = check_run(jo);
+
+    // A job that cannot be done is reported, and the next ones are run.
+    num_jobs++;
+    if (error != NULL) {
+      printf("Job %llu: FAILED (%s: %s)\n", (unsigned long long)num_jobs,
+             error, line.c_str());
+      fflush(stdout);
+      continue;
+    }
+
+    MeshStats stats;
+    run(jo, complex, stats);
+    const double read = stats.stages.front().wall;
+    const double write = stats.stages.back().wall;
+    printf("Job %llu: read %f s, mesh %f s, write %f s (%s)\n",
+           (unsigned long long)num_jobs, read,
+           stats.total().wall - read - write, write, line.c_str());
+    fflush(stdout);
+  }
+
+  delete complex;
+  printf("Done.\n");
+}
+
+/// <summary>
+/// Main function
+/// </summary>
+/// <param name="argc"></param>
+/// <param name="argv"></param>
+/// <returns></returns>
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("\nUsage: mesh_generator [-v | -s | -b | -t | -k | -m | -r | "
+           "-p | -o prefix] inputfile_A.off [bool_opcode inputfile_B.off]\n"
+           "       mesh_generator [options] -j joblist\n\n"
+           "Defines the volume enclosed by the input OFF file(s) and saves a "
+           "volume mesh to 'volume.msh'\n\n"
+           "Input files can be ASCII OFF, binary STL or binary PLY.\n"
+           "inputfile_A can also be a complex saved with -k (.bsp), possibly "
+           "followed by bool_opcode alone.\n\n"
+           "Command line arguments:\n"
+           "-v = verbose mode\n"
+           "-s = save the mesh bounding surface to 'skin.off'\n"
+           "-b = save the subdivided constraints to 'black_faces.off'\n"
+           "-t = tetrahedrize the cells of the volume mesh (and triangulate "
+           "the skin)\n"
+           "-k = save the complex to 'complex.bsp'\n"
+           "-m = save the statistics of the run (times, peak memory, sizes) "
+           "to 'stats.json'\n"
+           "-r = record a timeline of the run to 'trace.json' (Chrome trace "
+           "format, see chrome://tracing or ui.perfetto.dev)\n"
+           "-p = use all the available processors\n"
+           "-o prefix = prepend prefix to the names of the output files\n"
+           "-j joblist = run the jobs listed in the file joblist ('-' reads "
+           "them from the standard input), one per line with the arguments "
+           "of a run\n"
+           "bool_opcode: {U, I, D}\n"
+           "  U -> union (AuB),\n"
+           "  I -> intersection (A^B),\n"
+           "  D -> difference (A\\B)\n\n"
+           "Example:\n"
+           "mesh_generator ant.off U pig.off\n");
+    return 0;
+  }
+
+  RunOptions o;
+  const char *error = parse_options(argc - 1, argv + 1, o);
+  if (error != NULL)
+    ip_error((std::string(error) + "\n").c_str());
+
+  if (o.job_list != NULL) {
+    if (o.fileA_name != NULL)
+      ip_error("Input files cannot be passed with a job list\n");
+    run_jobs(o);
+    return 0;
+  }
 
-  if (surfmesh)
-    complex->saveSkin("skin.off", bool_opcode);
+  if ((error = check_run(o)) != NULL)
+    ip_error((std::string(error) + "\n").c_str());
+  BSPcomplex *complex = NULL;
+  MeshStats stats;
+  run(o, complex, stats);
 
   delete complex;
   printf("Done.\n");
@@ -1,94 +1,202 @@
 #include "BSP.h"
 #include "conforming_mesh.h"
 #include "extended_predicates.h"
+#include "parallel.h"
 #include "string.h"
+#include "trace.h"
+#include <algorithm>
 #include <stdarg.h>
-#include <time.h>
-
-int vertex_compare(const void *void_v1, const void *void_v2) {
-  const vertex_t *v1 = (vertex_t *)void_v1;
-  const vertex_t *v2 = (vertex_t *)void_v2;
-  const double dx = v1->coord[0] - v2->coord[0];
-  const double dy = v1->coord[1] - v2->coord[1];
-  const double dz = v1->coord[2] - v2->coord[2];
-  return (4 * ((dx > 0) - (dx < 0)) + 2 * ((dy > 0) - (dy < 0)) +
-          ((dz > 0) - (dz < 0)));
-}
 
-inline bool coincident_points(const vertex_t *a, const vertex_t *b) {
-  return !vertex_compare(a->coord, b->coord);
+// Order-preserving map of a coordinate to an unsigned integer: a < b if and
+// only if key(a) < key(b). -0 and 0 have the same key.
+inline uint64_t coord_key(double x) {
+  if (x == 0)
+    x = 0;
+  uint64_t k;
+  memcpy(&k, &x, sizeof(double));
+  const uint64_t sign = UINT64_C(1) << 63;
+  return (k & sign) ? (~k) : (k | sign);
 }
 
-void remove_duplicated_points(vertex_t **vertices_p, uint32_t *npts,
-                              vertex_t *vrts_copy, uint32_t *map,
-                              uint32_t *diff) {
-
-  // Sorting vertices by coordinates lexicographic order (x,y,z)
-  qsort(vrts_copy, *npts, sizeof(vertex_t), vertex_compare);
+// A point and the key of one of its coordinates
+struct coord_key_t {
+  uint64_t key;
+  uint32_t index;
+};
+
+//  Input: arrays a and tmp of n elements, number of threads: num_threads.
+// Output: returns either a or tmp, holding the elements of a stably sorted by
+//         key. The other array is overwritten.
+// Note. LSD radix sort on bytes. Bytes that are the same in all keys are
+//       skipped. Each thread counts and moves a fixed range of elements.
+static coord_key_t *radix_sort_keys(coord_key_t *a, coord_key_t *tmp,
+                                    uint32_t n, uint32_t num_threads) {
+  std::vector<uint64_t> diff(num_threads, 0); // Bits that differ from a[0]
+  parallel_run(num_threads, [&](uint32_t t) {
+    uint64_t d = 0;
+    for (uint32_t j = n * (uint64_t)t / num_threads;
+         j < n * (uint64_t)(t + 1) / num_threads; j++)
+      d |= a[j].key ^ a[0].key;
+    diff[t] = d;
+  });
+  uint64_t diff_bits = 0;
+  for (uint32_t t = 0; t < num_threads; t++)
+    diff_bits |= diff[t];
+
+  std::vector<uint32_t> count(256 * num_threads);
+  for (int shift = 0; shift < 64; shift += 8) {
+    if (((diff_bits >> shift) & 0xff) == 0)
+      continue;
+
+    parallel_run(num_threads, [&](uint32_t t) {
+      uint32_t *c = count.data() + 256 * t;
+      std::fill(c, c + 256, 0);
+      for (uint32_t j = n * (uint64_t)t / num_threads;
+           j < n * (uint64_t)(t + 1) / num_threads; j++)
+        c[(a[j].key >> shift) & 0xff]++;
+    });
+
+    // count[256 * t + d] becomes the position of the first element of
+    // thread t with digit d.
+    uint32_t pos = 0;
+    for (uint32_t d = 0; d < 256; d++)
+      for (uint32_t t = 0; t < num_threads; t++) {
+        const uint32_t c = count[256 * t + d];
+        count[256 * t + d] = pos;
+        pos += c;
+      }
 
-  // Count and memory position of duplicated vertices.
-  uint32_t vrts_counter = 0;
-  for (uint32_t i = 1; i < (*npts); i++) {
-    if (coincident_points(vrts_copy + i - 1, vrts_copy + i))
-      vrts_counter++;
-    diff[i] = vrts_counter;
+    parallel_run(num_threads, [&](uint32_t t) {
+      uint32_t *c = count.data() + 256 * t;
+      for (uint32_t j = n * (uint64_t)t / num_threads;
+           j < n * (uint64_t)(t + 1) / num_threads; j++)
+        tmp[c[(a[j].key >> shift) & 0xff]++] = a[j];
+    });
+    std::swap(a, tmp);
   }
+  return a;
+}
 
-  // Set original_index to follow vertices permutation.
-  for (uint32_t i = 0; i < (*npts); i++)
-    map[vrts_copy[i].original_index] = i;
+//  Input: vertices of two meshes: A and B (possibly empty),
+//         number of threads: num_threads.
+// Output: *vertices_p = the distinct points in lexicographic order (x,y,z),
+//         allocated with malloc; *npts = their number; map[i] = index in
+//         *vertices_p of the i-th point (the points of B follow those of A).
+// Note. Points are radix sorted by x, then the (usually short) runs of
+//       points with the same x are sorted by y and z. Equal points are
+//       consecutive, in the order of their index.
+void remove_duplicated_points(const MeshView &A, const MeshView &B,
+                              vertex_t **vertices_p, uint32_t *npts,
+                              uint32_t *map, uint32_t num_threads) {
+  TRACE_SPAN("dedup");
+  const uint32_t n = A.npts + B.npts;
+  auto point = [&](uint32_t i) -> const double * {
+    return (i < A.npts) ? (A.vertex(i)) : (B.vertex(i - A.npts));
+  };
+  // Range of the elements of thread t
+  auto begin = [&](uint32_t t) {
+    return (uint32_t)(n * (uint64_t)t / num_threads);
+  };
+
+  coord_key_t *buf = (coord_key_t *)malloc(sizeof(coord_key_t) * 2 * n);
+  parallel_run(num_threads, [&](uint32_t t) {
+    for (uint32_t i = begin(t); i < begin(t + 1); i++) {
+      buf[i].key = coord_key(point(i)[0]);
+      buf[i].index = i;
+    }
+  });
+  coord_key_t *sorted = buf;
+  if (n > 0)
+    sorted = radix_sort_keys(buf, buf + n, n, num_threads);
+
+  // Runs of equal x are sorted by the thread that owns their first element,
+  // on a copy of the y and z keys.
+  parallel_run(num_threads, [&](uint32_t t) {
+    std::vector<std::pair<std::pair<uint64_t, uint64_t>, uint32_t>> run;
+    uint32_t j = begin(t);
+    while (j > 0 && j < n && sorted[j - 1].key == sorted[j].key)
+      j++;
+    while (j < begin(t + 1)) {
+      uint32_t k = j + 1;
+      while (k < n && sorted[k].key == sorted[j].key)
+        k++;
+      if (k - j > 1) {
+        run.clear();
+        for (uint32_t i = j; i < k; i++) {
+          const double *p = point(sorted[i].index);
+          run.push_back(std::make_pair(
+              std::make_pair(coord_key(p[1]), coord_key(p[2])),
+              sorted[i].index));
+        }
+        std::sort(run.begin(), run.end());
+        for (uint32_t i = j; i < k; i++)
+          sorted[i].index = run[i - j].second;
+      }
+      j = k;
+    }
+  });
+
+  // Each thread numbers the distinct points of a range of sorted points:
+  // first count them, then number them after those of the previous ranges.
+  auto is_new = [&](uint32_t j) {
+    if (j == 0 || sorted[j - 1].key != sorted[j].key)
+      return true;
+    const double *p = point(sorted[j - 1].index);
+    const double *q = point(sorted[j].index);
+    return (p[1] != q[1] || p[2] != q[2]);
+  };
+  std::vector<uint32_t> first(num_threads + 1, 0);
+  parallel_run(num_threads, [&](uint32_t t) {
+    uint32_t num_new = 0;
+    for (uint32_t j = begin(t); j < begin(t + 1); j++)
+      num_new += is_new(j);
+    first[t + 1] = num_new;
+  });
+  for (uint32_t t = 0; t < num_threads; t++)
+    first[t + 1] += first[t];
+  *npts = first[num_threads];
 
   // Allocating memory to store uinque mesh vertices (vertices_p).
-  *vertices_p = (vertex_t *)malloc(sizeof(vertex_t) * (*npts - vrts_counter));
-
-  // Fill mesh vertices (vertices_p)
-  memcpy(*vertices_p, vrts_copy, sizeof(vertex_t));
-  for (uint32_t i = vrts_counter = 1; i < (*npts); i++)
-    if (!coincident_points(vrts_copy + i - 1, vrts_copy + i))
-      memcpy(*vertices_p + (vrts_counter++), vrts_copy + i, sizeof(vertex_t));
+  *vertices_p = (vertex_t *)malloc(sizeof(vertex_t) * (*npts));
+  parallel_run(num_threads, [&](uint32_t t) {
+    uint32_t u = first[t] - 1;
+    for (uint32_t j = begin(t); j < begin(t + 1); j++) {
+      if (is_new(j)) {
+        vertex_t &v = (*vertices_p)[++u];
+        memcpy(v.coord, point(sorted[j].index), 3 * sizeof(double));
+        v.original_index = sorted[j].index;
+      }
+      map[sorted[j].index] = u;
+    }
+  });
 
-  // Update uinque vertices number.
-  (*npts) = vrts_counter;
+  free(buf);
 }
 
 /// //////////////////////////////////////////////////////////////////////////////////////////
 
-void read_nodes_and_constraints(double *coords_A, uint32_t npts_A,
-                                uint32_t *tri_idx_A, uint32_t ntri_A,
-                                vertex_t **vertices_p, uint32_t *npts,
+void read_nodes_and_constraints(const MeshView &A, vertex_t **vertices_p,
+                                uint32_t *npts,
                                 uint32_t **tri_vertices_p, uint32_t *ntri,
-                                bool verbose) {
+                                bool verbose, uint32_t num_threads) {
 
   // Reading points coordinates.
-  *npts = npts_A;
-  *ntri = ntri_A;
-  vertex_t *tmp = (vertex_t *)malloc(*npts * sizeof(vertex_t));
-  uint32_t *diff = (uint32_t *)calloc(*npts, sizeof(uint32_t));
-  uint32_t *map = (uint32_t *)malloc(*npts * sizeof(uint32_t));
+  *ntri = A.ntri;
+  uint32_t *map = (uint32_t *)malloc(A.npts * sizeof(uint32_t));
   *tri_vertices_p = (uint32_t *)malloc(sizeof(uint32_t) * 3 * (*ntri));
 
-  for (uint32_t i = 0; i < (*npts); i++) {
-    tmp[i].coord[0] = coords_A[i * 3];
-    tmp[i].coord[1] = coords_A[i * 3 + 1];
-    tmp[i].coord[2] = coords_A[i * 3 + 2];
-    tmp[i].original_index = i;
-  }
-
-  if (*npts > 1)
-    remove_duplicated_points(vertices_p, npts, tmp, map, diff);
+  remove_duplicated_points(A, MeshView(), vertices_p, npts, map, num_threads);
   if (verbose)
     printf("Using %u unique vertices\n", *npts);
 
-  free(tmp);
-
   for (uint32_t i = 0, j = 0; i < (*ntri); j++) {
 
-    const uint32_t i1 = tri_idx_A[j * 3];
-    const uint32_t i2 = tri_idx_A[j * 3 + 1];
-    const uint32_t i3 = tri_idx_A[j * 3 + 2];
-    (*tri_vertices_p)[3 * i] = map[i1] - diff[map[i1]];
-    (*tri_vertices_p)[3 * i + 1] = map[i2] - diff[map[i2]];
-    (*tri_vertices_p)[3 * i + 2] = map[i3] - diff[map[i3]];
+    const uint32_t i1 = A.triangle(j)[0];
+    const uint32_t i2 = A.triangle(j)[1];
+    const uint32_t i3 = A.triangle(j)[2];
+    (*tri_vertices_p)[3 * i] = map[i1];
+    (*tri_vertices_p)[3 * i + 1] = map[i2];
+    (*tri_vertices_p)[3 * i + 2] = map[i3];
 
     const double *v1c = ((*vertices_p) + (*tri_vertices_p)[3 * i])->coord;
     const double *v2c = ((*vertices_p) + (*tri_vertices_p)[3 * i + 1])->coord;
@@ -100,61 +208,40 @@ void read_nodes_and_constraints(double *coords_A, uint32_t npts_A,
       i++;
   }
   free(map);
-  free(diff);
 
   if (verbose)
     printf("Using %u non-degenerate constraints\n", *ntri);
 }
 
 void read_nodes_and_constraints_twoInput(
-    double *coords_A, uint32_t npts_A, uint32_t *tri_idx_A, uint32_t ntri_A,
-    double *coords_B, uint32_t npts_B, uint32_t *tri_idx_B, uint32_t ntri_B,
-    vertex_t **vertices_p, uint32_t *npts, uint32_t **tri_vertices_p,
-    uint32_t *ntri, uint32_t **tri_group, bool verbose) {
+    const MeshView &A, const MeshView &B, vertex_t **vertices_p,
+    uint32_t *npts, uint32_t **tri_vertices_p, uint32_t *ntri,
+    uint32_t **tri_group, bool verbose, uint32_t num_threads) {
 
-  // Global numbers of points and triangles.
-  *npts = npts_A + npts_B;
-  *ntri = ntri_A + ntri_B;
+  // Global number of triangles.
+  *ntri = A.ntri + B.ntri;
 
   // Reading points coordinates.
-  vertex_t *tmp = (vertex_t *)malloc(*npts * sizeof(vertex_t));
-  uint32_t *diff = (uint32_t *)calloc(*npts, sizeof(uint32_t));
-  uint32_t *map = (uint32_t *)malloc(*npts * sizeof(uint32_t));
-
-  for (uint32_t i = 0; i < npts_A; i++) {
-    tmp[i].coord[0] = coords_A[i * 3];
-    tmp[i].coord[1] = coords_A[i * 3 + 1];
-    tmp[i].coord[2] = coords_A[i * 3 + 2];
-    tmp[i].original_index = i;
-  }
-  for (uint32_t i = 0; i < npts_B; i++) {
-    tmp[i + npts_A].coord[0] = coords_B[i * 3];
-    tmp[i + npts_A].coord[1] = coords_B[i * 3 + 1];
-    tmp[i + npts_A].coord[2] = coords_B[i * 3 + 2];
-    tmp[i + npts_A].original_index = i + npts_A;
-  }
-
-  if (*npts > 1)
-    remove_duplicated_points(vertices_p, npts, tmp, map, diff);
+  uint32_t *map = (uint32_t *)malloc((A.npts + B.npts) * sizeof(uint32_t));
+  remove_duplicated_points(A, B, vertices_p, npts, map, num_threads);
   if (verbose)
     printf("Using %u unique vertices\n", *npts);
 
-  free(tmp);
-
   // Reading triangle vertices indices.
   *tri_vertices_p = (uint32_t *)malloc(*ntri * 3 * sizeof(uint32_t));
   *tri_group = (uint32_t *)malloc(*ntri * sizeof(uint32_t));
 
-  uint32_t i1, i2, i3, base_ntri_A = ntri_A;
+  // ntri_A counts the non-degenerate triangles of A.
+  uint32_t i1, i2, i3, ntri_A = A.ntri;
   for (uint32_t ti = 0, j = 0; ti < (*ntri); j++) {
     if (ti < ntri_A) {
-      i1 = tri_idx_A[3 * j];
-      i2 = tri_idx_A[3 * j + 1];
-      i3 = tri_idx_A[3 * j + 2];
+      i1 = A.triangle(j)[0];
+      i2 = A.triangle(j)[1];
+      i3 = A.triangle(j)[2];
 
-      (*tri_vertices_p)[3 * ti] = map[i1] - diff[map[i1]];
-      (*tri_vertices_p)[3 * ti + 1] = map[i2] - diff[map[i2]];
-      (*tri_vertices_p)[3 * ti + 2] = map[i3] - diff[map[i3]];
+      (*tri_vertices_p)[3 * ti] = map[i1];
+      (*tri_vertices_p)[3 * ti + 1] = map[i2];
+      (*tri_vertices_p)[3 * ti + 2] = map[i3];
       (*tri_group)[ti] = CONSTR_A;
 
       const double *v1c = (*vertices_p + (*tri_vertices_p)[3 * ti])->coord;
@@ -168,16 +255,16 @@ void read_nodes_and_constraints_twoInput(
     } else {
       if (ti == ntri_A)
         j = 0;
-      i1 = tri_idx_B[3 * j];
-      i2 = tri_idx_B[3 * j + 1];
-      i3 = tri_idx_B[3 * j + 2];
-
-      i1 += npts_A;
-      i2 += npts_A;
-      i3 += npts_A;
-      (*tri_vertices_p)[3 * ti] = map[i1] - diff[map[i1]];
-      (*tri_vertices_p)[3 * ti + 1] = map[i2] - diff[map[i2]];
-      (*tri_vertices_p)[3 * ti + 2] = map[i3] - diff[map[i3]];
+      i1 = B.triangle(j)[0];
+      i2 = B.triangle(j)[1];
+      i3 = B.triangle(j)[2];
+
+      i1 += A.npts;
+      i2 += A.npts;
+      i3 += A.npts;
+      (*tri_vertices_p)[3 * ti] = map[i1];
+      (*tri_vertices_p)[3 * ti + 1] = map[i2];
+      (*tri_vertices_p)[3 * ti + 2] = map[i3];
       (*tri_group)[ti] = CONSTR_B;
 
       const double *v1c = (*vertices_p + (*tri_vertices_p)[3 * ti])->coord;
@@ -194,38 +281,35 @@ void read_nodes_and_constraints_twoInput(
       (uint32_t *)realloc(*tri_vertices_p, *ntri * 3 * sizeof(uint32_t));
   *tri_group = (uint32_t *)realloc(*tri_group, *ntri * sizeof(uint32_t));
   free(map);
-  free(diff);
 
   if (verbose)
     printf("Using %u non-degenerate constraints\n", *ntri);
 }
 
-/// <summary>
-/// Main function - Create a polyhedral mesh out of the input
-/// Input may be made of either one or two models to be combined into a boolean
-/// composition
-/// </summary>
-/// <param name="coords_A">Serialized coordinates of first model
-/// vertices</param> <param name="npts_A">Number of first model vertices</param>
-/// <param name="tri_idx_A">Serialized indexes of first model triangles</param>
-/// <param name="ntri_A">Number of first model triangles</param>
-/// <param name="coords_B">Serialized coordinates of second model
-/// vertices</param> <param name="npts_B">Number of second model
-/// vertices</param> <param name="tri_idx_B">Serialized indexes of second model
-/// triangles</param> <param name="ntri_B">Number of second model
-/// triangles</param> <param name="bool_opcode">Boolean operation (0 = no op, U
-/// = union, D = difference, I = intersection</param> <param
-/// name="verbose">Print useful info during the process</param> <param
-/// resulting BSPcomplex structure</returns>
-BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
-                               uint32_t *tri_idx_A, uint32_t ntri_A,
-                               double *coords_B, uint32_t npts_B,
-                               uint32_t *tri_idx_B, uint32_t ntri_B,
-                               char bool_opcode, bool verbose) {
+//  Input: input meshes: A and B (empty if bool_opcode is '0'), and the
+//         other parameters of makePolyhedralMesh,
+//         flag: free_input (free the arrays of A and B once they are read).
+// Output: returns the resulting BSPcomplex (complex itself if not NULL).
+//         If stats is not NULL, the stages of the pipeline are appended to
+//         it and the counts are set.
+static BSPcomplex *polyhedral_mesh(const MeshView &A, const MeshView &B,
+                                   char bool_opcode, bool verbose,
+                                   uint32_t num_threads, BSPcomplex *complex,
+                                   bool free_input, MeshStats *stats) {
+  TRACE_SPAN("makePolyhedralMesh");
+  if (num_threads == 0)
+    num_threads = 1;
+  // Delaunay and constraint insertion use the default floating point
+  // environment, the indirect predicates the one of initFPU. The caller's
+  // one is restored on return.
+  FPUscope fpu_scope;
+  fesetenv(FE_DFL_ENV);
+
   bool two_input = (bool_opcode != '0');
+  MeshStats local_stats;
 
   if (verbose) {
-    if (coords_B == NULL) {
+    if (!two_input) {
       printf("\nResolve auto-intersections and/or repair.\n\n");
     } else {
       printf("\nBoolean operator: ");
@@ -241,23 +325,29 @@ BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
     }
   }
 
+  if (stats == NULL)
+    stats = &local_stats;
+  stats->num_threads = num_threads;
+  stats->input_vertices = A.npts + B.npts;
+  stats->input_triangles = A.ntri + B.ntri;
+  StageClock timer;
+
   //--Initialization-----------------
   TetMesh *mesh = new TetMesh;
   Constraint *constraints = new Constraint;
 
   if (!two_input) {
-    read_nodes_and_constraints(coords_A, npts_A, tri_idx_A, ntri_A,
-                               &mesh->vertices, &mesh->num_vertices,
+    read_nodes_and_constraints(A, &mesh->vertices, &mesh->num_vertices,
                                &constraints->tri_vertices,
-                               &constraints->num_triangles, verbose);
+                               &constraints->num_triangles, verbose,
+                               num_threads);
     constraints->constr_group =
         (uint32_t *)calloc(constraints->num_triangles, sizeof(uint32_t));
   } else { // two input
     read_nodes_and_constraints_twoInput(
-        coords_A, npts_A, tri_idx_A, ntri_A, coords_B, npts_B, tri_idx_B,
-        ntri_B, &mesh->vertices, &mesh->num_vertices,
+        A, B, &mesh->vertices, &mesh->num_vertices,
         &constraints->tri_vertices, &constraints->num_triangles,
-        &constraints->constr_group, verbose);
+        &constraints->constr_group, verbose, num_threads);
   }
 
   if (mesh->num_vertices < 4)
@@ -266,17 +356,19 @@ BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
     ip_error("No non-degenerate constraints loaded.");
 
   // (free_mem)
-  {
-    free(coords_A);
-    free(tri_idx_A);
+  if (free_input) {
+    free((void *)A.coords);
+    free((void *)A.tri_idx);
     if (two_input) {
-      free(coords_B);
-      free(tri_idx_B);
+      free((void *)B.coords);
+      free((void *)B.tri_idx);
     }
   }
 
-  clock_t time0 = clock();
-  clock_t time1 = time0;
+  stats->vertices = mesh->num_vertices;
+  stats->constraints = constraints->num_triangles;
+  stats->addStage(timer, "input");
+  const size_t first_stage = stats->stages.size();
 
   //--Delaunay-Insertion-----------------
   // Setup for following vertex permutation in tetrahedrize
@@ -284,164 +376,133 @@ BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
     mesh->vertices[i].original_index = i;
 
   // Create Delaunay tetrahedrization of the vertices
-  mesh->tetrahedrize();
+  mesh->tetrahedrize(num_threads);
 
   // Align constraint vertices after vertex permutation
-  if (mesh->vertices[2].original_index != 3) {
-    for (uint32_t k = 0; k < 3 * constraints->num_triangles; k++)
-      constraints->tri_vertices[k] =
-          mesh->vertices[constraints->tri_vertices[k]].original_index;
-  } else {
-    for (uint32_t k = 0; k < 3 * constraints->num_triangles; k++) {
-      uint32_t l = mesh->vertices[3].original_index;
-      uint32_t c = constraints->tri_vertices[k];
-      if (c == 2)
-        constraints->tri_vertices[k] = l;
-      else if (c == 3)
-        constraints->tri_vertices[k] = 2;
-      else if (c == l)
-        constraints->tri_vertices[k] = 3;
-    }
-  }
-  clock_t time2 = clock();
+  uint32_t *new_index =
+      (uint32_t *)malloc(mesh->num_vertices * sizeof(uint32_t));
+  for (uint32_t i = 0; i < mesh->num_vertices; i++)
+    new_index[mesh->vertices[i].original_index] = i;
+  for (uint32_t k = 0; k < 3 * constraints->num_triangles; k++)
+    constraints->tri_vertices[k] = new_index[constraints->tri_vertices[k]];
+  free(new_index);
+  stats->addStage(timer, "delaunay");
   if (verbose)
-    printf("\tDelaunay insertion: %f s\n",
-           (double)(time2 - time1) / CLOCKS_PER_SEC);
+    printf("\tDelaunay insertion: %f s\n", stats->stages.back().wall);
 
   //--Half-Edges-and-Virtual-Constraint----------------------
-  half_edge_t *half_edges = (half_edge_t *)calloc(
-      3 * constraints->num_triangles, sizeof(half_edge_t));
-  fill_half_edges(constraints, half_edges);
-  sort_half_edges(half_edges, 3 * constraints->num_triangles);
+  {
+    TRACE_SPAN("half_edges");
+    half_edge_t *half_edges = (half_edge_t *)calloc(
+        3 * constraints->num_triangles, sizeof(half_edge_t));
+    fill_half_edges(constraints, half_edges);
+    sort_half_edges(half_edges, 3 * constraints->num_triangles);
+
+    uint32_t nvc = place_virtual_constraints(mesh, constraints, half_edges);
+    stats->virtual_constraints = nvc;
+    if (verbose)
+      printf("\t%u virtual constraints added\n", nvc);
+
+    free(half_edges);
+  }
 
-  uint32_t nvc = place_virtual_constraints(mesh, constraints, half_edges);
+  stats->addStage(timer, "virtual_constraints");
   if (verbose)
-    printf("\t%u virtual constraints added\n", nvc);
+    printf("\tHalf-edges: %f s\n", stats->stages.back().wall);
 
-  free(half_edges);
+  //--Map-Tetrahedra-Constraint-Intersections----------------
+  // Map the tetrahedra improperly intersecated by the constraints:
+  //    map[0].list(i) are the indices of the constraints which improperly
+  //    intersect the i-th tetrahedron.
+  // Other 4 maps (map[j+1], j=0,...,3) store the constraints that partially
+  // or completely overlap with the face opposite to vertex j of each tet.
+  TetConstraintMap *map = new TetConstraintMap[5];
 
-  clock_t time3 = clock();
-  if (verbose)
-    printf("\tHalf-edges: %f s\n", (double)(time3 - time2) / CLOCKS_PER_SEC);
+  insert_constraints(mesh, constraints, map[0], map[1], map[2], map[3],
+                     map[4], num_threads);
 
-  //--Map-Tetrahedra-Constraint-Intersections----------------
-  // Initialize an array to map the tetrahedra improperly intersecated
-  // by the constraints:
-  //    the i-th element is a pointer (of tetrahedra index type) used to store
-  //    the indices of the constraints that improper intersect the i-th
-  //    tetrahedron,
-  //    it points to an array (map[i] of lenght num_map[i]) whose elements
-  //    are the indices of the constraints which improperly intersect the
-  //    i-th tetrahedron.
-  uint32_t *num_map = (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
-  uint32_t **map = (uint32_t **)calloc(mesh->tet_num, sizeof(uint32_t *));
-
-  // Initalize other 4 maps to memory the tet-faces that are partially or
-  // completely overlap with a constraint.
-  uint32_t *num_map_f0 = (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
-  uint32_t **map_f0 = (uint32_t **)calloc(mesh->tet_num, sizeof(uint32_t *));
-  uint32_t *num_map_f1 = (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
-  uint32_t **map_f1 = (uint32_t **)calloc(mesh->tet_num, sizeof(uint32_t *));
-  uint32_t *num_map_f2 = (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
-  uint32_t **map_f2 = (uint32_t **)calloc(mesh->tet_num, sizeof(uint32_t *));
-  uint32_t *num_map_f3 = (uint32_t *)calloc(mesh->tet_num, sizeof(uint32_t));
-  uint32_t **map_f3 = (uint32_t **)calloc(mesh->tet_num, sizeof(uint32_t *));
-
-  insert_constraints(mesh, constraints, 
-                     num_map, map, 
-                     num_map_f0, map_f0,
-                     num_map_f1, map_f1,
-                     num_map_f2, map_f2,
-                     num_map_f3, map_f3);
-
-  clock_t time4 = clock();
+  stats->addStage(timer, "constraint_map");
   if (verbose)
-    printf("\tMap creation: %f s\n", (double)(time4 - time3) / CLOCKS_PER_SEC);
+    printf("\tMap creation: %f s\n", stats->stages.back().wall);
 
-  double DEL_time = (double)(time4 - time0) / CLOCKS_PER_SEC;
+  double DEL_time = 0;
+  for (size_t i = first_stage; i < stats->stages.size(); i++)
+    DEL_time += stats->stages[i].wall;
   if (verbose)
     printf("TOTAL Delaunay + map: %f s\n\n", DEL_time);
 
   initFPU(); // From here on we need indirect predicates
 
   //-Init BSP with mesh and constraints---------------------------------------
-  BSPcomplex *complex = new BSPcomplex(
-      mesh, constraints,
-      (const uint32_t **)map, num_map,
-      (const uint32_t **)map_f0, num_map_f0,
-      (const uint32_t **)map_f1, num_map_f1, 
-      (const uint32_t **)map_f2, num_map_f2,
-      (const uint32_t **)map_f3, num_map_f3);
-
-  // Free the memory used by map(s) and num_map(s)
-  for (uint64_t i = 0; i < mesh->tet_num; i++) {
-    if (num_map[i])
-      free(map[i]);
-    if (num_map_f0[i])
-      free(map_f0[i]);
-    if (num_map_f1[i])
-      free(map_f1[i]);
-    if (num_map_f2[i])
-      free(map_f2[i]);
-    if (num_map_f3[i])
-      free(map_f3[i]);
+  if (complex == NULL)
+    complex = new BSPcomplex(mesh, constraints, map[0], map[1], map[2], map[3],
+                             map[4]);
+  else {
+    complex->clear();
+    complex->init(mesh, constraints, map[0], map[1], map[2], map[3], map[4]);
   }
-  free(num_map);
-  free(map);
-  free(num_map_f0);
-  free(map_f0);
-  free(num_map_f1);
-  free(map_f1);
-  free(num_map_f2);
-  free(map_f2);
-  free(num_map_f3);
-  free(map_f3);
+
+  // Free the memory used by the maps
+  delete[] map;
 
   delete mesh;
   delete constraints;
 
-  clock_t time5 = clock();
+  stats->initial_cells = complex->cells.size();
+  stats->addStage(timer, "complex_init");
   if (verbose)
-    printf("\tDelaunay -> Complex %lf s\n",
-           (double)(time5 - time4) / CLOCKS_PER_SEC);
+    printf("\tDelaunay -> Complex %lf s\n", stats->stages.back().wall);
   if (verbose)
     printf("\tInitial cells: %lu\n", complex->cells.size());
 
   //-Subdivision----------------------------------------------------------------
-  for (size_t i = 0; i < complex->cells.size(); /*ignore */) {
-    if (complex->cells[i].constraints.size() > 0)
-      complex->splitCell(i);
-    else
-      i++;
-  }
-  clock_t time6 = clock();
+  complex->subdivide(num_threads);
+  stats->final_cells = complex->cells.size();
+  stats->addStage(timer, "subdivision");
   if (verbose)
-    printf("\tCell subdivision %f s\n",
-           (double)(time6 - time5) / CLOCKS_PER_SEC);
+    printf("\tCell subdivision %f s\n", stats->stages.back().wall);
   if (verbose)
     printf("\tFinal cells: %lu\n", complex->cells.size());
 
   //--Decide colour of GREY faces-----------------------------------------------
-  for (size_t i = 0; i < complex->faces.size(); i++) {
-    BSPface &face = complex->faces[i];
-    if (face.colour == GREY)
-      face.colour = complex->blackAB_or_white(i, bool_opcode != '0');
+  uint64_t num_grey = 0;
+  {
+    TraceSpan span("colour_grey_faces");
+    for (size_t i = 0; i < complex->faces.size(); i++) {
+      BSPface &face = complex->faces[i];
+      if (face.colour == GREY) {
+        face.colour = complex->blackAB_or_white(i, bool_opcode != '0');
+        num_grey++;
+      }
+    }
+    span.setCount(num_grey);
   }
+  stats->grey_faces = num_grey;
+  stats->faces = complex->faces.size();
 
-  clock_t time7 = clock();
+  stats->addStage(timer, "grey_faces");
   if (verbose)
-    printf("\tFind black faces %f s\n",
-           (double)(time7 - time6) / CLOCKS_PER_SEC);
+    printf("\tFind black faces %f s\n", stats->stages.back().wall);
 
   //-Classification:intrenal/external cells-------------------------------------
   complex->constraintsSurface_complexPartition(bool_opcode != '0');
 
-  clock_t time8 = clock();
+  stats->addStage(timer, "classification");
   if (verbose)
-    printf("\tInt-ext class. %f s\n", (double)(time8 - time7) / CLOCKS_PER_SEC);
+    printf("\tInt-ext class. %f s\n", stats->stages.back().wall);
+
+  uint64_t num_lpi = 0, num_tpi = 0;
+  for (const genericPoint *v : complex->vertices) {
+    num_lpi += v->isLPI();
+    num_tpi += v->isTPI();
+  }
+  stats->lpi_vertices = num_lpi;
+  stats->tpi_vertices = num_tpi;
 
-  clock_t time9 = clock();
-  double BSP_time = (double)(time9 - time4) / CLOCKS_PER_SEC;
+  double BSP_time = 0;
+  for (size_t i = first_stage; i < stats->stages.size(); i++)
+    BSP_time += stats->stages[i].wall;
+  BSP_time -= DEL_time;
   if (verbose) {
     printf("TOTAL BSP: %f s\n\n", BSP_time);
     printf("TOTAL time: %f s\n\n", BSP_time + DEL_time);
@@ -449,3 +510,47 @@ BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
 
   return complex;
 }
+
+/// <summary>
+/// Main function - Create a polyhedral mesh out of the input
+/// Input may be made of either one or two models to be combined into a boolean
+/// composition
+/// </summary>
+/// <param name="coords_A">Serialized coordinates of first model
+/// vertices</param> <param name="npts_A">Number of first model vertices</param>
+/// <param name="tri_idx_A">Serialized indexes of first model triangles</param>
+/// <param name="ntri_A">Number of first model triangles</param>
+/// <param name="coords_B">Serialized coordinates of second model
+/// vertices</param> <param name="npts_B">Number of second model
+/// vertices</param> <param name="tri_idx_B">Serialized indexes of second model
+/// triangles</param> <param name="ntri_B">Number of second model
+/// triangles</param> <param name="bool_opcode">Boolean operation (0 = no op, U
+/// = union, D = difference, I = intersection</param> <param
+/// name="verbose">Print useful info during the process</param>
+/// <param name="num_threads">Number of threads used by the parallel
+/// stages (0 is read as 1)</param> <param name="complex">If not NULL, a
+/// complex that is cleared and filled in place of a new one, so that its
+/// memory is reused</param> <param name="stats">If not NULL, receives the
+/// statistics of the run</param> <param
+/// resulting BSPcomplex structure</returns>
+BSPcomplex *makePolyhedralMesh(double *coords_A, uint32_t npts_A,
+                               uint32_t *tri_idx_A, uint32_t ntri_A,
+                               double *coords_B, uint32_t npts_B,
+                               uint32_t *tri_idx_B, uint32_t ntri_B,
+                               char bool_opcode, bool verbose,
+                               uint32_t num_threads, BSPcomplex *complex,
+                               MeshStats *stats) {
+  return polyhedral_mesh(MeshView(coords_A, npts_A, tri_idx_A, ntri_A),
+                         MeshView(coords_B, npts_B, tri_idx_B, ntri_B),
+                         bool_opcode, verbose, num_threads, complex, true,
+                         stats);
+}
+
+std::unique_ptr<BSPcomplex> makePolyhedralMesh(const MeshView &A,
+                                               const MeshView &B,
+                                               char bool_opcode, bool verbose,
+                                               uint32_t num_threads,
+                                               MeshStats *stats) {
+  return std::unique_ptr<BSPcomplex>(polyhedral_mesh(
+      A, B, bool_opcode, verbose, num_threads, NULL, false, stats));
+}
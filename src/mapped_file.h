@@ -0,0 +1,85 @@
+#ifndef _MAPPED_FILE_
+#define _MAPPED_FILE_
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+  const char *data;
+  size_t size;
+
+  MappedFile() : data(NULL), size(0) {}
+  ~MappedFile() { unmap(); }
+
+  // Returns false if the file cannot be opened or mapped.
+  bool map(const char *filename) {
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER fs;
+    if (!GetFileSizeEx(fh, &fs)) {
+      CloseHandle(fh);
+      return false;
+    }
+    size = (size_t)fs.QuadPart;
+    if (size) {
+      HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mh != NULL) {
+        data = (const char *)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mh);
+      }
+    }
+    CloseHandle(fh);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+    size = (size_t)st.st_size;
+    if (size) {
+      void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data = (const char *)p;
+#ifdef MADV_WILLNEED
+        madvise(p, size, MADV_WILLNEED);
+#endif
+      }
+    }
+    close(fd);
+#endif
+    return (size == 0 || data != NULL);
+  }
+
+  void unmap() {
+    if (data != NULL) {
+#ifdef _WIN32
+      UnmapViewOfFile(data);
+#else
+      munmap((void *)data, size);
+#endif
+    }
+    data = NULL;
+    size = 0;
+  }
+};
+
+#endif /* _MAPPED_FILE_ */
@@ -0,0 +1,965 @@
+#include "mesh_io.h"
+#include "implicit_point.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <cfenv>
+#include <chrono>
+#include <cmath>
+#include <locale>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Seconds elapsed since start_time
+static double elapsed_since(std::chrono::steady_clock::time_point start_time) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_time)
+      .count();
+}
+
+// Blank characters as in the "C" locale isspace().
+inline bool is_blank(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+         c == '\f';
+}
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Returns the end of the token that starts at s (e is the end of the buffer)
+inline const char *token_end(const char *s, const char *e) {
+  while (s < e && !is_blank(*s))
+    s++;
+  return s;
+}
+
+//  Input: token [s, e) of decimal digits with optional '+' sign
+// Output: the value in *v. Returns false if the token is not a valid uint32_t.
+static bool parse_uint32(const char *s, const char *e, uint32_t *v) {
+  if (s < e && *s == '+')
+    s++;
+  if (s == e)
+    return false;
+  uint64_t r = 0;
+  for (; s < e; s++) {
+    if (!is_digit(*s))
+      return false;
+    r = r * 10 + (uint64_t)(*s - '0');
+    if (r > UINT32_MAX)
+      return false;
+  }
+  *v = (uint32_t)r;
+  return true;
+}
+
+//  Input: token [s, e) representing a decimal floating point number
+// Output: the correctly rounded value in *v. Returns false if the token is
+//         not a valid number.
+// Note: does not depend on the current locale. Must run in round-to-nearest
+//       mode. Most numbers written by mesh exporters have at most 15
+//       significant digits and a small exponent, so that the exact result is
+//       a product (or a quotient) of two doubles which IEEE 754 rounds
+//       correctly. Other numbers are converted by the C++ library using the
+//       classic locale.
+static bool parse_double(const char *s, const char *e, double *v) {
+  static const double pow10[23] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *p = s;
+  bool negative = false;
+  if (p < e && (*p == '+' || *p == '-'))
+    negative = (*p++ == '-');
+
+  uint64_t mantissa = 0;
+  int num_digits = 0; // Significant digits accumulated in mantissa
+  int exp10 = 0;
+  bool any_digit = false, truncated = false;
+  for (; p < e && is_digit(*p); p++) {
+    any_digit = true;
+    if (num_digits < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      if (mantissa)
+        num_digits++;
+    } else {
+      exp10++;
+      truncated |= (*p != '0');
+    }
+  }
+  if (p < e && *p == '.')
+    for (p++; p < e && is_digit(*p); p++) {
+      any_digit = true;
+      if (num_digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        if (mantissa)
+          num_digits++;
+        exp10--;
+      } else
+        truncated |= (*p != '0');
+    }
+  if (!any_digit)
+    return false;
+
+  if (p < e && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool exp_negative = false;
+    if (p < e && (*p == '+' || *p == '-'))
+      exp_negative = (*p++ == '-');
+    if (p == e || !is_digit(*p))
+      return false;
+    int ev = 0;
+    for (; p < e && is_digit(*p); p++)
+      if (ev < 100000)
+        ev = ev * 10 + (*p - '0');
+    exp10 += (exp_negative) ? (-ev) : (ev);
+  }
+  if (p != e)
+    return false;
+
+  if (!truncated && mantissa <= (UINT64_C(1) << 53) && exp10 >= -22 &&
+      exp10 <= 22) {
+    double r = (double)mantissa;
+    r = (exp10 < 0) ? (r / pow10[-exp10]) : (r * pow10[exp10]);
+    *v = (negative) ? (-r) : (r);
+    return true;
+  }
+
+  // Uncommon number: let the standard library do the job.
+  std::istringstream ss(std::string(s, e));
+  ss.imbue(std::locale::classic());
+  double r;
+  if (!(ss >> r))
+    return false;
+  *v = r;
+  return true;
+}
+
+//  Input: buffer [b, e) and [cb, ce) subrange of it
+// Output: number of tokens that start within [cb, ce)
+static uint64_t count_tokens(const char *b, const char *cb, const char *ce) {
+  uint64_t n = 0;
+  bool prev_blank = (cb == b) || is_blank(cb[-1]);
+  for (const char *p = cb; p < ce; p++) {
+    const bool blank = is_blank(*p);
+    n += (prev_blank && !blank);
+    prev_blank = blank;
+  }
+  return n;
+}
+
+#define OFF_PARSE_OK 0
+#define OFF_PARSE_BAD_TOKEN 1
+#define OFF_PARSE_NOT_TRIANGLE 2
+#define OFF_PARSE_BAD_INDEX 3
+
+//  Input: buffer [b, e), subrange [cb, ce) and global position of its first
+//         token in the sequence of tokens that follow the OFF header
+// Output: parses the tokens that start within [cb, ce) and writes them into
+//         vertices (3*npts coordinates) and tri_vertices (ntri faces, each
+//         one made of 4 tokens '3 i j k'). Returns one of OFF_PARSE_*.
+static int parse_OFF_tokens(const char *b, const char *e, const char *cb,
+                            const char *ce, uint64_t first_token,
+                            double *vertices, uint32_t npts,
+                            uint32_t *tri_vertices, uint32_t ntri) {
+  const uint64_t num_coords = 3 * (uint64_t)npts;
+  const uint64_t num_tokens = num_coords + 4 * (uint64_t)ntri;
+  uint64_t t = first_token;
+  const char *p = cb;
+  while (p < ce && t < num_tokens) {
+    if (is_blank(*p) || (p != b && !is_blank(p[-1]))) {
+      p++;
+      continue;
+    }
+    const char *te = token_end(p, e);
+    if (t < num_coords) {
+      if (!parse_double(p, te, vertices + t))
+        return OFF_PARSE_BAD_TOKEN;
+    } else {
+      const uint64_t u = t - num_coords;
+      uint32_t val;
+      if (!parse_uint32(p, te, &val))
+        return OFF_PARSE_BAD_TOKEN;
+      if ((u & 3) == 0) {
+        if (val != 3)
+          return OFF_PARSE_NOT_TRIANGLE;
+      } else {
+        if (val >= npts)
+          return OFF_PARSE_BAD_INDEX;
+        tri_vertices[(u >> 2) * 3 + (u & 3) - 1] = val;
+      }
+    }
+    t++;
+    p = te;
+  }
+  return OFF_PARSE_OK;
+}
+
+void read_OFF_file(const char *filename, double **vertices_p, uint32_t *npts,
+                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose,
+                   uint32_t num_threads) {
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+
+  MappedFile file;
+  if (!file.map(filename))
+    ip_error("read_nodes_and_constraints: FATAL ERROR "
+             "cannot open input file.\n");
+
+  const char *b = file.data;
+  const char *e = file.data + file.size;
+
+  // Check OFF mark (1st line).
+  if (file.size < 3 || b[0] != 'O' || b[1] != 'F' || b[2] != 'F')
+    ip_error("read_nodes_and_constraints: FATAL ERROR "
+             "1st line of input file is different from OFF\n");
+
+  // Reading number of points, triangles and edges (edges are ignored).
+  uint32_t header[3];
+  const char *p = b + 3;
+  for (int i = 0; i < 3; i++) {
+    while (p < e && is_blank(*p))
+      p++;
+    const char *te = token_end(p, e);
+    if (!parse_uint32(p, te, header + i))
+      ip_error("read_nodes_and_constraints: FATAL ERROR 2st line of "
+               "input file do not contanins point and triangles numbers.\n");
+    p = te;
+  }
+  *npts = header[0];
+  *ntri = header[1];
+
+  if (verbose)
+    printf("file %s contains %d vertices and %d constraints (triangles)\n",
+           filename, *npts, *ntri);
+
+  *vertices_p = (double *)malloc(sizeof(double) * 3 * (*npts));
+  *tri_vertices_p = (uint32_t *)malloc(sizeof(uint32_t) * 3 * (*ntri));
+  if ((*npts && *vertices_p == NULL) || (*ntri && *tri_vertices_p == NULL))
+    ip_error("read_OFF_file: FATAL ERROR out of memory\n");
+
+  // Split the body into one chunk per thread. A token belongs to the
+  // chunk where it starts, so chunk boundaries can fall anywhere.
+  const char *body = p;
+  const size_t body_size = e - body;
+  const size_t min_chunk_size = 1 << 20;
+  uint32_t num_chunks = (num_threads > 0) ? (num_threads) : (1);
+  if (body_size / min_chunk_size < num_chunks)
+    num_chunks = (uint32_t)(body_size / min_chunk_size) + 1;
+
+  std::vector<const char *> chunk_begin(num_chunks + 1);
+  for (uint32_t i = 0; i < num_chunks; i++)
+    chunk_begin[i] = body + (body_size / num_chunks) * i;
+  chunk_begin[num_chunks] = e;
+
+  // 1st pass: count tokens per chunk to know where each chunk writes.
+  std::vector<uint64_t> first_token(num_chunks + 1, 0);
+  parallel_run(num_chunks, [&](uint32_t i) {
+    first_token[i + 1] = count_tokens(b, chunk_begin[i], chunk_begin[i + 1]);
+  });
+  for (uint32_t i = 0; i < num_chunks; i++)
+    first_token[i + 1] += first_token[i];
+
+  if (first_token[num_chunks] < 3 * (uint64_t)(*npts) + 4 * (uint64_t)(*ntri))
+    ip_error("error reading input file\n");
+
+  // 2nd pass: parse.
+  std::vector<int> result(num_chunks, OFF_PARSE_OK);
+  parallel_run(num_chunks, [&](uint32_t i) {
+    const int rounding = fegetround();
+    fesetround(FE_TONEAREST);
+    result[i] = parse_OFF_tokens(b, e, chunk_begin[i], chunk_begin[i + 1],
+                                 first_token[i], *vertices_p, *npts,
+                                 *tri_vertices_p, *ntri);
+    fesetround(rounding);
+  });
+
+  for (uint32_t i = 0; i < num_chunks; i++)
+    if (result[i] == OFF_PARSE_NOT_TRIANGLE)
+      ip_error("Non-triangular faces not supported\n");
+    else if (result[i] == OFF_PARSE_BAD_INDEX)
+      ip_error("read_OFF_file: FATAL ERROR vertex index out of range\n");
+    else if (result[i] != OFF_PARSE_OK)
+      ip_error("error reading input file\n");
+
+  if (verbose)
+    printf("\tParsing: %f s (%u threads)\n", elapsed_since(start_time),
+           num_chunks);
+}
+
+// Little-endian loads from unaligned memory (independent of host byte order)
+inline uint16_t load_le16(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return (uint16_t)(u[0] | (u[1] << 8));
+}
+
+inline uint32_t load_le32(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) |
+         ((uint32_t)u[3] << 24);
+}
+
+inline uint64_t load_le64(const char *p) {
+  return (uint64_t)load_le32(p) | ((uint64_t)load_le32(p + 4) << 32);
+}
+
+inline float load_le_float(const char *p) {
+  const uint32_t u = load_le32(p);
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline double load_le_double(const char *p) {
+  const uint64_t u = load_le64(p);
+  double d;
+  memcpy(&d, &u, sizeof(d));
+  return d;
+}
+
+inline uint64_t hash64(uint64_t k) {
+  k ^= k >> 33;
+  k *= UINT64_C(0xff51afd7ed558ccd);
+  k ^= k >> 33;
+  k *= UINT64_C(0xc4ceb9fe1a85ec53);
+  k ^= k >> 33;
+  return k;
+}
+
+inline uint64_t hash_float3(const float *c) {
+  uint32_t u[3];
+  memcpy(u, c, sizeof(u));
+  return hash64(((uint64_t)u[0] << 32 | u[1]) ^ hash64(u[2]));
+}
+
+// Open addressing (linear probing) hash table that merges vertices with
+// identical coordinates. Slots store vertex index + 1 (0 = empty slot).
+class VertexWelder {
+public:
+  std::vector<float> coords; // 3 coordinates per unique vertex
+  std::vector<uint32_t> slots;
+  uint64_t mask;
+
+  VertexWelder(uint64_t expected_vertices) {
+    uint64_t n = 1024;
+    while (n < 2 * expected_vertices)
+      n <<= 1;
+    slots.assign(n, 0);
+    mask = n - 1;
+    coords.reserve(3 * expected_vertices);
+  }
+
+  // Returns the index of the vertex having coordinates c[0], c[1], c[2],
+  // adding a new vertex if necessary.
+  uint32_t weld(const float *c) {
+    uint64_t h = hash_float3(c) & mask;
+    for (;; h = (h + 1) & mask) {
+      const uint32_t s = slots[h];
+      if (s == 0)
+        break;
+      const float *v = coords.data() + 3 * (uint64_t)(s - 1);
+      if (v[0] == c[0] && v[1] == c[1] && v[2] == c[2])
+        return s - 1;
+    }
+
+    const uint32_t nv = (uint32_t)(coords.size() / 3);
+    coords.insert(coords.end(), c, c + 3);
+    slots[h] = nv + 1;
+    if (2 * (uint64_t)(nv + 1) > slots.size())
+      grow();
+    return nv;
+  }
+
+  void grow() {
+    slots.assign(slots.size() * 2, 0);
+    mask = slots.size() - 1;
+    const uint32_t nv = (uint32_t)(coords.size() / 3);
+    for (uint32_t i = 0; i < nv; i++) {
+      uint64_t h = hash_float3(coords.data() + 3 * (uint64_t)i) & mask;
+      while (slots[h])
+        h = (h + 1) & mask;
+      slots[h] = i + 1;
+    }
+  }
+};
+
+void read_STL_file(const char *filename, double **vertices_p, uint32_t *npts,
+                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose) {
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+
+  MappedFile file;
+  if (!file.map(filename))
+    ip_error("read_STL_file: FATAL ERROR cannot open input file.\n");
+
+  // Binary STL: 80 bytes header, number of facets, then 50 bytes per facet
+  // (normal, 3 vertices, attribute byte count).
+  const uint64_t facet_size = 50;
+  if (file.size < 84)
+    ip_error("read_STL_file: FATAL ERROR input file is not a binary STL\n");
+  const uint32_t nf = load_le32(file.data + 80);
+  if (file.size < 84 + facet_size * nf ||
+      (file.size != 84 + facet_size * nf && !strncmp(file.data, "solid", 5)))
+    ip_error("read_STL_file: FATAL ERROR ASCII STL files are not supported\n");
+
+  *ntri = nf;
+  *tri_vertices_p = (uint32_t *)malloc(sizeof(uint32_t) * 3 * (*ntri));
+  if (*ntri && *tri_vertices_p == NULL)
+    ip_error("read_STL_file: FATAL ERROR out of memory\n");
+
+  // Closed meshes have about half as many vertices as facets.
+  VertexWelder welder(nf / 2 + 1);
+  const char *facet = file.data + 84;
+  for (uint32_t i = 0; i < nf; i++, facet += facet_size)
+    for (int j = 0; j < 3; j++) {
+      float c[3];
+      for (int k = 0; k < 3; k++) {
+        c[k] = load_le_float(facet + 12 + 12 * j + 4 * k);
+        if (c[k] == 0.0f)
+          c[k] = 0.0f; // -0 and +0 must be the same vertex
+      }
+      (*tri_vertices_p)[3 * (uint64_t)i + j] = welder.weld(c);
+    }
+
+  *npts = (uint32_t)(welder.coords.size() / 3);
+  *vertices_p = (double *)malloc(sizeof(double) * 3 * (*npts));
+  if (*npts && *vertices_p == NULL)
+    ip_error("read_STL_file: FATAL ERROR out of memory\n");
+  for (size_t i = 0; i < welder.coords.size(); i++)
+    (*vertices_p)[i] = welder.coords[i];
+
+  if (verbose) {
+    printf("file %s contains %d vertices and %d constraints (triangles)\n",
+           filename, *npts, *ntri);
+    printf("\tParsing: %f s\n", elapsed_since(start_time));
+  }
+}
+
+// Scalar types allowed in PLY property declarations.
+#define PLY_INT8 0
+#define PLY_UINT8 1
+#define PLY_INT16 2
+#define PLY_UINT16 3
+#define PLY_INT32 4
+#define PLY_UINT32 5
+#define PLY_FLOAT32 6
+#define PLY_FLOAT64 7
+#define PLY_INVALID 8
+
+static int ply_type(const std::string &name) {
+  static const char *names[] = {"char",  "uchar",  "short",   "ushort",
+                                "int",   "uint",   "float",   "double",
+                                "int8",  "uint8",  "int16",   "uint16",
+                                "int32", "uint32", "float32", "float64"};
+  for (int i = 0; i < 16; i++)
+    if (name == names[i])
+      return i % 8;
+  return PLY_INVALID;
+}
+
+inline size_t ply_type_size(int type) {
+  static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+  return sizes[type];
+}
+
+inline double ply_load_double(const char *p, int type) {
+  switch (type) {
+  case PLY_INT8:
+    return (double)(int8_t)p[0];
+  case PLY_UINT8:
+    return (double)(uint8_t)p[0];
+  case PLY_INT16:
+    return (double)(int16_t)load_le16(p);
+  case PLY_UINT16:
+    return (double)load_le16(p);
+  case PLY_INT32:
+    return (double)(int32_t)load_le32(p);
+  case PLY_UINT32:
+    return (double)load_le32(p);
+  case PLY_FLOAT32:
+    return (double)load_le_float(p);
+  default:
+    return load_le_double(p);
+  }
+}
+
+// Integer value of a list count or index. Negative values become
+// UINT64_MAX, so that they are caught by the range checks of the caller.
+inline uint64_t ply_load_uint(const char *p, int type) {
+  switch (type) {
+  case PLY_INT8:
+    return (p[0] < 0) ? UINT64_MAX : (uint64_t)p[0];
+  case PLY_UINT8:
+    return (uint8_t)p[0];
+  case PLY_INT16:
+    return ((int16_t)load_le16(p) < 0) ? UINT64_MAX : load_le16(p);
+  case PLY_UINT16:
+    return load_le16(p);
+  case PLY_INT32:
+    return ((int32_t)load_le32(p) < 0) ? UINT64_MAX : load_le32(p);
+  case PLY_UINT32:
+    return load_le32(p);
+  default: // Non-integer types are not allowed for counts and indexes
+    return UINT64_MAX;
+  }
+}
+
+struct ply_property_t {
+  std::string name;
+  int type;       // Scalar type, or type of list items
+  int count_type; // PLY_INVALID for scalar properties
+};
+
+struct ply_element_t {
+  std::string name;
+  uint64_t count;
+  std::vector<ply_property_t> properties;
+};
+
+//  Input: value of property pr starting at p, end of buffer e
+// Output: pointer past the value, NULL if the buffer is too short
+static const char *ply_skip_property(const ply_property_t &pr, const char *p,
+                                     const char *e) {
+  if (pr.count_type == PLY_INVALID)
+    return ((size_t)(e - p) < ply_type_size(pr.type))
+               ? (NULL)
+               : (p + ply_type_size(pr.type));
+
+  if ((size_t)(e - p) < ply_type_size(pr.count_type))
+    return NULL;
+  const uint64_t n = ply_load_uint(p, pr.count_type);
+  p += ply_type_size(pr.count_type);
+  if (n == UINT64_MAX || (uint64_t)(e - p) / ply_type_size(pr.type) < n)
+    return NULL;
+  return p + n * ply_type_size(pr.type);
+}
+
+// Same as above for a whole element record
+static const char *ply_skip_record(const ply_element_t &el, const char *p,
+                                   const char *e) {
+  for (size_t k = 0; k < el.properties.size() && p != NULL; k++)
+    p = ply_skip_property(el.properties[k], p, e);
+  return p;
+}
+
+void read_PLY_file(const char *filename, double **vertices_p, uint32_t *npts,
+                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose,
+                   uint32_t num_threads) {
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+
+  MappedFile file;
+  if (!file.map(filename))
+    ip_error("read_PLY_file: FATAL ERROR cannot open input file.\n");
+
+  const char *b = file.data;
+  const char *e = file.data + file.size;
+
+  // Parse the header line by line.
+  std::vector<ply_element_t> elements;
+  const char *p = b;
+  bool magic = false, format = false, end_header = false;
+  while (p < e && !end_header) {
+    const char *le = p;
+    while (le < e && *le != '\n')
+      le++;
+    std::istringstream line(std::string(p, le));
+    line.imbue(std::locale::classic());
+    p = (le < e) ? (le + 1) : (le);
+
+    std::string key;
+    line >> key;
+    if (!magic) {
+      if (key != "ply")
+        break;
+      magic = true;
+    } else if (key == "format") {
+      std::string f;
+      line >> f;
+      if (f != "binary_little_endian")
+        ip_error("read_PLY_file: FATAL ERROR only binary little-endian PLY "
+                 "files are supported\n");
+      format = true;
+    } else if (key == "element") {
+      ply_element_t el;
+      if (!(line >> el.name >> el.count))
+        ip_error("read_PLY_file: FATAL ERROR invalid element declaration\n");
+      elements.push_back(el);
+    } else if (key == "property") {
+      ply_property_t pr;
+      std::string t;
+      line >> t;
+      if (t == "list") {
+        std::string ct;
+        line >> ct >> t;
+        pr.count_type = ply_type(ct);
+        if (pr.count_type == PLY_INVALID)
+          ip_error("read_PLY_file: FATAL ERROR invalid property type\n");
+      } else
+        pr.count_type = PLY_INVALID;
+      pr.type = ply_type(t);
+      line >> pr.name;
+      if (pr.type == PLY_INVALID || elements.empty())
+        ip_error("read_PLY_file: FATAL ERROR invalid property declaration\n");
+      elements.back().properties.push_back(pr);
+    } else if (key == "end_header")
+      end_header = true;
+    // Comments, obj_info and unknown keywords are ignored.
+  }
+  if (!magic || !end_header)
+    ip_error("read_PLY_file: FATAL ERROR input file is not a PLY\n");
+  if (!format)
+    ip_error("read_PLY_file: FATAL ERROR missing format declaration\n");
+
+  bool vertices_read = false, faces_read = false;
+  *npts = *ntri = 0;
+  *vertices_p = NULL;
+  *tri_vertices_p = NULL;
+
+  for (const ply_element_t &el : elements) {
+    if (el.name == "vertex" && !vertices_read) {
+      // Vertex records have fixed size: convert them in parallel.
+      size_t stride = 0, offset[3] = {0, 0, 0};
+      int type[3] = {PLY_INVALID, PLY_INVALID, PLY_INVALID};
+      for (const ply_property_t &pr : el.properties) {
+        if (pr.count_type != PLY_INVALID)
+          ip_error("read_PLY_file: FATAL ERROR list properties of vertices "
+                   "are not supported\n");
+        for (int c = 0; c < 3; c++)
+          if (pr.name == std::string(1, (char)('x' + c))) {
+            offset[c] = stride;
+            type[c] = pr.type;
+          }
+        stride += ply_type_size(pr.type);
+      }
+      if (type[0] == PLY_INVALID || type[1] == PLY_INVALID ||
+          type[2] == PLY_INVALID)
+        ip_error("read_PLY_file: FATAL ERROR missing vertex coordinates\n");
+      if (el.count > UINT32_MAX || (uint64_t)(e - p) / stride < el.count)
+        ip_error("error reading input file\n");
+
+      *npts = (uint32_t)el.count;
+      *vertices_p = (double *)malloc(sizeof(double) * 3 * (*npts));
+      if (*npts && *vertices_p == NULL)
+        ip_error("read_PLY_file: FATAL ERROR out of memory\n");
+
+      const char *records = p;
+      double *coords = *vertices_p;
+      const uint32_t num_jobs =
+          (*npts < (1 << 16) || num_threads == 0) ? 1 : num_threads;
+      parallel_run(num_jobs, [&](uint32_t j) {
+        const uint64_t begin = (el.count * j) / num_jobs;
+        const uint64_t end = (el.count * (j + 1)) / num_jobs;
+        for (uint64_t i = begin; i < end; i++)
+          for (int c = 0; c < 3; c++)
+            coords[3 * i + c] =
+                ply_load_double(records + i * stride + offset[c], type[c]);
+      });
+      p += el.count * stride;
+      vertices_read = true;
+    } else if (el.name == "face" && !faces_read) {
+      if (el.count > UINT32_MAX)
+        ip_error("error reading input file\n");
+      *ntri = (uint32_t)el.count;
+      *tri_vertices_p = (uint32_t *)malloc(sizeof(uint32_t) * 3 * (*ntri));
+      if (*ntri && *tri_vertices_p == NULL)
+        ip_error("read_PLY_file: FATAL ERROR out of memory\n");
+
+      int list_id = -1;
+      for (size_t k = 0; k < el.properties.size(); k++)
+        if (el.properties[k].count_type != PLY_INVALID &&
+            (el.properties[k].name == "vertex_indices" ||
+             el.properties[k].name == "vertex_index"))
+          list_id = (int)k;
+      if (list_id < 0)
+        ip_error("read_PLY_file: FATAL ERROR missing face vertex indexes\n");
+
+      for (uint64_t i = 0; i < el.count; i++) {
+        for (int k = 0; k < (int)el.properties.size(); k++) {
+          const ply_property_t &pr = el.properties[k];
+          if (k != list_id) {
+            if ((p = ply_skip_property(pr, p, e)) == NULL)
+              ip_error("error reading input file\n");
+            continue;
+          }
+          const size_t cs = ply_type_size(pr.count_type);
+          const size_t is = ply_type_size(pr.type);
+          if ((size_t)(e - p) < cs)
+            ip_error("error reading input file\n");
+          if (ply_load_uint(p, pr.count_type) != 3)
+            ip_error("Non-triangular faces not supported\n");
+          p += cs;
+          if ((size_t)(e - p) < 3 * is)
+            ip_error("error reading input file\n");
+          // Indexes are range checked when all the elements are read.
+          for (int c = 0; c < 3; c++, p += is) {
+            const uint64_t idx = ply_load_uint(p, pr.type);
+            (*tri_vertices_p)[3 * i + c] =
+                (idx > UINT32_MAX) ? (UINT32_MAX) : ((uint32_t)idx);
+          }
+        }
+      }
+      faces_read = true;
+    } else {
+      for (uint64_t i = 0; i < el.count; i++)
+        if ((p = ply_skip_record(el, p, e)) == NULL)
+          ip_error("error reading input file\n");
+    }
+  }
+
+  if (!vertices_read || !faces_read)
+    ip_error("read_PLY_file: FATAL ERROR missing vertex or face element\n");
+  for (uint64_t i = 0; i < 3 * (uint64_t)(*ntri); i++)
+    if ((*tri_vertices_p)[i] >= *npts)
+      ip_error("read_PLY_file: FATAL ERROR vertex index out of range\n");
+
+  if (verbose) {
+    printf("file %s contains %d vertices and %d constraints (triangles)\n",
+           filename, *npts, *ntri);
+    printf("\tParsing: %f s\n", elapsed_since(start_time));
+  }
+}
+
+// Returns true if filename ends with ext (case insensitive)
+static bool has_extension(const char *filename, const char *ext) {
+  const size_t fl = strlen(filename), el = strlen(ext);
+  if (fl < el)
+    return false;
+  for (size_t i = 0; i < el; i++)
+    if (tolower((unsigned char)filename[fl - el + i]) != ext[i])
+      return false;
+  return true;
+}
+
+void read_mesh_file(const char *filename, double **vertices_p, uint32_t *npts,
+                    uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose,
+                    uint32_t num_threads) {
+  TRACE_SPAN("read");
+  if (has_extension(filename, ".stl"))
+    read_STL_file(filename, vertices_p, npts, tri_vertices_p, ntri, verbose);
+  else if (has_extension(filename, ".ply"))
+    read_PLY_file(filename, vertices_p, npts, tri_vertices_p, ntri, verbose,
+                  num_threads);
+  else
+    read_OFF_file(filename, vertices_p, npts, tri_vertices_p, ntri, verbose,
+                  num_threads);
+}
+
+//-----------------------------------------------------------------------------
+// Output writers
+//-----------------------------------------------------------------------------
+
+// Number of records buffered by the binary writers before each fwrite
+#define MSH_CHUNK 65536
+
+// Writes count items of size bytes to f.
+static void msh_write(FILE *f, const void *data, size_t size, size_t count) {
+  if (count && fwrite(data, size, count, f) != count)
+    ip_error("save_MSH_file: FATAL ERROR cannot write the file\n");
+}
+
+void save_MSH_file(const char *filename, const double *coords, uint64_t npts,
+                   const uint32_t *tets, uint64_t ntets,
+                   const uint64_t *tet_cell) {
+  FILE *f = fopen(filename, "wb");
+  if (f == NULL)
+    ip_error("save_MSH_file: FATAL ERROR cannot open the file\n");
+
+  const int one = 1; // Tells the reader the endianness
+  fprintf(f, "$MeshFormat\n4.1 1 %d\n", (int)sizeof(size_t));
+  msh_write(f, &one, sizeof(int), 1);
+  fprintf(f, "\n$EndMeshFormat\n");
+
+  // A single volume holds all the nodes and elements.
+  double bbox[6] = {0, 0, 0, 0, 0, 0};
+  for (uint64_t i = 0; i < npts; i++)
+    for (int j = 0; j < 3; j++) {
+      const double x = coords[3 * i + j];
+      if (i == 0 || x < bbox[j])
+        bbox[j] = x;
+      if (i == 0 || x > bbox[j + 3])
+        bbox[j + 3] = x;
+    }
+  const size_t num_entities[4] = {0, 0, 0, 1}; // Points, curves, surfaces...
+  const int volume_tag = 1;
+  const size_t volume_lists[2] = {0, 0}; // No physical tags, no boundary
+  fprintf(f, "$Entities\n");
+  msh_write(f, num_entities, sizeof(size_t), 4);
+  msh_write(f, &volume_tag, sizeof(int), 1);
+  msh_write(f, bbox, sizeof(double), 6);
+  msh_write(f, volume_lists, sizeof(size_t), 2);
+  fprintf(f, "\n$EndEntities\n");
+
+  // Nodes: tags are 1, ..., npts.
+  std::vector<size_t> buf(5 * MSH_CHUNK);
+  const size_t nodes_header[4] = {1, npts, (npts > 0) ? (size_t)1 : (size_t)0,
+                                  npts};
+  const int nodes_block[3] = {3, volume_tag, 0}; // Dim, tag, parametric
+  fprintf(f, "$Nodes\n");
+  msh_write(f, nodes_header, sizeof(size_t), 4);
+  msh_write(f, nodes_block, sizeof(int), 3);
+  msh_write(f, &nodes_header[1], sizeof(size_t), 1);
+  for (uint64_t i = 0; i < npts; i += MSH_CHUNK) {
+    const size_t n = (size_t)std::min<uint64_t>(MSH_CHUNK, npts - i);
+    for (size_t j = 0; j < n; j++)
+      buf[j] = i + j + 1;
+    msh_write(f, buf.data(), sizeof(size_t), n);
+  }
+  msh_write(f, coords, sizeof(double), 3 * npts);
+  fprintf(f, "\n$EndNodes\n");
+
+  // Elements: 4-node tetrahedra (type 4) with tags 1, ..., ntets.
+  const size_t elements_header[4] = {1, ntets,
+                                     (ntets > 0) ? (size_t)1 : (size_t)0,
+                                     ntets};
+  const int elements_block[3] = {3, volume_tag, 4}; // Dim, tag, type
+  fprintf(f, "$Elements\n");
+  msh_write(f, elements_header, sizeof(size_t), 4);
+  msh_write(f, elements_block, sizeof(int), 3);
+  msh_write(f, &elements_header[1], sizeof(size_t), 1);
+  for (uint64_t i = 0; i < ntets; i += MSH_CHUNK) {
+    const size_t n = (size_t)std::min<uint64_t>(MSH_CHUNK, ntets - i);
+    for (size_t j = 0; j < n; j++) {
+      buf[5 * j] = i + j + 1;
+      for (int k = 0; k < 4; k++)
+        buf[5 * j + k + 1] = (size_t)tets[4 * (i + j) + k] + 1;
+    }
+    msh_write(f, buf.data(), sizeof(size_t), 5 * n);
+  }
+  fprintf(f, "\n$EndElements\n");
+
+  // Element data: one value per tetrahedron, stored after its tag.
+  if (tet_cell != NULL) {
+    fprintf(f, "$ElementData\n1\n\"cell\"\n1\n0\n3\n0\n1\n%llu\n",
+            (unsigned long long)ntets);
+    char *rec = (char *)buf.data();
+    const size_t rec_size = sizeof(size_t) + sizeof(double);
+    for (uint64_t i = 0; i < ntets; i += MSH_CHUNK) {
+      const size_t n = (size_t)std::min<uint64_t>(MSH_CHUNK, ntets - i);
+      for (size_t j = 0; j < n; j++) {
+        const size_t tag = i + j + 1;
+        const double value = (double)tet_cell[i + j];
+        memcpy(rec + j * rec_size, &tag, sizeof(size_t));
+        memcpy(rec + j * rec_size + sizeof(size_t), &value, sizeof(double));
+      }
+      msh_write(f, rec, rec_size, n);
+    }
+    fprintf(f, "\n$EndElementData\n");
+  }
+
+  if (fclose(f) != 0)
+    ip_error("save_MSH_file: FATAL ERROR cannot write the file\n");
+}
+
+// Number of records formatted by each thread of the text writers before the
+// buffers are written
+#define OFF_CHUNK 65536
+
+//  Input: buffer: s (at least 32 chars), double: x.
+// Output: writes to s the shortest decimal representation of x that reads
+//         back as x, returns the end of the written characters.
+// Note. A decimal with up to 15 significant digits is recovered from its
+//       nearest double: if the 15 digits representation reads back as x
+//       (trailing zeros are dropped) it is also the shortest one.
+//       Does not depend on the current locale, as parse_double: the decimal
+//       point of the locale is replaced by '.'. Must run in round-to-nearest
+//       mode, as parse_double.
+static char *format_double(char *s, double x) {
+  char tmp[64];
+  char *e = s;
+  for (int prec = 15; prec <= 17; prec++) {
+    snprintf(tmp, sizeof(tmp), "%.*g", prec, x);
+    e = s;
+    for (const char *p = tmp; *p != '\0';)
+      if (is_digit(*p) || *p == '-' || *p == '+' || *p == 'e' ||
+          *p == 'E' || !std::isfinite(x))
+        *e++ = *p++;
+      else { // Decimal point, possibly of several bytes
+        *e++ = '.';
+        while (*p != '\0' && !is_digit(*p))
+          p++;
+      }
+    double y;
+    if (prec == 17 || (parse_double(s, e, &y) && y == x))
+      break;
+  }
+  return e;
+}
+
+//  Input: buffer: s (at least 20 chars), unsigned integer: v.
+// Output: writes v to s, returns the end of the written characters.
+static char *format_uint(char *s, uint64_t v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n)
+    *s++ = digits[--n];
+  return s;
+}
+
+void save_OFF_file(const char *filename, const double *coords, uint64_t npts,
+                   const uint64_t *face_start, uint64_t nfaces,
+                   const uint32_t *face_vrts, uint32_t num_threads) {
+  if (num_threads == 0)
+    num_threads = 1;
+  FILE *f = fopen(filename, "wb");
+  if (f == NULL)
+    ip_error("save_OFF_file: FATAL ERROR cannot open the file\n");
+
+  fprintf(f, "OFF\n%llu %llu 0\n", (unsigned long long)npts,
+          (unsigned long long)nfaces);
+
+  // Records (vertices, then faces) are formatted in rounds: every thread
+  // fills its buffer with OFF_CHUNK consecutive records, then the buffers
+  // are written in order.
+  std::vector<std::vector<char>> bufs(num_threads);
+  const uint64_t num_records = npts + nfaces;
+  const uint64_t round = (uint64_t)num_threads * OFF_CHUNK;
+  for (uint64_t r = 0; r < num_records; r += round) {
+    parallel_run(num_threads, [&](uint32_t t) {
+      const int rounding = fegetround();
+      fesetround(FE_TONEAREST);
+      std::vector<char> &buf = bufs[t];
+      buf.clear();
+      const uint64_t begin =
+          std::min(num_records, r + (uint64_t)t * OFF_CHUNK);
+      const uint64_t end = std::min(num_records, begin + OFF_CHUNK);
+      for (uint64_t i = begin; i < end; i++) {
+        const size_t len = buf.size();
+        char *s;
+        if (i < npts) {
+          buf.resize(len + 3 * 32);
+          s = buf.data() + len;
+          for (int j = 0; j < 3; j++) {
+            s = format_double(s, coords[3 * i + j]);
+            *s++ = (j < 2) ? ' ' : '\n';
+          }
+        } else {
+          const uint64_t *fs = face_start + (i - npts);
+          buf.resize(len + 21 * (fs[1] - fs[0] + 1));
+          s = format_uint(buf.data() + len, fs[1] - fs[0]);
+          for (uint64_t j = fs[0]; j < fs[1]; j++) {
+            *s++ = ' ';
+            s = format_uint(s, face_vrts[j]);
+          }
+          *s++ = '\n';
+        }
+        buf.resize(s - buf.data());
+      }
+      fesetround(rounding);
+    });
+
+    for (const std::vector<char> &buf : bufs)
+      if (!buf.empty() && fwrite(buf.data(), 1, buf.size(), f) != buf.size())
+        ip_error("save_OFF_file: FATAL ERROR cannot write the file\n");
+  }
+
+  if (fclose(f) != 0)
+    ip_error("save_OFF_file: FATAL ERROR cannot write the file\n");
+}
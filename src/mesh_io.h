@@ -0,0 +1,56 @@
+#ifndef _MESH_IO_
+#define _MESH_IO_
+
+#include <stdint.h>
+
+// Input readers. All of them fill the serialized arrays consumed by
+// makePolyhedralMesh: vertex coordinates (x0 y0 z0 x1 y1 z1 ...) and
+// triangle vertex indexes (a0 b0 c0 a1 b1 c1 ...). Both arrays are
+// allocated with malloc and ownership passes to the caller.
+
+// Reads a triangle mesh from an ASCII OFF file.
+// The file is memory mapped and parsed by up to num_threads threads.
+void read_OFF_file(const char *filename, double **vertices_p, uint32_t *npts,
+                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose,
+                   uint32_t num_threads = 1);
+
+// Reads a triangle mesh from a binary STL file. Facets store their own
+// copies of the vertices: copies with identical coordinates are merged
+// while loading, so that the result is an indexed mesh.
+void read_STL_file(const char *filename, double **vertices_p, uint32_t *npts,
+                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose);
+
+// Reads a triangle mesh from a binary little-endian PLY file. Large vertex
+// lists are converted by up to num_threads threads.
+void read_PLY_file(const char *filename, double **vertices_p, uint32_t *npts,
+                   uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose,
+                   uint32_t num_threads = 1);
+
+// Calls the reader that corresponds to the file extension
+// (.stl, .ply, anything else is read as OFF), with up to num_threads
+// threads.
+void read_mesh_file(const char *filename, double **vertices_p, uint32_t *npts,
+                    uint32_t **tri_vertices_p, uint32_t *ntri, bool verbose,
+                    uint32_t num_threads = 1);
+
+// Output writers.
+
+// Writes a tetrahedral mesh to a binary Gmsh MSH 4.1 file: vertex coordinates
+// (x0 y0 z0 x1 y1 z1 ...) and tetrahedra vertex indexes (a0 b0 c0 d0 a1 ...),
+// with positive orientation. If tet_cell is not NULL, the value tet_cell[i]
+// of each tetrahedron i is saved too, as element data named "cell".
+void save_MSH_file(const char *filename, const double *coords, uint64_t npts,
+                   const uint32_t *tets, uint64_t ntets,
+                   const uint64_t *tet_cell);
+
+// Writes a polygon mesh to an ASCII OFF file: vertex coordinates
+// (x0 y0 z0 x1 y1 z1 ...) and the vertex indexes of the faces one after the
+// other, face i being face_vrts[face_start[i]], ...,
+// face_vrts[face_start[i + 1] - 1]. Records are formatted by num_threads
+// threads; coordinates are printed with the shortest representation that
+// reads back exactly.
+void save_OFF_file(const char *filename, const double *coords, uint64_t npts,
+                   const uint64_t *face_start, uint64_t nfaces,
+                   const uint32_t *face_vrts, uint32_t num_threads);
+
+#endif /* _MESH_IO_ */
@@ -0,0 +1,141 @@
+#include "mesh_stats.h"
+#include "implicit_point.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+// windows.h first
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+double process_cpu_time() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    return 0;
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  return (double)(k.QuadPart + u.QuadPart) * 1e-7; // 100 ns units
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return 0;
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+         (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+uint64_t process_peak_rss() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return 0;
+  return (uint64_t)pmc.PeakWorkingSetSize;
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return 0;
+#ifdef __APPLE__
+  return (uint64_t)ru.ru_maxrss; // bytes
+#else
+  return (uint64_t)ru.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+StageTime MeshStats::total() const {
+  StageTime t;
+  t.name = "total";
+  t.wall = t.cpu = 0;
+  for (const StageTime &s : stages) {
+    t.wall += s.wall;
+    t.cpu += s.cpu;
+    t.predicates += s.predicates;
+  }
+  return t;
+}
+
+//  Input: open file: f, predicate counts: c.
+// Output: writes the non-zero counts as a JSON array. static_filter is
+//         only written for the classes that have static filters.
+static void save_predicates_JSON(FILE *f, const PredicateCounts &c) {
+  fprintf(f, "[");
+  bool first = true;
+  for (int k = 0; k < PRED_NUM_KINDS; k++)
+    for (int t = 0; t < PRED_NUM_TYPES; t++)
+      if (c.calls[k][t]) {
+        fprintf(f,
+                "%s\n      {\"predicate\": \"%s\", \"type\": \"%s\", "
+                "\"calls\": %llu, \"degenerate\": %llu",
+                (first) ? ("") : (","), PredicateCounts::kindName(k),
+                PredicateCounts::typeName(t),
+                (unsigned long long)c.calls[k][t],
+                (unsigned long long)c.degenerate[k][t]);
+        if (PredicateCounts::hasStaticFilter(k, t))
+          fprintf(f, ", \"static_filter\": %llu",
+                  (unsigned long long)c.static_filter[k][t]);
+        fprintf(f, "}");
+        first = false;
+      }
+  fprintf(f, "%s]", (first) ? ("") : ("\n    "));
+}
+
+void MeshStats::saveJSON(const char *filename) const {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    ip_error("MeshStats::saveJSON: FATAL ERROR cannot open the file\n");
+
+  const StageTime t = total();
+  fprintf(f, "{\n  \"num_threads\": %u,\n", num_threads);
+  fprintf(f, "  \"peak_rss_bytes\": %llu,\n", (unsigned long long)peak_rss);
+  fprintf(f, "  \"wall_s\": %.6f,\n  \"cpu_s\": %.6f,\n", t.wall, t.cpu);
+
+  fprintf(f, "  \"stages\": [");
+  for (size_t i = 0; i < stages.size(); i++) {
+    fprintf(f, "%s\n    {\"name\": \"%s\", \"wall_s\": %.6f, \"cpu_s\": %.6f",
+            (i) ? (",") : (""), stages[i].name, stages[i].wall,
+            stages[i].cpu);
+#ifdef PREDICATE_COUNTERS
+    fprintf(f, ",\n     \"predicates\": ");
+    save_predicates_JSON(f, stages[i].predicates);
+#endif
+    fprintf(f, "}");
+  }
+  fprintf(f, "\n  ],\n");
+
+  const struct {
+    const char *name;
+    uint64_t value;
+  } counts[] = {{"input_vertices", input_vertices},
+                {"input_triangles", input_triangles},
+                {"vertices", vertices},
+                {"constraints", constraints},
+                {"virtual_constraints", virtual_constraints},
+                {"initial_cells", initial_cells},
+                {"final_cells", final_cells},
+                {"faces", faces},
+                {"grey_faces", grey_faces},
+                {"lpi_vertices", lpi_vertices},
+                {"tpi_vertices", tpi_vertices}};
+  const size_t num_counts = sizeof(counts) / sizeof(counts[0]);
+  fprintf(f, "  \"counts\": {");
+  for (size_t i = 0; i < num_counts; i++)
+    fprintf(f, "%s\n    \"%s\": %llu", (i) ? (",") : (""), counts[i].name,
+            (unsigned long long)counts[i].value);
+  fprintf(f, "\n  }\n}\n");
+
+  if (fclose(f) != 0)
+    ip_error("MeshStats::saveJSON: FATAL ERROR cannot write the file\n");
+}
@@ -0,0 +1,98 @@
+#ifndef _MESH_STATS_
+#define _MESH_STATS_
+
+#include "predicate_counters.h"
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+// CPU time used by the process so far (all its threads), in seconds.
+double process_cpu_time();
+
+// Peak resident memory of the process so far, in bytes (0 if unknown).
+uint64_t process_peak_rss();
+
+// Wall-clock and CPU time spent in a stage, in seconds, and the predicates
+// called (see predicate_counters.h).
+struct StageTime {
+  const char *name;
+  double wall, cpu;
+  PredicateCounts predicates;
+};
+
+// Measures the time spent between consecutive laps.
+class StageClock {
+  std::chrono::steady_clock::time_point wall0;
+  double cpu0;
+  PredicateCounts predicates0;
+
+public:
+  StageClock() { restart(); }
+
+  void restart() {
+    wall0 = std::chrono::steady_clock::now();
+    cpu0 = process_cpu_time();
+    predicates0 = predicate_counts();
+  }
+
+  // Returns the time elapsed since the last lap (or restart), and restarts.
+  StageTime lap(const char *name) {
+    const std::chrono::steady_clock::time_point wall1 =
+        std::chrono::steady_clock::now();
+    const double cpu1 = process_cpu_time();
+    const PredicateCounts predicates1 = predicate_counts();
+    StageTime t;
+    t.name = name;
+    t.wall = std::chrono::duration<double>(wall1 - wall0).count();
+    t.cpu = cpu1 - cpu0;
+    t.predicates = predicates1;
+    t.predicates -= predicates0;
+    wall0 = wall1;
+    cpu0 = cpu1;
+    predicates0 = predicates1;
+    return t;
+  }
+};
+
+// Statistics of a run: the time of each stage, the peak memory, and the
+// sizes of the intermediate structures. CPU times and the peak memory are
+// those of the whole process, so they include the work of other threads
+// (e.g. concurrent meshing jobs).
+struct MeshStats {
+  std::vector<StageTime> stages;
+  uint64_t peak_rss;
+  uint32_t num_threads;
+
+  uint64_t input_vertices;      // Vertices of the input model(s)
+  uint64_t input_triangles;     // Triangles of the input model(s)
+  uint64_t vertices;            // Unique vertices
+  uint64_t constraints;         // Non-degenerate constraints
+  uint64_t virtual_constraints; // Constraints added to close open boundaries
+  uint64_t initial_cells;       // Tetrahedra of the Delaunay mesh
+  uint64_t final_cells;         // Cells after the subdivision
+  uint64_t faces;               // Faces after the subdivision
+  uint64_t grey_faces;          // Faces coloured by the in/out tests
+  uint64_t lpi_vertices;        // Implicit vertices: line-plane intersections
+  uint64_t tpi_vertices;        // Implicit vertices: three-plane intersections
+
+  MeshStats()
+      : peak_rss(0), num_threads(1), input_vertices(0), input_triangles(0),
+        vertices(0), constraints(0), virtual_constraints(0),
+        initial_cells(0), final_cells(0), faces(0), grey_faces(0),
+        lpi_vertices(0), tpi_vertices(0) {}
+
+  // Appends the stage that ends now, and updates the peak memory.
+  void addStage(StageClock &clock, const char *name) {
+    stages.push_back(clock.lap(name));
+    peak_rss = process_peak_rss();
+  }
+
+  // Returns the sum of the stage times.
+  StageTime total() const;
+
+  // Saves the statistics to a JSON file. The predicate counts of the stages
+  // are included if PREDICATE_COUNTERS is defined.
+  void saveJSON(const char *filename) const;
+};
+
+#endif /* _MESH_STATS_ */
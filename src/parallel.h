@@ -0,0 +1,53 @@
+#ifndef _PARALLEL_
+#define _PARALLEL_
+
+#include "trace.h"
+#include <cfenv>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Number of threads used by the parallel stages of the pipeline.
+inline uint32_t parallel_num_threads() {
+  const uint32_t n = std::thread::hardware_concurrency();
+  return (n == 0) ? 1 : n;
+}
+
+// Runs job(i) for i = 0, ..., num_jobs-1, each one on its own thread.
+// Job 0 runs on the calling thread. Returns when all jobs are done.
+// Every job runs with the floating point environment of the calling thread
+// (rounding mode included), that new threads do not inherit on all
+// platforms. If a trace is being recorded, the jobs of the other threads
+// are spans named as the innermost span of the calling thread.
+template <class Job> void parallel_run(uint32_t num_jobs, Job job) {
+  fenv_t env;
+  fegetenv(&env);
+  const char *span = trace_current_span();
+  std::vector<std::thread> workers;
+  for (uint32_t i = 1; i < num_jobs; i++)
+    workers.emplace_back([&job, &env, span](uint32_t j) {
+      fesetenv(&env);
+      if (span != NULL) {
+        TraceSpan s(span);
+        job(j);
+      } else
+        job(j);
+    }, i);
+  if (num_jobs)
+    job(0);
+  for (std::thread &w : workers)
+    w.join();
+}
+
+// Saves the floating point environment of the calling thread and restores
+// it when destroyed. Stages that need a specific environment (e.g. initFPU)
+// set it within such a scope, so that the caller's one is left unchanged.
+class FPUscope {
+  fenv_t saved;
+
+public:
+  FPUscope() { fegetenv(&saved); }
+  ~FPUscope() { fesetenv(&saved); }
+};
+
+#endif /* _PARALLEL_ */
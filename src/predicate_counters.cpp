@@ -0,0 +1,74 @@
+#include "predicate_counters.h"
+#include <mutex>
+#include <string.h>
+
+void PredicateCounts::clear() {
+  memset(calls, 0, sizeof(calls));
+  memset(degenerate, 0, sizeof(degenerate));
+  memset(static_filter, 0, sizeof(static_filter));
+}
+
+PredicateCounts &PredicateCounts::operator+=(const PredicateCounts &c) {
+  for (int k = 0; k < PRED_NUM_KINDS; k++)
+    for (int t = 0; t < PRED_NUM_TYPES; t++) {
+      calls[k][t] += c.calls[k][t];
+      degenerate[k][t] += c.degenerate[k][t];
+      static_filter[k][t] += c.static_filter[k][t];
+    }
+  return *this;
+}
+
+PredicateCounts &PredicateCounts::operator-=(const PredicateCounts &c) {
+  for (int k = 0; k < PRED_NUM_KINDS; k++)
+    for (int t = 0; t < PRED_NUM_TYPES; t++) {
+      calls[k][t] -= c.calls[k][t];
+      degenerate[k][t] -= c.degenerate[k][t];
+      static_filter[k][t] -= c.static_filter[k][t];
+    }
+  return *this;
+}
+
+const char *PredicateCounts::kindName(int kind) {
+  static const char *names[PRED_NUM_KINDS] = {
+      "orient3d",         "orient2d",       "insphere",
+      "point_in_segment", "segments_cross", "point_in_triangle"};
+  return names[kind];
+}
+
+const char *PredicateCounts::typeName(int type) {
+  static const char *names[PRED_NUM_TYPES] = {"explicit", "lpi", "tpi"};
+  return names[type];
+}
+
+#ifdef PREDICATE_COUNTERS
+
+// Counts of the threads that have ended
+static std::mutex ended_mutex;
+static PredicateCounts ended_counts;
+
+// Counts of a thread, added to ended_counts when the thread ends
+struct ThreadPredicateCounts {
+  PredicateCounts counts;
+
+  ~ThreadPredicateCounts() {
+    std::lock_guard<std::mutex> lock(ended_mutex);
+    ended_counts += counts;
+  }
+};
+
+static thread_local ThreadPredicateCounts thread_counts;
+
+PredicateCounts &thread_predicate_counts() { return thread_counts.counts; }
+
+PredicateCounts predicate_counts() {
+  PredicateCounts c = thread_counts.counts;
+  std::lock_guard<std::mutex> lock(ended_mutex);
+  c += ended_counts;
+  return c;
+}
+
+#else
+
+PredicateCounts predicate_counts() { return PredicateCounts(); }
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef _PREDICATE_COUNTERS_
+#define _PREDICATE_COUNTERS_
+
+#include "implicit_point.h"
+#include <stdint.h>
+
+// Counters of the predicate calls made by the pipeline, enabled by building
+// with PREDICATE_COUNTERS defined (CMake option PREDICATE_COUNTERS). When it
+// is not defined, the counting code compiles to nothing.
+//
+// Calls are classified by predicate and by the most complex type of their
+// operands (explicit < LPI < TPI). For each class the counters record:
+//   calls         - all the calls,
+//   degenerate    - calls that returned 0 (sign predicates only). These
+//                   always require the exact evaluation, so they are a lower
+//                   bound on the exact evaluations,
+//   static_filter - calls decided by the semi-static filters of the Delaunay
+//                   insertion (explicit orient3d and insphere only, see
+//                   hasStaticFilter).
+// The filter, interval and exact stages of the predicate library itself are
+// not observable here: for LPI and TPI operands only calls and degenerate
+// carry data.
+// Each thread counts on its own; the counts of a thread are added to the
+// process totals when it ends. Totals are thus process-wide: concurrent
+// meshing jobs are counted together.
+
+enum PredicateKind {
+  PRED_ORIENT3D,
+  PRED_ORIENT2D,
+  PRED_INSPHERE,
+  PRED_POINT_IN_SEGMENT,
+  PRED_SEGMENTS_CROSS,
+  PRED_POINT_IN_TRIANGLE,
+  PRED_NUM_KINDS
+};
+
+enum PredicatePointType {
+  PRED_EXPLICIT,
+  PRED_LPI,
+  PRED_TPI,
+  PRED_NUM_TYPES
+};
+
+struct PredicateCounts {
+  uint64_t calls[PRED_NUM_KINDS][PRED_NUM_TYPES];
+  uint64_t degenerate[PRED_NUM_KINDS][PRED_NUM_TYPES];
+  uint64_t static_filter[PRED_NUM_KINDS][PRED_NUM_TYPES];
+
+  PredicateCounts() { clear(); }
+  void clear();
+
+  PredicateCounts &operator+=(const PredicateCounts &c);
+  PredicateCounts &operator-=(const PredicateCounts &c);
+
+  // Names used in the reports
+  static const char *kindName(int kind);
+  static const char *typeName(int type);
+
+  // True if the calls of this class can be decided by the static filters
+  static bool hasStaticFilter(int kind, int type) {
+    return type == PRED_EXPLICIT &&
+           (kind == PRED_ORIENT3D || kind == PRED_INSPHERE);
+  }
+};
+
+// Counts of the calling thread plus those of the threads that have ended
+// (all zero if PREDICATE_COUNTERS is not defined).
+PredicateCounts predicate_counts();
+
+#ifdef PREDICATE_COUNTERS
+
+// Counts of the calling thread
+PredicateCounts &thread_predicate_counts();
+
+inline int predicate_point_type(const genericPoint &p) {
+  if (p.isTPI())
+    return PRED_TPI;
+  return (p.isLPI()) ? (PRED_LPI) : (PRED_EXPLICIT);
+}
+
+inline int predicate_point_type(const genericPoint &a, const genericPoint &b) {
+  const int ta = predicate_point_type(a), tb = predicate_point_type(b);
+  return (ta > tb) ? (ta) : (tb);
+}
+
+inline int predicate_point_type(const genericPoint &a, const genericPoint &b,
+                                const genericPoint &c) {
+  const int tab = predicate_point_type(a, b), tc = predicate_point_type(c);
+  return (tab > tc) ? (tab) : (tc);
+}
+
+inline int predicate_point_type(const genericPoint &a, const genericPoint &b,
+                                const genericPoint &c, const genericPoint &d) {
+  const int tab = predicate_point_type(a, b), tcd = predicate_point_type(c, d);
+  return (tab > tcd) ? (tab) : (tcd);
+}
+
+#define COUNT_PREDICATE(kind, type)                                            \
+  (thread_predicate_counts().calls[kind][type]++)
+#define COUNT_PREDICATE_STATIC_FILTER(kind, type)                              \
+  (thread_predicate_counts().static_filter[kind][type]++)
+#define COUNT_PREDICATE_RESULT(kind, type, result)                             \
+  do {                                                                         \
+    PredicateCounts &pc_ = thread_predicate_counts();                          \
+    pc_.calls[kind][type]++;                                                   \
+    if ((result) == 0)                                                         \
+      pc_.degenerate[kind][type]++;                                            \
+  } while (0)
+
+#else
+
+#define COUNT_PREDICATE(kind, type) ((void)0)
+#define COUNT_PREDICATE_STATIC_FILTER(kind, type) ((void)0)
+#define COUNT_PREDICATE_RESULT(kind, type, result) ((void)0)
+
+#endif
+
+// Counted versions of the predicates of genericPoint used by the pipeline.
+// Without PREDICATE_COUNTERS they are plain calls.
+class CountedPredicates {
+public:
+  static int orient3D(const genericPoint &a, const genericPoint &b,
+                      const genericPoint &c, const genericPoint &d) {
+    const int o = genericPoint::orient3D(a, b, c, d);
+    COUNT_PREDICATE_RESULT(PRED_ORIENT3D, predicate_point_type(a, b, c, d),
+                           o);
+    return o;
+  }
+
+  static int orient2D(const genericPoint &a, const genericPoint &b,
+                      const genericPoint &c, int n) {
+    const int o = genericPoint::orient2D(a, b, c, n);
+    COUNT_PREDICATE_RESULT(PRED_ORIENT2D, predicate_point_type(a, b, c), o);
+    return o;
+  }
+
+  static int orient2Dxy(const genericPoint &a, const genericPoint &b,
+                        const genericPoint &c) {
+    const int o = genericPoint::orient2Dxy(a, b, c);
+    COUNT_PREDICATE_RESULT(PRED_ORIENT2D, predicate_point_type(a, b, c), o);
+    return o;
+  }
+
+  static int orient2Dyz(const genericPoint &a, const genericPoint &b,
+                        const genericPoint &c) {
+    const int o = genericPoint::orient2Dyz(a, b, c);
+    COUNT_PREDICATE_RESULT(PRED_ORIENT2D, predicate_point_type(a, b, c), o);
+    return o;
+  }
+
+  static int orient2Dzx(const genericPoint &a, const genericPoint &b,
+                        const genericPoint &c) {
+    const int o = genericPoint::orient2Dzx(a, b, c);
+    COUNT_PREDICATE_RESULT(PRED_ORIENT2D, predicate_point_type(a, b, c), o);
+    return o;
+  }
+
+  static bool pointInInnerSegment(const genericPoint &p,
+                                  const genericPoint &v1,
+                                  const genericPoint &v2, int xyz) {
+    COUNT_PREDICATE(PRED_POINT_IN_SEGMENT, predicate_point_type(p, v1, v2));
+    return genericPoint::pointInInnerSegment(p, v1, v2, xyz);
+  }
+
+  static bool innerSegmentsCross(const genericPoint &A, const genericPoint &B,
+                                 const genericPoint &P, const genericPoint &Q,
+                                 int xyz) {
+    COUNT_PREDICATE(PRED_SEGMENTS_CROSS, predicate_point_type(A, B, P, Q));
+    return genericPoint::innerSegmentsCross(A, B, P, Q, xyz);
+  }
+
+  static bool pointInTriangle(const genericPoint &P, const genericPoint &A,
+                              const genericPoint &B, const genericPoint &C,
+                              int xyz) {
+    COUNT_PREDICATE(PRED_POINT_IN_TRIANGLE, predicate_point_type(P, A, B, C));
+    return genericPoint::pointInTriangle(P, A, B, C, xyz);
+  }
+};
+
+#endif /* _PREDICATE_COUNTERS_ */
@@ -0,0 +1,133 @@
+#ifndef _SMALL_VECTOR_
+#define _SMALL_VECTOR_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+// Vector of trivially copyable elements that keeps up to N of them inline,
+// in place of the heap pointer. Longer vectors are moved to the heap.
+// Only the subset of the std::vector interface used by the BSP complex is
+// provided; iterators are plain pointers.
+template <class T, uint32_t N> class SmallVector {
+  static_assert(sizeof(T) * N >= sizeof(T *), "N is too small");
+
+  uint32_t num; // Number of elements
+  uint32_t cap; // Capacity (N if the elements are inline)
+  union {
+    T buf[N];
+    T *heap;
+  };
+
+  inline bool onHeap() const { return cap > N; }
+
+  void grow(uint32_t n) {
+    uint32_t new_cap = cap;
+    while (new_cap < n)
+      new_cap *= 2;
+    if (onHeap())
+      heap = (T *)realloc(heap, sizeof(T) * new_cap);
+    else {
+      T *h = (T *)malloc(sizeof(T) * new_cap);
+      memcpy(h, buf, sizeof(T) * num);
+      heap = h;
+    }
+    cap = new_cap;
+  }
+
+public:
+  SmallVector() : num(0), cap(N) {}
+
+  SmallVector(const SmallVector &v) : num(0), cap(N) {
+    assign(v.begin(), v.end());
+  }
+
+  SmallVector(SmallVector &&v) noexcept : num(v.num), cap(v.cap) {
+    memcpy(buf, v.buf, sizeof(buf));
+    v.num = 0;
+    v.cap = N;
+  }
+
+  ~SmallVector() {
+    if (onHeap())
+      free(heap);
+  }
+
+  SmallVector &operator=(const SmallVector &v) {
+    if (this != &v)
+      assign(v.begin(), v.end());
+    return *this;
+  }
+
+  SmallVector &operator=(SmallVector &&v) noexcept {
+    if (this != &v) {
+      if (onHeap())
+        free(heap);
+      num = v.num;
+      cap = v.cap;
+      memcpy(buf, v.buf, sizeof(buf));
+      v.num = 0;
+      v.cap = N;
+    }
+    return *this;
+  }
+
+  inline uint32_t size() const { return num; }
+  inline bool empty() const { return num == 0; }
+
+  inline T *data() { return onHeap() ? heap : buf; }
+  inline const T *data() const { return onHeap() ? heap : buf; }
+  inline T *begin() { return data(); }
+  inline const T *begin() const { return data(); }
+  inline T *end() { return data() + num; }
+  inline const T *end() const { return data() + num; }
+
+  inline T &operator[](size_t i) { return data()[i]; }
+  inline const T &operator[](size_t i) const { return data()[i]; }
+  inline T &back() { return data()[num - 1]; }
+  inline const T &back() const { return data()[num - 1]; }
+
+  void reserve(uint32_t n) {
+    if (n > cap)
+      grow(n);
+  }
+
+  inline void push_back(const T &x) {
+    if (num == cap) {
+      const T y = x; // x may be an element of this vector
+      grow(num + 1);
+      data()[num++] = y;
+    } else
+      data()[num++] = x;
+  }
+
+  inline void pop_back() { num--; }
+  inline void clear() { num = 0; }
+
+  // New elements are value-initialized, as std::vector does.
+  void resize(uint32_t n, const T &x = T()) {
+    reserve(n);
+    std::fill(data() + std::min(num, n), data() + n, x);
+    num = n;
+  }
+
+  template <class It> void assign(It first, It last) {
+    const uint32_t n = (uint32_t)std::distance(first, last);
+    num = 0;
+    reserve(n);
+    std::copy(first, last, data());
+    num = n;
+  }
+
+  // Inserts x before pos, returns the position of x.
+  T *insert(T *pos, const T &x) {
+    const uint32_t i = (uint32_t)(pos - begin());
+    push_back(x);
+    std::rotate(begin() + i, end() - 1, end());
+    return begin() + i;
+  }
+};
+
+#endif /* _SMALL_VECTOR_ */
@@ -0,0 +1,230 @@
+#include "BSP.h"
+#include "mesh_io.h"
+#include "synthetic_mesh.h"
+#include <cfenv>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Concurrency stress test of makePolyhedralMesh. Every case is meshed once
+// on the main thread, then copies of all the cases are meshed at the same
+// time, each one on its own thread and with several worker threads. The
+// test checks that every copy has the output of the sequential run, and
+// that each call leaves the floating point environment of its caller (a
+// different rounding mode per thread) unchanged.
+
+// Directory of the models tested by default (set by CMake)
+#ifndef STRESS_MODELS_DIR
+#define STRESS_MODELS_DIR "models"
+#endif
+
+static const char *default_models[] = {"mannequin.off"};
+
+// An input mesh, loaded once and shared by all the runs
+struct StressInput {
+  std::string name;
+  double *coords;
+  uint32_t npts;
+  uint32_t *tri_idx;
+  uint32_t ntri;
+
+  MeshView view() const { return MeshView(coords, npts, tri_idx, ntri); }
+};
+
+// Inputs A and B (NULL if op is '0') meshed with the operator op
+struct StressCase {
+  const StressInput *A, *B;
+  char op;
+};
+
+// Digest of the output of a run: sizes of the complex and a hash of its
+// tetrahedrization (see BSPcomplex::saveMesh).
+struct StressDigest {
+  uint64_t vertices, faces, cells, tets, hash;
+
+  bool operator==(const StressDigest &d) const {
+    return vertices == d.vertices && faces == d.faces && cells == d.cells &&
+           tets == d.tets && hash == d.hash;
+  }
+  bool operator!=(const StressDigest &d) const { return !(*this == d); }
+};
+
+// Result of a run: its digest, and whether the environment of the caller
+// was restored.
+struct StressRun {
+  StressDigest digest;
+  bool env_kept;
+};
+
+//  Input: hash: h, data: p of size bytes.
+// Output: returns h updated with the data (FNV-1a).
+static uint64_t fnv1a(uint64_t h, const void *p, size_t size) {
+  const unsigned char *c = (const unsigned char *)p;
+  for (size_t i = 0; i < size; i++)
+    h = (h ^ c[i]) * UINT64_C(0x100000001b3);
+  return h;
+}
+
+//  Input: test case: c, worker threads: num_threads, rounding mode of the
+//         caller: round.
+// Output: meshes the case with the given rounding mode and no exception
+//         flag set, returns the digest of the output computed in the
+//         default environment, and whether the call left the rounding mode
+//         and the flags unchanged.
+static StressRun run_case(const StressCase &c, uint32_t num_threads,
+                          int round) {
+  fesetenv(FE_DFL_ENV);
+  fesetround(round);
+  feclearexcept(FE_ALL_EXCEPT);
+  std::unique_ptr<BSPcomplex> complex = makePolyhedralMesh(
+      c.A->view(), (c.B) ? (c.B->view()) : (MeshView()), c.op, false,
+      num_threads);
+  StressRun r;
+  r.env_kept = (fegetround() == round && fetestexcept(FE_ALL_EXCEPT) == 0);
+
+  fesetenv(FE_DFL_ENV);
+  BSPtetrahedra t;
+  complex->tetrahedrize(c.op, t, num_threads);
+  uint64_t h = UINT64_C(0xcbf29ce484222325);
+  h = fnv1a(h, t.coords.data(), t.coords.size() * sizeof(double));
+  h = fnv1a(h, t.tets.data(), t.tets.size() * sizeof(uint32_t));
+  h = fnv1a(h, t.cell.data(), t.cell.size() * sizeof(uint64_t));
+  r.digest.vertices = complex->vertices.size();
+  r.digest.faces = complex->faces.size();
+  r.digest.cells = complex->cells.size();
+  r.digest.tets = t.tets.size() / 4;
+  r.digest.hash = h;
+  return r;
+}
+
+//  Input: path of a mesh file: filename, threads: num_threads.
+// Output: returns the mesh stored in the file.
+static StressInput load_input(const char *filename, uint32_t num_threads) {
+  StressInput m;
+  read_mesh_file(filename, &m.coords, &m.npts, &m.tri_idx, &m.ntri, false,
+                 num_threads);
+  const char *base = strrchr(filename, '/');
+  m.name = (base) ? (base + 1) : (filename);
+  return m;
+}
+
+//  Input: synthetic model (see synthetic_mesh.h) "kind:triangles": spec,
+//         seed.
+// Output: returns the generated mesh.
+static StressInput synthetic_input(const std::string &spec, uint64_t seed) {
+  const size_t colon = spec.find(':');
+  const std::string kind = spec.substr(0, colon);
+  const long num_triangles =
+      (colon == std::string::npos) ? (0) : (atol(spec.c_str() + colon + 1));
+  if (!is_synthetic_kind(kind.c_str()) || num_triangles <= 0)
+    ip_error("Invalid synthetic model\n");
+
+  StressInput m;
+  make_synthetic_mesh(kind.c_str(), (uint32_t)num_triangles, seed, &m.coords,
+                      &m.npts, &m.tri_idx, &m.ntri);
+  m.name = spec + "/" + std::to_string((unsigned long long)seed);
+  return m;
+}
+
+int main(int argc, char **argv) {
+  uint32_t copies = 2, num_threads = 2;
+  std::string synthetic = "spheres:2000";
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') {
+      if (argv[i][1] != '\0' && strchr("jtg", argv[i][1]) != NULL) {
+        if (++i == argc)
+          ip_error("Missing option argument\n");
+        const char opt = argv[i - 1][1];
+        if (opt == 'g')
+          synthetic = argv[i];
+        else if (opt == 'j') {
+          if ((copies = (uint32_t)atoi(argv[i])) == 0)
+            ip_error("The number of copies must be positive\n");
+        } else if ((num_threads = (uint32_t)atoi(argv[i])) < 2)
+          ip_error("The number of worker threads must be at least 2\n");
+      } else if (argv[i][1] == 'h') {
+        printf("\nUsage: mesh_generator_stress [-j copies | -t threads | "
+               "-g kind:triangles] [model ...]\n\n"
+               "Meshes each model alone, and a synthetic model alone and in "
+               "union with another one, first sequentially and then "
+               "concurrently, and checks that the outputs match and that "
+               "the floating point environment of the callers is kept.\n\n"
+               "-j copies = concurrent runs of each case (default 2)\n"
+               "-t threads = worker threads of each run, at least 2 "
+               "(default 2)\n"
+               "-g kind:triangles = synthetic model (see "
+               "mesh_generator_synth, default spheres:2000)\n"
+               "The default model is mannequin.off, in %s\n",
+               STRESS_MODELS_DIR);
+        return 0;
+      } else
+        ip_error("Unknown option\n");
+    } else
+      files.push_back(argv[i]);
+  }
+  if (files.empty())
+    for (const char *m : default_models)
+      files.push_back(std::string(STRESS_MODELS_DIR) + "/" + m);
+
+  std::vector<StressInput> inputs;
+  for (const std::string &f : files)
+    inputs.push_back(load_input(f.c_str(), num_threads));
+  inputs.push_back(synthetic_input(synthetic, 1));
+  inputs.push_back(synthetic_input(synthetic, 2));
+
+  std::vector<StressCase> cases;
+  for (size_t i = 0; i + 1 < inputs.size(); i++)
+    cases.push_back({&inputs[i], NULL, '0'});
+  cases.push_back({&inputs[inputs.size() - 2], &inputs.back(), 'U'});
+
+  // Reference outputs
+  std::vector<StressDigest> expected;
+  bool ok = true;
+  for (const StressCase &c : cases) {
+    const StressRun r = run_case(c, 1, FE_TONEAREST);
+    expected.push_back(r.digest);
+    ok &= r.env_kept;
+  }
+
+  // Concurrent runs: copies of every case, with different rounding modes.
+  static const int rounds[4] = {FE_TONEAREST, FE_UPWARD, FE_DOWNWARD,
+                                FE_TOWARDZERO};
+  const size_t num_runs = cases.size() * copies;
+  std::vector<StressRun> runs(num_runs);
+  std::vector<std::thread> threads;
+  for (size_t k = 0; k < num_runs; k++)
+    threads.emplace_back([&, k]() {
+      runs[k] = run_case(cases[k % cases.size()], num_threads, rounds[k % 4]);
+    });
+  for (std::thread &t : threads)
+    t.join();
+
+  for (size_t i = 0; i < cases.size(); i++) {
+    const StressCase &c = cases[i];
+    uint32_t mismatches = 0, env_changes = 0;
+    for (size_t k = i; k < num_runs; k += cases.size()) {
+      mismatches += (runs[k].digest != expected[i]);
+      env_changes += !runs[k].env_kept;
+    }
+    printf("%s %c %s: %llu cells, %llu tetrahedra, %u/%u mismatches, "
+           "%u environment changes\n",
+           c.A->name.c_str(), c.op, (c.B) ? (c.B->name.c_str()) : (""),
+           (unsigned long long)expected[i].cells,
+           (unsigned long long)expected[i].tets, mismatches, copies,
+           env_changes);
+    ok &= (mismatches == 0 && env_changes == 0);
+  }
+  fesetenv(FE_DFL_ENV);
+
+  for (StressInput &m : inputs) {
+    free(m.coords);
+    free(m.tri_idx);
+  }
+  printf((ok) ? ("Passed.\n") : ("FAILED.\n"));
+  return (ok) ? (0) : (1);
+}
@@ -0,0 +1,59 @@
+#include "mesh_io.h"
+#include "parallel.h"
+#include "synthetic_mesh.h"
+#include "implicit_point.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+int main(int argc, char **argv) {
+  uint32_t num_threads = 1;
+  uint64_t seed = 1;
+  std::vector<const char *> args;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-' && argv[i][1] == 'p')
+      num_threads = parallel_num_threads();
+    else if (argv[i][0] == '-' && argv[i][1] == 's') {
+      if (++i == argc)
+        ip_error("Missing option argument\n");
+      seed = (uint64_t)strtoull(argv[i], NULL, 10);
+    } else
+      args.push_back(argv[i]);
+  }
+
+  if (args.size() != 3 || !is_synthetic_kind(args[0]) || atol(args[1]) <= 0) {
+    printf("\nUsage: mesh_generator_synth [-p | -s seed] kind triangles "
+           "output.off\n\n"
+           "Generates a stress input of about the given number of triangles "
+           "in the unit cube, and saves it to an OFF file.\n\n"
+           "kind:\n"
+           "  spheres -> interpenetrating closed spheres\n"
+           "  soup    -> independent, mutually crossing triangles\n"
+           "  sheets  -> overlapping, nearly coplanar grids\n"
+           "  slivers -> long and thin closed prisms crossing each other\n"
+           "-p = use all the available processors to write the file\n"
+           "-s seed = seed of the random numbers (default 1)\n\n"
+           "Example:\n"
+           "mesh_generator_synth spheres 1000000 spheres.off\n");
+    return 0;
+  }
+
+  double *coords;
+  uint32_t *tri_idx, npts, ntri;
+  make_synthetic_mesh(args[0], (uint32_t)atol(args[1]), seed, &coords, &npts,
+                      &tri_idx, &ntri);
+  printf("%u vertices, %u triangles\n", npts, ntri);
+
+  std::vector<uint64_t> face_start(ntri + 1);
+  for (uint32_t i = 0; i <= ntri; i++)
+    face_start[i] = 3 * (uint64_t)i;
+  save_OFF_file(args[2], coords, npts, face_start.data(), ntri, tri_idx,
+                num_threads);
+
+  free(coords);
+  free(tri_idx);
+  printf("Done.\n");
+
+  return 0;
+}
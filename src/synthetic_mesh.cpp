@@ -0,0 +1,259 @@
+#include "synthetic_mesh.h"
+#include "implicit_point.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double pi = 3.14159265358979323846;
+
+// Deterministic random numbers (splitmix64)
+class SynthRandom {
+  uint64_t s;
+
+public:
+  SynthRandom(uint64_t seed) : s(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [a, b)
+  double uniform(double a = 0, double b = 1) {
+    return a + (b - a) * ((double)(next() >> 11) * (1.0 / 9007199254740992.0));
+  }
+};
+
+// Model being generated, with room for a known number of elements
+struct SynthMesh {
+  double *coords;
+  uint32_t *tris;
+  uint32_t npts, ntri;
+
+  SynthMesh() : coords(NULL), tris(NULL), npts(0), ntri(0) {}
+
+  // Makes room for max_pts vertices and max_tri triangles
+  void allocate(uint64_t max_pts, uint64_t max_tri) {
+    if (max_pts > UINT32_MAX || max_tri > UINT32_MAX)
+      ip_error("make_synthetic_mesh: FATAL ERROR model too large\n");
+    coords = (double *)malloc(sizeof(double) * 3 * max_pts);
+    tris = (uint32_t *)malloc(sizeof(uint32_t) * 3 * max_tri);
+    if (coords == NULL || tris == NULL)
+      ip_error("make_synthetic_mesh: FATAL ERROR out of memory\n");
+  }
+
+  uint32_t addVertex(double x, double y, double z) {
+    coords[3 * npts] = x;
+    coords[3 * npts + 1] = y;
+    coords[3 * npts + 2] = z;
+    return npts++;
+  }
+
+  void addTriangle(uint32_t a, uint32_t b, uint32_t c) {
+    tris[3 * ntri] = a;
+    tris[3 * ntri + 1] = b;
+    tris[3 * ntri + 2] = c;
+    ntri++;
+  }
+};
+
+//  Input: number of triangles: n, random numbers: rnd.
+// Output: fills m with spheres made of about 2000 triangles each (a single
+//         finer one if n is smaller), randomly placed so that they overlap
+//         twice the volume of the cube.
+static void synthetic_spheres(uint32_t n, SynthRandom &rnd, SynthMesh &m) {
+  // A sphere has nlat bands of 2 * nlat quads: 4 * nlat * (nlat - 1)
+  // triangles.
+  const uint32_t nlat =
+      std::max(3u, std::min(23u, (uint32_t)((1 + sqrt(1.0 + n)) / 2)));
+  const uint32_t nlon = 2 * nlat;
+  const uint32_t sphere_tris = 2 * nlon * (nlat - 1);
+  const uint32_t sphere_pts = 2 + (nlat - 1) * nlon;
+  const uint32_t num_spheres = std::max(1u, n / sphere_tris);
+  const double radius =
+      std::min(0.25, cbrt(3.0 * 2.0 / (4.0 * pi * num_spheres)));
+
+  m.allocate((uint64_t)num_spheres * sphere_pts,
+             (uint64_t)num_spheres * sphere_tris);
+  for (uint32_t s = 0; s < num_spheres; s++) {
+    double c[3];
+    for (int j = 0; j < 3; j++)
+      c[j] = rnd.uniform(radius, 1 - radius);
+    const double phase = rnd.uniform(0, 2 * pi / nlon);
+
+    const uint32_t north = m.addVertex(c[0], c[1], c[2] + radius);
+    const uint32_t first = m.npts;
+    for (uint32_t i = 1; i < nlat; i++) {
+      const double theta = pi * i / nlat;
+      for (uint32_t j = 0; j < nlon; j++) {
+        const double phi = phase + 2 * pi * j / nlon;
+        m.addVertex(c[0] + radius * sin(theta) * cos(phi),
+                    c[1] + radius * sin(theta) * sin(phi),
+                    c[2] + radius * cos(theta));
+      }
+    }
+    const uint32_t south = m.addVertex(c[0], c[1], c[2] - radius);
+
+    // Outward oriented triangles
+    for (uint32_t j = 0; j < nlon; j++) {
+      const uint32_t j1 = (j + 1) % nlon;
+      m.addTriangle(north, first + j, first + j1);
+      for (uint32_t i = 0; i + 2 < nlat; i++) {
+        const uint32_t a = first + i * nlon, b = a + nlon;
+        m.addTriangle(a + j, b + j, b + j1);
+        m.addTriangle(a + j, b + j1, a + j1);
+      }
+      const uint32_t last = first + (nlat - 2) * nlon;
+      m.addTriangle(south, last + j1, last + j);
+    }
+  }
+}
+
+//  Input: number of triangles: n, random numbers: rnd.
+// Output: fills m with n unconnected triangles with random vertices close to
+//         random centers, sized so that each one crosses a few others.
+static void synthetic_soup(uint32_t n, SynthRandom &rnd, SynthMesh &m) {
+  const double size = std::min(0.25, 0.5 / cbrt((double)n));
+  m.allocate(3 * (uint64_t)n, n);
+  for (uint32_t t = 0; t < n; t++) {
+    double c[3];
+    for (int j = 0; j < 3; j++)
+      c[j] = rnd.uniform(size, 1 - size);
+    uint32_t v[3];
+    for (int k = 0; k < 3; k++)
+      v[k] = m.addVertex(c[0] + rnd.uniform(-size, size),
+                         c[1] + rnd.uniform(-size, size),
+                         c[2] + rnd.uniform(-size, size));
+    m.addTriangle(v[0], v[1], v[2]);
+  }
+}
+
+//  Input: number of triangles: n, random numbers: rnd.
+// Output: fills m with 8 (fewer if n is tiny) square grids covering most of
+//         the plane z = 1/2, each one shifted by a fraction of a cell and
+//         tilted by about 1e-6, so that they overlap and cross at tiny
+//         angles.
+static void synthetic_sheets(uint32_t n, SynthRandom &rnd, SynthMesh &m) {
+  const uint32_t num_sheets = std::max(1u, std::min(8u, n / 2));
+  const uint32_t cells = std::max(
+      1u, (uint32_t)sqrt((double)n / (2.0 * num_sheets)));
+  const double h = 0.8 / cells;
+
+  m.allocate((uint64_t)num_sheets * (cells + 1) * (cells + 1),
+             (uint64_t)num_sheets * 2 * cells * cells);
+  for (uint32_t s = 0; s < num_sheets; s++) {
+    const double ox = rnd.uniform(0, h), oy = rnd.uniform(0, h);
+    const double ax = rnd.uniform(-1e-6, 1e-6), ay = rnd.uniform(-1e-6, 1e-6);
+    const double az = rnd.uniform(-1e-6, 1e-6);
+    const uint32_t first = m.npts;
+    for (uint32_t i = 0; i <= cells; i++)
+      for (uint32_t j = 0; j <= cells; j++) {
+        const double x = 0.1 + ox + i * h, y = 0.1 + oy + j * h;
+        m.addVertex(x, y, 0.5 + az + ax * (x - 0.5) + ay * (y - 0.5));
+      }
+    for (uint32_t i = 0; i < cells; i++)
+      for (uint32_t j = 0; j < cells; j++) {
+        const uint32_t a = first + i * (cells + 1) + j, b = a + cells + 1;
+        m.addTriangle(a, b, b + 1);
+        m.addTriangle(a, b + 1, a + 1);
+      }
+  }
+}
+
+//  Input: number of triangles: n, random numbers: rnd.
+// Output: fills m with n / 8 closed triangular prisms (8 triangles each)
+//         between random points at least 0.3 apart. Their width decreases with
+//         their number, so that each one crosses a few others.
+static void synthetic_slivers(uint32_t n, SynthRandom &rnd, SynthMesh &m) {
+  const uint32_t num_prisms = std::max(1u, n / 8);
+  const double width = std::min(0.01, 4.0 / num_prisms);
+
+  m.allocate(6 * (uint64_t)num_prisms, 8 * (uint64_t)num_prisms);
+  for (uint32_t s = 0; s < num_prisms; s++) {
+    double p[3], q[3], d[3], l;
+    do {
+      for (int j = 0; j < 3; j++) {
+        p[j] = rnd.uniform(0.05, 0.95);
+        q[j] = rnd.uniform(0.05, 0.95);
+        d[j] = q[j] - p[j];
+      }
+      l = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    } while (l < 0.3);
+    for (int j = 0; j < 3; j++)
+      d[j] /= l;
+
+    // Orthonormal u, v with u x v = d
+    const int k = (fabs(d[0]) < fabs(d[1]))
+                      ? ((fabs(d[0]) < fabs(d[2])) ? (0) : (2))
+                      : ((fabs(d[1]) < fabs(d[2])) ? (1) : (2));
+    double u[3] = {0, 0, 0}, v[3];
+    u[k] = 1;
+    const double ud = u[0] * d[0] + u[1] * d[1] + u[2] * d[2];
+    for (int j = 0; j < 3; j++)
+      u[j] -= ud * d[j];
+    const double lu = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    for (int j = 0; j < 3; j++)
+      u[j] /= lu;
+    v[0] = d[1] * u[2] - d[2] * u[1];
+    v[1] = d[2] * u[0] - d[0] * u[2];
+    v[2] = d[0] * u[1] - d[1] * u[0];
+
+    // Cross-section: equilateral triangle, counterclockwise around d
+    uint32_t pv[3], qv[3];
+    for (int c = 0; c < 3; c++) {
+      const double a = 2 * pi * c / 3;
+      double o[3];
+      for (int j = 0; j < 3; j++)
+        o[j] = width * (cos(a) * u[j] + sin(a) * v[j]);
+      pv[c] = m.addVertex(p[0] + o[0], p[1] + o[1], p[2] + o[2]);
+      qv[c] = m.addVertex(q[0] + o[0], q[1] + o[1], q[2] + o[2]);
+    }
+
+    // Outward oriented triangles
+    m.addTriangle(pv[0], pv[2], pv[1]);
+    m.addTriangle(qv[0], qv[1], qv[2]);
+    for (int c = 0; c < 3; c++) {
+      const int c1 = (c + 1) % 3;
+      m.addTriangle(pv[c], pv[c1], qv[c1]);
+      m.addTriangle(pv[c], qv[c1], qv[c]);
+    }
+  }
+}
+
+static const char *synthetic_kinds[] = {"spheres", "soup", "sheets",
+                                        "slivers"};
+
+bool is_synthetic_kind(const char *kind) {
+  for (const char *k : synthetic_kinds)
+    if (strcmp(kind, k) == 0)
+      return true;
+  return false;
+}
+
+void make_synthetic_mesh(const char *kind, uint32_t num_triangles,
+                         uint64_t seed, double **vertices_p, uint32_t *npts,
+                         uint32_t **tri_vertices_p, uint32_t *ntri) {
+  if (num_triangles == 0)
+    ip_error("make_synthetic_mesh: FATAL ERROR no triangles requested\n");
+
+  SynthRandom rnd(seed);
+  SynthMesh m;
+  if (strcmp(kind, "spheres") == 0)
+    synthetic_spheres(num_triangles, rnd, m);
+  else if (strcmp(kind, "soup") == 0)
+    synthetic_soup(num_triangles, rnd, m);
+  else if (strcmp(kind, "sheets") == 0)
+    synthetic_sheets(num_triangles, rnd, m);
+  else if (strcmp(kind, "slivers") == 0)
+    synthetic_slivers(num_triangles, rnd, m);
+  else
+    ip_error("make_synthetic_mesh: FATAL ERROR unknown kind\n");
+
+  *vertices_p = m.coords;
+  *npts = m.npts;
+  *tri_vertices_p = m.tris;
+  *ntri = m.ntri;
+}
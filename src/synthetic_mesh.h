@@ -0,0 +1,24 @@
+#ifndef _SYNTHETIC_MESH_
+#define _SYNTHETIC_MESH_
+
+#include <stdint.h>
+
+// Generators of stress inputs for scaling tests. Like the readers of
+// mesh_io.h, they fill the serialized arrays consumed by makePolyhedralMesh
+// (allocated with malloc, ownership passes to the caller). The models fit
+// the unit cube and depend only on kind, num_triangles and seed:
+//   spheres - interpenetrating closed spheres (about 2000 triangles each),
+//   soup    - independent triangles, each crossing a few others,
+//   sheets  - overlapping, nearly coplanar grids (open surfaces),
+//   slivers - closed, long and thin triangular prisms crossing each other.
+// The number of triangles is about num_triangles.
+
+// Returns true if kind is one of the kinds above.
+bool is_synthetic_kind(const char *kind);
+
+// Generates a model of the given kind (ip_error if kind is unknown).
+void make_synthetic_mesh(const char *kind, uint32_t num_triangles,
+                         uint64_t seed, double **vertices_p, uint32_t *npts,
+                         uint32_t **tri_vertices_p, uint32_t *ntri);
+
+#endif /* _SYNTHETIC_MESH_ */
@@ -0,0 +1,133 @@
+#include "trace.h"
+#include "implicit_point.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+std::atomic<bool> trace_recording(false);
+
+// A recorded span
+struct TraceEvent {
+  const char *name;
+  uint32_t tid;
+  int64_t start, duration; // Nanoseconds
+  uint64_t count;
+};
+
+// Time of trace_start, in nanoseconds of the steady clock. It is stored
+// before trace_recording is set (release) and loaded after trace_recording
+// is found set (acquire).
+static std::atomic<int64_t> trace_origin(0);
+
+// Spans of the threads that have ended, and the ids of the threads that
+// have ended. Ids are reused, so that the short-lived workers of
+// parallel_run share a few rows of the timeline.
+static std::mutex ended_mutex;
+static std::vector<TraceEvent> ended_events;
+static std::vector<uint32_t> free_tids;
+static uint32_t num_tids = 0;
+
+// Spans of a thread, added to ended_events when the thread ends
+struct ThreadTrace {
+  uint32_t tid;
+  const char *current; // Innermost open span
+  std::vector<TraceEvent> events;
+
+  ThreadTrace() : current(NULL) {
+    std::lock_guard<std::mutex> lock(ended_mutex);
+    if (free_tids.empty())
+      tid = ++num_tids;
+    else {
+      std::vector<uint32_t>::iterator t =
+          std::min_element(free_tids.begin(), free_tids.end());
+      tid = *t;
+      free_tids.erase(t);
+    }
+  }
+  ~ThreadTrace() {
+    std::lock_guard<std::mutex> lock(ended_mutex);
+    ended_events.insert(ended_events.end(), events.begin(), events.end());
+    free_tids.push_back(tid);
+  }
+};
+
+static thread_local ThreadTrace thread_trace;
+
+static int64_t steady_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static int64_t trace_now() {
+  return steady_now() - trace_origin.load(std::memory_order_relaxed);
+}
+
+void TraceSpan::begin(const char *n) {
+  name = n;
+  parent = thread_trace.current;
+  thread_trace.current = n;
+  start = trace_now();
+}
+
+void TraceSpan::end() {
+  thread_trace.current = parent;
+  if (!trace_recording.load(std::memory_order_acquire))
+    return;
+  TraceEvent e = {name, thread_trace.tid, start, trace_now() - start, count};
+  thread_trace.events.push_back(e);
+}
+
+const char *trace_current_span() {
+  if (!trace_recording.load(std::memory_order_acquire))
+    return NULL;
+  return thread_trace.current;
+}
+
+void trace_start() {
+  if (trace_recording.load(std::memory_order_acquire))
+    ip_error("trace_start: FATAL ERROR a trace is already being recorded\n");
+  thread_trace.events.clear();
+  std::lock_guard<std::mutex> lock(ended_mutex);
+  ended_events.clear();
+  trace_origin.store(steady_now(), std::memory_order_relaxed);
+  trace_recording.store(true, std::memory_order_release);
+}
+
+void trace_save(const char *filename) {
+  trace_recording.store(false, std::memory_order_release);
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(ended_mutex);
+    events.swap(ended_events);
+  }
+  events.insert(events.end(), thread_trace.events.begin(),
+                thread_trace.events.end());
+  thread_trace.events.clear();
+  std::sort(events.begin(), events.end(),
+            [](const TraceEvent &a, const TraceEvent &b) {
+              return (a.start != b.start) ? (a.start < b.start)
+                                          : (a.duration > b.duration);
+            });
+
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    ip_error("trace_save: FATAL ERROR cannot open the file\n");
+  fprintf(f, "{\"displayTimeUnit\": \"ms\",\n \"traceEvents\": [");
+  for (size_t i = 0; i < events.size(); i++) {
+    const TraceEvent &e = events[i];
+    fprintf(f,
+            "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+            "\"ts\": %.3f, \"dur\": %.3f",
+            (i) ? (",") : (""), e.name, e.tid, e.start * 1e-3,
+            e.duration * 1e-3);
+    if (e.count != UINT64_MAX)
+      fprintf(f, ", \"args\": {\"n\": %llu}", (unsigned long long)e.count);
+    fprintf(f, "}");
+  }
+  fprintf(f, "\n ]}\n");
+  if (fclose(f) != 0)
+    ip_error("trace_save: FATAL ERROR cannot write the file\n");
+}
@@ -0,0 +1,68 @@
+#ifndef _TRACE_
+#define _TRACE_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Timeline of the pipeline. Scoped spans (TRACE_SPAN) are recorded between
+// trace_start and trace_save, which writes them in the Chrome trace event
+// format (load it in chrome://tracing or https://ui.perfetto.dev).
+// While no trace is being recorded a span only loads a flag.
+//
+// Each thread records its spans on its own and hands them over when it
+// ends, so that the timeline has one row per thread. The workers started by
+// parallel_run get a span named as the one enclosing the call.
+//
+// A trace is process-wide: it records the spans of all the threads. Jobs
+// that run concurrently must thus not call trace_start and trace_save
+// independently: one thread records a single trace of all of them.
+
+// Starts recording, discarding the spans of an earlier trace. A trace must
+// not be already being recorded.
+void trace_start();
+
+// Stops recording and saves the spans of the calling thread and of the
+// threads that have ended (those of threads still running are not saved).
+void trace_save(const char *filename);
+
+// Name of the innermost span of the calling thread (NULL if none is being
+// recorded).
+const char *trace_current_span();
+
+extern std::atomic<bool> trace_recording;
+
+class TraceSpan {
+  const char *name;   // NULL if the span is not recorded
+  const char *parent; // Span enclosing this one
+  int64_t start;      // Nanoseconds since trace_start
+  uint64_t count;     // Number of items processed (UINT64_MAX if not set)
+
+  void begin(const char *n);
+  void end();
+
+public:
+  // name must outlive the trace (e.g. a string literal)
+  explicit TraceSpan(const char *n) : name(NULL), count(UINT64_MAX) {
+    if (trace_recording.load(std::memory_order_acquire))
+      begin(n);
+  }
+  ~TraceSpan() {
+    if (name != NULL)
+      end();
+  }
+
+  // Sets the number of items processed, saved as the argument "n".
+  void setCount(uint64_t n) { count = n; }
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Records the rest of the enclosing scope as a span called name.
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif /* _TRACE_ */